@@ -16,6 +16,8 @@
 #include <string>
 #include <fstream>
 #include <iostream>
+#include <atomic>
+#include <mutex>
 
 #include "xdaq/Application.h"
 
@@ -33,6 +35,7 @@
 #include "xdata/String.h"
 #include "xdata/Vector.h"
 #include "xdata/UnsignedInteger32.h"
+#include "xdata/Boolean.h"
 
 #include "toolbox/mem/Reference.h"
 #include "b2in/nub/exception/Exception.h"
@@ -44,6 +47,14 @@
 #include "toolbox/squeue.h"
 
 #include "bril/pltslinkprocessor/EventAnalyzer.h"
+#include "bril/pltslinkprocessor/SlinkRing.h"
+#include "bril/pltslinkprocessor/PipelineMetrics.h"
+#include "bril/pltslinkprocessor/SlinkPipeline.h"
+
+namespace zmq{
+    class context_t;
+    class message_t;
+}
 
 namespace toolbox{
     namespace task{
@@ -65,6 +76,7 @@ namespace bril
                 ~Application ();
 
                 void Default (xgi::Input * in, xgi::Output * out) throw (xgi::exception::Exception);
+                void Metrics (xgi::Input * in, xgi::Output * out) throw (xgi::exception::Exception);
                 void onMessage (toolbox::mem::Reference * ref, xdata::Properties & plist) throw (b2in::nub::exception::Exception);
                 virtual void actionPerformed(xdata::Event& e);
                 virtual void actionPerformed(toolbox::Event& e);
@@ -73,13 +85,14 @@ namespace bril
 
             private:
                 bool publishing(toolbox::task::WorkLoop* wl);
+                void publishLumiSection(const LumiSectionSummary& summary);
+                void publishBXHistograms(const LumiSectionSummary& summary);
                 void doPublish(const std::string& busname,const std::string& topicname,toolbox::mem::Reference* bufRef);
                 void subscribeAll();
                 void zmqClient();
+                void slinkReceiver(zmq::context_t* context);
                 void makePlots();	
 
-                void initializeOutputFiles(unsigned runNumber, vector<unsigned> channels);
-
             protected:
 
                 void startTimer();
@@ -113,6 +126,33 @@ namespace bril
                 xdata::String m_bus;
                 xdata::String m_workloopHost;
                 xdata::String m_slinkHost;
+
+                // Run the full reconstruction (clusters, tracks) for the efficiency and
+                // accidental analysis. Without it only the fast zero-counting lumi is made.
+                xdata::Boolean m_fullReconstruction;
+
+                // Threads (zmqClient's own included) that reconstruct and analyze
+                // the telescopes of an event in parallel; 1 does it all in zmqClient
+                xdata::UnsignedInteger32 m_reconstructionThreads;
+
+                // Memory (MB) for a table of the charges of every pixel and ADC
+                // value, 0 for none, and whether it is in half precision
+                xdata::UnsignedInteger32 m_chargeTableMB;
+                xdata::Boolean m_chargeTableHalf;
+
+                // Slink messages on their way from the receive thread to zmqClient
+                SlinkRing<zmq::message_t>* m_slinkRing;
+                static const size_t SLINK_RING_SLOTS = 4096;
+
+                // zmqClient and its receive thread run until m_stopping is set;
+                // m_zmqClientRunning is held while zmqClient runs, so that the
+                // destructor can wait for it before the ring and context go
+                zmq::context_t* m_zmqContext;
+                std::atomic<bool> m_stopping;
+                std::mutex m_zmqClientRunning;
+
+                // Live counters for the web page and the metrics endpoint
+                PipelineMetrics m_metrics;
                 typedef std::multimap< std::string, std::string > TopicStore;
                 typedef std::multimap< std::string, std::string >::iterator TopicStoreIt;
                 TopicStore m_out_topicTobuses;
@@ -125,10 +165,11 @@ namespace bril
                 typedef std::map<std::string, toolbox::squeue< toolbox::mem::Reference* >* >::iterator QueueStoreIt;
                 QueueStore m_topicoutqueues;
 
-                // files for validation
-                ofstream effFile;
-                ofstream accFile;
-                ofstream lumiFile;
+                // lumisections waiting for the publishing workloop
+                toolbox::squeue< LumiSectionSummary* > m_lumiSections;
+
+                // files for validation, written by the publishing workloop
+                LumiSectionFiles m_outputFiles;
 
                 std::map<std::string,std::string> m_outtopicdicts;
                 toolbox::task::WorkLoop* m_publishing;
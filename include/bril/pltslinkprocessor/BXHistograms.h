@@ -0,0 +1,129 @@
+#ifndef GUARD_BXHistograms_h
+#define GUARD_BXHistograms_h
+
+// Per bunch crossing counters for the fast luminosity path: for every BX the
+// number of triggered crossings, and for every channel the number of those
+// with a triple coincidence (all three planes hit). The crossings without
+// one are the zeros for zero counting, per BX.
+//
+// The counts live in one block allocated when the channels are set: a row of
+// triggers followed by a row per channel, each row a whole number of cache
+// lines and the block cache-line aligned. Fill() is a handful of increments
+// and never allocates.
+//
+// BX is the 0-based bunch crossing number from the event header (0-3563);
+// anything else is only counted in OutOfRange().
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+
+class BXHistograms
+{
+    public:
+        static const unsigned NBX = 3564;
+
+        BXHistograms() : _data(0), _outOfRange(0) {}
+        ~BXHistograms() { free(_data); }
+
+        // channels: FED channels to count, in the order of the rows. Starts
+        // counting afresh; only allocates if the channels are new.
+        void SetChannels(const std::vector<unsigned>& channels)
+        {
+            if (!_data || channels != _channels) {
+                free(_data);
+                _data = 0;
+                _channels = channels;
+                void* data = 0;
+                if (posix_memalign(&data, 64, Size() * sizeof(uint32_t)) == 0) {
+                    _data = (uint32_t*) data;
+                }
+            }
+            Clear();
+        }
+
+        void Clear()
+        {
+            if (_data) {
+                memset(_data, 0, Size() * sizeof(uint32_t));
+            }
+            _outOfRange = 0;
+        }
+
+        // Hot path: planeMasks as from PLTEventBatch::PlaneMasks, indexed by FED channel
+        void Fill(uint32_t bx, const uint8_t* planeMasks)
+        {
+            if (bx >= NBX || !_data) {
+                ++_outOfRange;
+                return;
+            }
+            ++_data[bx];
+            uint32_t* row = _data + STRIDE;
+            for (size_t i = 0; i != _channels.size(); ++i, row += STRIDE) {
+                row[bx] += (planeMasks[_channels[i]] == 7);
+            }
+        }
+
+        const std::vector<unsigned>& Channels() const { return _channels; }
+        unsigned long OutOfRange() const { return _outOfRange; }
+
+        // i is the index in Channels(), not the FED channel
+        uint32_t Triggers(unsigned bx) const          { return _data ? _data[bx] : 0; }
+        uint32_t Coincidences(size_t i, unsigned bx) const { return _data ? _data[(i + 1) * STRIDE + bx] : 0; }
+        uint32_t Zeros(size_t i, unsigned bx) const   { return Triggers(bx) - Coincidences(i, bx); }
+
+        // -ln of the fraction of crossings without a coincidence, 0 if it can't be measured
+        float ZeroCounting(size_t i, unsigned bx) const
+        {
+            uint32_t const triggers = Triggers(bx);
+            uint32_t const zeros    = Zeros(i, bx);
+            if (triggers == 0 || zeros == 0) {
+                return 0.;
+            }
+            return -log(double(zeros)/triggers);
+        }
+
+        // Hand over the counts in O(1), e.g. at the end of a lumisection
+        void Swap(BXHistograms& other)
+        {
+            std::swap(_data, other._data);
+            _channels.swap(other._channels);
+            std::swap(_outOfRange, other._outOfRange);
+        }
+
+        // Add the counts of other, which must count the same channels
+        void Add(const BXHistograms& other)
+        {
+            if (!other._data) {
+                return;
+            }
+            if (!_data) {
+                SetChannels(other._channels);
+            }
+            if (other._channels != _channels) {
+                return;
+            }
+            for (size_t i = 0; i != Size(); ++i) {
+                _data[i] += other._data[i];
+            }
+            _outOfRange += other._outOfRange;
+        }
+
+    private:
+        BXHistograms(const BXHistograms&);
+        BXHistograms& operator=(const BXHistograms&);
+
+        // NBX rounded up to a whole number of 64 byte cache lines
+        static const unsigned STRIDE = (NBX + 15) / 16 * 16;
+
+        size_t Size() const { return (_channels.size() + 1) * STRIDE; }
+
+        uint32_t*             _data;
+        std::vector<unsigned> _channels;
+        unsigned long         _outOfRange;
+};
+
+#endif
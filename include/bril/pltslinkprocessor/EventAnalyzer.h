@@ -6,10 +6,12 @@
 #include <fstream>
 #include <string>
 #include <cmath>
+#include <algorithm>
 
 #include "PLTEvent.h"
 #include "PLTPlane.h"
 #include "PLTBinaryFileReader.h"
+#include "BXHistograms.h"
 
 using namespace std;
 class EffCounter
@@ -30,33 +32,97 @@ class EffCounter
         unsigned numer[3];
 };
 
+// Everything counted for one telescope. Telescopes never share counters, so
+// they can be analyzed in parallel without locks (see AnalyzeEvent); each is
+// padded so that workers on neighbouring telescopes don't share cache lines.
+struct TelescopeCounters
+{
+    EffCounter hits;
+    EffCounter hitsDelayed;
+    std::pair<unsigned, unsigned> accidentals;
+    std::vector<std::pair<float, float> > twoHitTrackSlopes;
+    std::vector<std::pair<float, float> > threeHitTrackSlopes;
+    char padding[64];
+
+    TelescopeCounters() : accidentals(0, 0) {}
+};
+
+// Expected track slopes and residuals of one telescope, from tracks.csv
+struct TrackQuality
+{
+    float meanSlopeX, meanSlopeY;
+    float sigmaSlopeX, sigmaSlopeY;
+    float meanResidualX[3], meanResidualY[3];
+    float sigmaResidualX[3], sigmaResidualY[3];
+
+    TrackQuality() : meanSlopeX(0), meanSlopeY(0), sigmaSlopeX(0), sigmaSlopeY(0)
+    {
+        for (unsigned i = 0; i < 3; ++i) {
+            meanResidualX[i]  = 0;
+            meanResidualY[i]  = 0;
+            sigmaResidualX[i] = 0;
+            sigmaResidualY[i] = 0;
+        }
+    }
+};
+
 class EventAnalyzer
 {
     public:
-        EventAnalyzer() {};
+        EventAnalyzer() : _lumiBXCounter(0) { std::fill(_coincidences, _coincidences + NCHANNELS, 0ul); };
         EventAnalyzer(PLTEvent*, string, vector<unsigned>);
         ~EventAnalyzer() {};
 
         void          ReinitializeCounters();
+
+        // Analyzes the telescopes of the current event. If the event has
+        // reconstruction workers (PLTEvent::SetReconstructionThreads) the
+        // telescopes are spread over them.
         int           AnalyzeEvent();
+        void          AnalyzeTelescope(PLTTelescope&);
         void          CalculateTelescopeRates(unsigned, PLTTelescope&);
         void          CalculateAccidentalRates(PLTTelescope&);
         vector<float> GetTelescopeEfficiency(int);
         float         GetTelescopeAccidentals(int);
         float         GetZeroCounting(int);
 
+        // Fast luminosity path: needs only the planes hit in each channel (see
+        // PLTEventBatch::PlaneMasks), no reconstruction. A crossing counts as a
+        // coincidence for a channel if all three planes have a hit;
+        // GetFastZeroCounting is then -ln of the fraction of crossings without one.
+        // The same is also counted per BX (the one from the event header), see
+        // BXHistograms; TakeBXHistograms hands those counts over and starts
+        // them afresh, e.g. once per lumisection.
+        void          AnalyzeLumi(const uint8_t*, uint32_t);
+        float         GetFastZeroCounting(int);
+        unsigned long GetLumiBXCounter() { return _lumiBXCounter; }
+        const BXHistograms& GetBXHistograms() { return _bxHistograms; }
+        void          TakeBXHistograms(BXHistograms&);
+
+        // Used when several analyzers each see part of the data (e.g. replay threads):
+        // SetBXCounter sets the global ordinal of the first event this analyzer will
+        // see, and Merge adds the counters of another analyzer into this one.
+        void          SetBXCounter(unsigned long);
+        unsigned long GetBXCounter() { return _bxCounter; }
+        void          Merge(const EventAnalyzer&);
+
     private:
+        // telescopes are indexed by FED channel
+        static const unsigned NCHANNELS = 37;
+
         PLTEvent                 *_event;
         PLTAlignment             *_alignment;
         PLTPlane::FiducialRegion _fidRegionHits; 
 
         // counters
-        unsigned long _bxCounter, _delay;
-        std::map<unsigned, EffCounter> _telescopeHits;
-        std::map<unsigned, EffCounter> _telescopeHitsDelayed;
-        std::map<unsigned, std::pair<unsigned, unsigned> > _accidentalRates;
-        std::map<unsigned, std::vector<std::pair<float, float> > >  _twoHitTrackSlopes;
-        std::map<unsigned, std::vector<std::pair<float, float> > >  _threeHitTrackSlopes;
+        unsigned long _bxCounter, _bxStart, _delay;
+        TelescopeCounters _telescopes[NCHANNELS];
+
+        // fast luminosity counters, indexed by FED channel
+        std::vector<unsigned> _channels;
+        unsigned long _lumiBXCounter;
+        unsigned long _coincidences[NCHANNELS];
+        BXHistograms  _bxHistograms;
 
         // track quality selection parameters
         float _pixelDist;
@@ -65,10 +131,7 @@ class EventAnalyzer
         float _slopeXHigh;
         float _slopeYHigh;
 
-        std::map<unsigned, float> _meanSlopeX, _meanSlopeY;
-        std::map<unsigned, float> _sigmaSlopeX, _sigmaSlopeY;
-        std::map<unsigned, std::map<unsigned, float> > _meanResidualX, _meanResidualY;
-        std::map<unsigned, std::map<unsigned, float> > _sigmaResidualX, _sigmaResidualY;
+        TrackQuality _trackQuality[NCHANNELS];
 };
 
 #endif
@@ -10,16 +10,37 @@
 #include <set>
 
 #include "bril/pltslinkprocessor/PLTHit.h"
+#include "bril/pltslinkprocessor/PLTHitArrays.h"
 #include "bril/pltslinkprocessor/PLTPlane.h"
 #include "bril/pltslinkprocessor/PLTGainCal.h"
 #include "bril/pltslinkprocessor/PLTError.h"
+#include "bril/pltslinkprocessor/PLTEventIndex.h"
+#include "bril/pltslinkprocessor/PLTPixelMask.h"
+#include "bril/pltslinkprocessor/PLTGzipInput.h"
+#include "bril/pltslinkprocessor/PLTEventBatch.h"
+#include "bril/pltslinkprocessor/PLTEventFilter.h"
+
+class PLTEventArena;
 
 typedef enum InputTypeEnum {
   kBinaryFile,
   kTextFile,
-  kBuffer
+  kBuffer,
+  kMappedFile,
+  kGzipFile
 } InputType;
 
+// Generation of a slink file. Files from older versions of FEDStreamReader can
+// have duplicated hit pairs, an odd number of words in an event and header or
+// trailer words in either order, which ReadEventHitsBinary and ReadEventHitsMapped
+// work around on every word. Newer files have none of that and are read with a
+// straight decoder instead.
+typedef enum SlinkFormatEnum {
+  kFormatUnknown,
+  kFormatLegacy,
+  kFormatModern
+} SlinkFormat;
+
 class PLTBinaryFileReader
 {
   public:
@@ -30,23 +51,79 @@ class PLTBinaryFileReader
     bool Open (std::string const);
     bool OpenBinary (std::string const);
     bool OpenTextFile (std::string const);
+    bool OpenMappedFile (std::string const);
+    bool OpenGzipFile (std::string const);
+    void CloseMappedFile ();
     void SetInputType (InputType inputType);
 
     int  convPXL (int);
     bool DecodeSpyDataFifo (uint32_t, std::vector<PLTHit*>&, std::vector<PLTError>&, std::vector<int>&);
+    int  DecodeSpyDataFifoBatch (const uint32_t*, size_t const, PLTHitArrays&, std::vector<PLTError>&, std::vector<int>&);
     int  ReadEventHits (uint32_t*, uint32_t, std::vector<PLTHit*>&, std::vector<PLTError>&, unsigned long&, uint32_t&, uint32_t&, std::vector<int>&);
     int  ReadEventHitsBinary (std::vector<PLTHit*>&, std::vector<PLTError>&, unsigned long&, uint32_t&, uint32_t&, std::vector<int>&);
+    int  ReadEventHitsBinaryModern (std::vector<PLTHit*>&, std::vector<PLTError>&, unsigned long&, uint32_t&, uint32_t&, std::vector<int>&);
+    int  ReadEventHitsMapped (std::vector<PLTHit*>&, std::vector<PLTError>&, unsigned long&, uint32_t&, uint32_t&, std::vector<int>&);
+    int  ReadEventHitsMappedModern (std::vector<PLTHit*>&, std::vector<PLTError>&, unsigned long&, uint32_t&, uint32_t&, std::vector<int>&);
+    int  ReadEventHitsGzip (std::vector<PLTHit*>&, std::vector<PLTError>&, unsigned long&, uint32_t&, uint32_t&, std::vector<int>&);
     int  ReadEventHitsText (std::vector<PLTHit*>&, unsigned long&, uint32_t&, uint32_t&);
     int  ReadEventHitsBuffer (uint32_t*, uint32_t, std::vector<PLTHit*>&, std::vector<PLTError>&, unsigned long&, uint32_t&, uint32_t&, std::vector<int>&);
+    int  ReadEventBatch (const uint32_t*, size_t const, PLTEventBatch&);
 
     void ReadPixelMask (std::string const);
     void ReadOnlinePixelMask(const std::string maskFileName, const PLTGainCal& gainCal);
     bool IsPixelMasked (int const);
+    bool IsPixelMasked (int const Channel, int const ROC, int const Col, int const Row)
+    {
+      return fPixelMask.IsMasked(Channel, ROC, Col, Row);
+    }
 
     void SetPlaneFiducialRegion (PLTPlane::FiducialRegion);
 
+    // Events and hits that fail the filter are skipped while decoding; ReadEventHits
+    // only returns events that pass. With kBuffer input there is no next event to
+    // move on to, so for an event that fails it returns FILTEREDEVENT and the
+    // event number, time and BX are those of the rejected event.
+    void SetFilter (PLTEventFilter const& in) { fFilter = in; }
+    const PLTEventFilter& Filter () { return fFilter; }
+
+    static int const FILTEREDEVENT = -2;
+
+    // File format generation (binary and mapped input). It is detected from the
+    // first FORMATDETECTEVENTS events when the file is opened, unless it was set
+    // before with SetFormat.
+    SlinkFormat Format () { return fFormat; }
+    void SetFormat (SlinkFormat const in) { fFormat = in; }
+    static SlinkFormat DetectFormat (const uint32_t*, size_t const, size_t const MaxEvents = FORMATDETECTEVENTS);
+
+    static size_t const FORMATDETECTEVENTS = 1000;
+    static size_t const FORMATDETECTBYTES = 1 << 22;
+
+    // If an arena is set the hits are taken from it and must not be deleted by
+    // the caller; otherwise they are allocated with new and the caller owns them
+    void SetArena (PLTEventArena* in) { fArena = in; }
+
+    // Event index (binary, mapped and gzip input). LoadEventIndex reads the sidecar
+    // file if there is an up-to-date one and otherwise builds the index by scanning
+    // the file (and writes the sidecar). The Seek functions position the reader so
+    // that the next ReadEventHits returns the requested event.
+    bool BuildEventIndex ();
+    bool LoadEventIndex (bool const WriteSidecar = true);
+    bool SeekEvent (size_t const);
+    bool SeekEventRange (size_t const, size_t const);
+    bool SeekEventNumber (unsigned long const);
+    bool SeekEventTime (uint32_t const, uint32_t const EndTime = 0xffffffff);
+    const PLTEventIndex& EventIndex () { return fEventIndex; }
+    void SetEventIndex (const PLTEventIndex& in) { fEventIndex = in; }
+
+    // Byte offset of the header of the last event read (kMappedFile and kGzipFile), and
+    // an optional offset at which to stop looking for new events
+    uint64_t EventOffset () { return fEventOffset; }
+    void SetStopOffset (uint64_t const in) { fStopOffset = in; }
+
+    static uint64_t const NOSTOPOFFSET = 0xffffffffffffffffULL;
+
     PLTPlane::FiducialRegion fPlaneFiducialRegion;
-    const std::set<int>& PixelMask(){return fPixelMask;}
+    const PLTPixelMask& PixelMask(){return fPixelMask;}
 
   private:
     std::string fFileName;
@@ -55,8 +132,58 @@ class PLTBinaryFileReader
     uint32_t fLastTime;
     int fTimeMult;
     int fFEDID;
+    SlinkFormat fFormat;
+
+    // Day rollover: make the trailer time continuous across midnight
+    uint32_t UnrollTime (uint32_t const Time)
+    {
+      if (Time < fLastTime) {
+        ++fTimeMult;
+      }
+      fLastTime = Time;
+      return Time + 86400000 * fTimeMult;
+    }
+
+    PLTEventArena* fArena;
+    PLTHit* NewHit (int const, int const, int const, int const, int const);
+    void DiscardHits (std::vector<PLTHit*>&, size_t const);
+
+    PLTEventFilter fFilter;
+    int  ReadNextEventHits (uint32_t*, uint32_t, std::vector<PLTHit*>&, std::vector<PLTError>&, unsigned long&, uint32_t&, uint32_t&, std::vector<int>&);
+
+    // Memory-mapped input (kMappedFile): the whole file is mapped read-only and
+    // scanned word by word, fMappedPos is the index of the next 32-bit word to read
+    const uint32_t* fMappedData;
+    size_t fMappedBytes;
+    size_t fMappedSize;
+    size_t fMappedPos;
+
+    // Text input (kTextFile) is read in large blocks and parsed in place;
+    // [fTextPos, fTextEnd) is the part of fTextBuffer not parsed yet
+    std::vector<char> fTextBuffer;
+    size_t fTextPos;
+    size_t fTextEnd;
+    bool fTextEOF;
+    bool FillTextBuffer ();
+    static size_t const TEXTBUFFERSIZE = 1 << 22;
+
+    // Compressed slink file (kGzipFile), inflated on its own thread
+    PLTGzipInput fGzip;
+
+    PLTEventIndex fEventIndex;
+    uint64_t fEventOffset;
+    uint64_t fStopOffset;
+    bool fDecodeHits; // false when we only want the headers and trailers, e.g. to build the index
+
+    // Scratch space for the batch decoder, kept to avoid reallocating every event
+    std::vector<uint32_t> fBatchHitWords;
+    std::vector<uint32_t> fEventWords;
+    std::vector<PLTHit*> fBatchNoHits;
+    PLTHitArrays fBatchHits;
+    void FlushBatch (const uint32_t*, size_t const, std::vector<PLTHit*>&, std::vector<PLTError>&, std::vector<int>&);
+    void FlushEventBatch (const uint32_t*, size_t const, PLTEventBatch&);
 
-    std::set<int> fPixelMask;
+    PLTPixelMask fPixelMask;
 };
 
 
@@ -13,6 +13,7 @@ class PLTCluster
     ~PLTCluster ();
 
     void AddHit (PLTHit*);
+    void Clear ();
     float Charge ();
     size_t NHits ();
     PLTHit* Hit (size_t const);
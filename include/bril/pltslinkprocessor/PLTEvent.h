@@ -7,6 +7,9 @@
 #include "bril/pltslinkprocessor/PLTAlignment.h"
 #include "bril/pltslinkprocessor/PLTTracking.h"
 #include "bril/pltslinkprocessor/PLTError.h"
+#include "bril/pltslinkprocessor/PLTEventArena.h"
+#include "bril/pltslinkprocessor/PLTWorkerPool.h"
+#include "bril/pltslinkprocessor/PLTStageTimer.h"
 
 #include <map>
 
@@ -41,6 +44,33 @@ class PLTEvent : public PLTTracking
 
     PLTAlignment* GetAlignment ();
 
+    // Reconstruct the telescopes of an event (clustering and tracking) on a pool
+    // of NThreads workers, the calling thread included; 1 (the default) does it
+    // all on the calling thread. Each worker clusters and tracks with its own
+    // arena and tracking scratch, and a telescope is only ever touched by the
+    // worker that has it, so nothing is locked. The pool is also there for
+    // per-telescope analysis of the event, see EventAnalyzer::AnalyzeEvent.
+    // Changing it drops the current event.
+    void SetReconstructionThreads (int const NThreads);
+    int GetReconstructionThreads ()
+    {
+      return fPool ? fPool->NWorkers() : 1;
+    }
+    PLTWorkerPool* GetWorkerPool ()
+    {
+      return fPool;
+    }
+
+    // Time per event spent decoding, calibrating, aligning, clustering and
+    // tracking, see PLTStageTimer.h (empty unless built with PLT_STAGE_TIMING).
+    // Analysis of the event can add to it too. TakeStageTimes closes the
+    // current event, adds everything so far to Out and starts afresh.
+    PLTStageTimes& GetStageTimes ()
+    {
+      return fStageTimes;
+    }
+    void TakeStageTimes (PLTStageTimes& Out);
+
     unsigned long EventNumber ()
     { 
       return fEvent;
@@ -50,9 +80,22 @@ class PLTEvent : public PLTTracking
       return fHits.size();
     }
 
+    // Number of hits, or negative at the end. With a buffer whose event fails
+    // the filter it returns PLTBinaryFileReader::FILTEREDEVENT and there is no event.
     int GetNextEvent(void);
     int GetNextEvent(uint32_t* buf, uint32_t bufSize);
 
+    // Buffer holding several events back to back: decode them all with
+    // GetNextEventBatch and then step through them with SelectBatchEvent(i),
+    // which makes event i the current event. Layout problems are counted in the
+    // batch rather than printed.
+    int GetNextEventBatch (const uint32_t* buf, uint32_t bufSize);
+    int SelectBatchEvent (size_t const);
+    const PLTEventBatch& GetBatch ()
+    {
+      return fBatch;
+    }
+
     PLTGainCal* GetGainCal ()
     {
       return &fGainCal;
@@ -92,11 +135,54 @@ class PLTEvent : public PLTTracking
       return;
     }
     
-    const std::set<int>& PixelMask ()
+    const PLTPixelMask& PixelMask ()
     {
       return fBinFile.PixelMask();
     } 
 
+    // Only decode the events and hits selected by the filter, see PLTEventFilter
+    void SetFilter (PLTEventFilter const& in)
+    {
+      fBinFile.SetFilter(in);
+      return;
+    }
+
+    bool LoadEventIndex (bool const WriteSidecar = true)
+    {
+      return fBinFile.LoadEventIndex(WriteSidecar);
+    }
+
+    bool SeekEvent (size_t const i)
+    {
+      return fBinFile.SeekEvent(i);
+    }
+
+    bool SeekEventRange (size_t const First, size_t const End)
+    {
+      return fBinFile.SeekEventRange(First, End);
+    }
+
+    bool SeekEventNumber (unsigned long const Event)
+    {
+      return fBinFile.SeekEventNumber(Event);
+    }
+
+    bool SeekEventTime (uint32_t const BeginTime, uint32_t const EndTime = 0xffffffff)
+    {
+      return fBinFile.SeekEventTime(BeginTime, EndTime);
+    }
+
+    const PLTEventIndex& EventIndex ()
+    {
+      return fBinFile.EventIndex();
+    }
+
+    void SetEventIndex (const PLTEventIndex& in)
+    {
+      fBinFile.SetEventIndex(in);
+      return;
+    }
+
     int GetHardwareID (int const ch)
     {
       return fGainCal.GetHardwareID(ch);
@@ -127,8 +213,41 @@ class PLTEvent : public PLTTracking
     PLTPlane::Clustering fClustering;
     PLTPlane::FiducialRegion fFiducial;
 
-    std::map<int, PLTTelescope> fTelescopeMap;
-    std::map<std::pair<int, int>, PLTPlane> fPlaneMap;
+    // Events decoded by the last GetNextEventBatch
+    PLTEventBatch fBatch;
+
+    // The hits of the current event as arrays for the gaincal, when they
+    // were not decoded that way, and their charges
+    PLTHitArrays fCalibrationHits;
+    std::vector<float> fCharges;
+
+    // Hits, clusters and tracks of the current event come from here
+    PLTEventArena fArena;
+
+    // Hits handed to AddHit(PLTHit*) which we own and have to delete
+    std::vector<PLTHit*> fOwnedHits;
+
+    // Planes and telescopes are kept for the life of the event object and
+    // just cleared between events, indexed by FED channel (and ROC)
+    static int const NCHANNELS = 37;
+    static int const NROCS = 3;
+    PLTTelescope fTelescopeArray[NCHANNELS];
+    PLTPlane fPlaneArray[NCHANNELS][NROCS];
+    bool fChannelActive[NCHANNELS];
+    std::vector<int> fActiveChannels;
+
+    // Charges and positions of fHits; Arrays, if given, are the same hits
+    // as arrays from Begin on
+    void CalibrateHits (PLTHitArrays const* Arrays = 0, size_t const Begin = 0);
+    void ReconstructTelescope (int const Channel, PLTEventArena&, PLTTracking&, PLTStageTimes&);
+
+    // Reconstruction workers, see SetReconstructionThreads; 0 if there are none
+    PLTWorkerPool* fPool;
+    std::vector<PLTEventArena*> fWorkerArenas;
+    std::vector<PLTTracking*> fWorkerTracking;
+    std::vector<PLTStageTimes*> fWorkerStageTimes;
+
+    PLTStageTimes fStageTimes;
 
 };
 
@@ -0,0 +1,116 @@
+#ifndef GUARD_PLTEventArena_h
+#define GUARD_PLTEventArena_h
+
+// Per-event storage for the hits, clusters and tracks of one PLTEvent.
+//
+// Objects are handed out from typed pools which grow in blocks and are never
+// freed until the arena itself goes away. Reset() just rewinds the pools, so
+// clearing an event is O(1) and, once the pools have grown to the size of the
+// busiest event seen so far, processing an event does no heap allocation for
+// these objects at all. Objects that are handed out again keep the capacity of
+// their internal vectors, which is why they are cleared rather than rebuilt.
+//
+// Whoever gets an object from the arena must NOT delete it.
+
+#include <vector>
+#include <cstddef>
+
+#include "bril/pltslinkprocessor/PLTHit.h"
+#include "bril/pltslinkprocessor/PLTCluster.h"
+#include "bril/pltslinkprocessor/PLTTrack.h"
+
+
+template <class T> class PLTPool
+{
+  public:
+    PLTPool () : fUsed(0) {}
+
+    ~PLTPool ()
+    {
+      for (size_t i = 0; i != fBlocks.size(); ++i) {
+        delete [] fBlocks[i];
+      }
+    }
+
+    T* Get ()
+    {
+      if (fUsed == fObjects.size()) {
+        T* Block = new T[BLOCKSIZE];
+        fBlocks.push_back(Block);
+        for (size_t i = 0; i != BLOCKSIZE; ++i) {
+          fObjects.push_back(Block + i);
+        }
+      }
+      return fObjects[fUsed++];
+    }
+
+    void   Reset () { fUsed = 0; }
+    size_t NUsed () const { return fUsed; }
+    size_t NAllocated () const { return fObjects.size(); }
+
+  private:
+    // Not copyable: the objects are owned by the pool
+    PLTPool (PLTPool const&);
+    PLTPool& operator= (PLTPool const&);
+
+    static size_t const BLOCKSIZE = 256;
+
+    std::vector<T*> fBlocks;
+    std::vector<T*> fObjects;
+    size_t fUsed;
+};
+
+
+class PLTEventArena
+{
+  public:
+    PLTEventArena () {}
+    ~PLTEventArena () {}
+
+    PLTHit* NewHit (int const Channel, int const ROC, int const Column, int const Row, int const ADC)
+    {
+      PLTHit* Hit = fHits.Get();
+      *Hit = PLTHit(Channel, ROC, Column, Row, ADC);
+      return Hit;
+    }
+
+    PLTHit* NewHit (PLTHit const& In)
+    {
+      PLTHit* Hit = fHits.Get();
+      *Hit = In;
+      return Hit;
+    }
+
+    PLTCluster* NewCluster ()
+    {
+      PLTCluster* Cluster = fClusters.Get();
+      Cluster->Clear();
+      return Cluster;
+    }
+
+    PLTTrack* NewTrack ()
+    {
+      PLTTrack* Track = fTracks.Get();
+      Track->Clear();
+      return Track;
+    }
+
+    void Reset ()
+    {
+      fHits.Reset();
+      fClusters.Reset();
+      fTracks.Reset();
+      return;
+    }
+
+  private:
+    PLTEventArena (PLTEventArena const&);
+    PLTEventArena& operator= (PLTEventArena const&);
+
+    PLTPool<PLTHit> fHits;
+    PLTPool<PLTCluster> fClusters;
+    PLTPool<PLTTrack> fTracks;
+};
+
+
+#endif
@@ -0,0 +1,116 @@
+#ifndef GUARD_PLTEventBatch_h
+#define GUARD_PLTEventBatch_h
+
+// A batch of events decoded in one pass from a buffer holding several
+// back-to-back FED events (e.g. a multipart zmq message or a block of a file),
+// see PLTBinaryFileReader::ReadEventBatch. The hits, errors and desync channels
+// of all events are stored one after the other and each event keeps the range
+// of entries that belong to it. Everything is meant to be reused from buffer to
+// buffer so that nothing reallocates once the batch has grown to size.
+//
+// Layout problems in the buffer (a missing header or trailer, hits outside an
+// event, ...) are not printed but flagged on the event and counted; the
+// counters keep running over all buffers until ResetCounters() is called.
+
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+
+#include "bril/pltslinkprocessor/PLTHitArrays.h"
+#include "bril/pltslinkprocessor/PLTError.h"
+
+class PLTEventBatch
+{
+  public:
+    PLTEventBatch ()
+    {
+      ResetCounters();
+    }
+    ~PLTEventBatch () {}
+
+    enum EventFlag {
+      kNoHeader       = 0x01, // hit data or a trailer without a header before it
+      kNoTrailer      = 0x02, // the buffer ended before the trailer of this event
+      kTruncatedTDC   = 0x04, // the buffer ended inside the TDC block
+      kOddSize        = 0x08  // the buffer had an odd number of words; the last one was ignored
+    };
+
+    struct Entry
+    {
+      unsigned long Event;
+      uint32_t Time;
+      uint32_t BX;
+      int FEDID;
+      size_t HitBegin, HitEnd;
+      size_t ErrorBegin, ErrorEnd;
+      size_t DesyncBegin, DesyncEnd;
+      uint32_t Flags;
+
+      size_t NHits () const { return HitEnd - HitBegin; }
+    };
+
+    size_t NEvents () const { return fEvents.size(); }
+    Entry const& Event (size_t const i) const { return fEvents[i]; }
+
+    // For each FED channel, the planes (bit n for ROC n) with at least one hit
+    // in event i, e.g. 7 for a triple coincidence. Masks needs NCHANNELS entries.
+    // Hits are already masked and fiducial-checked by the decoder.
+    void PlaneMasks (size_t const i, uint8_t* Masks) const
+    {
+      for (int ch = 0; ch != NCHANNELS; ++ch) {
+        Masks[ch] = 0;
+      }
+      Entry const& e = fEvents[i];
+      for (size_t ih = e.HitBegin; ih != e.HitEnd; ++ih) {
+        Masks[fHits.fChannel[ih]] |= 1 << fHits.fROC[ih];
+      }
+      return;
+    }
+
+    static int const NCHANNELS = 37;
+
+    // Empty the batch for the next buffer. The counters are not touched.
+    void Clear ()
+    {
+      fEvents.clear();
+      fHits.Clear();
+      fErrors.clear();
+      fDesyncChannels.clear();
+      return;
+    }
+
+    void ResetCounters ()
+    {
+      fNBuffers = 0;
+      fNEvents = 0;
+      fNHits = 0;
+      fNOddSize = 0;
+      fNNoHeader = 0;
+      fNNoTrailer = 0;
+      fNTruncatedTDC = 0;
+      return;
+    }
+
+    // Number of layout problems of any kind since the last ResetCounters()
+    unsigned long NProblems () const
+    {
+      return fNOddSize + fNNoHeader + fNNoTrailer + fNTruncatedTDC;
+    }
+
+    std::vector<Entry> fEvents;
+    PLTHitArrays fHits;
+    std::vector<PLTError> fErrors;
+    std::vector<int> fDesyncChannels;
+
+    // Counters, summed over all buffers
+    unsigned long fNBuffers;
+    unsigned long fNEvents;
+    unsigned long fNHits;
+    unsigned long fNOddSize;
+    unsigned long fNNoHeader;
+    unsigned long fNNoTrailer;
+    unsigned long fNTruncatedTDC;
+};
+
+
+#endif
@@ -0,0 +1,159 @@
+#ifndef GUARD_PLTEventFilter_h
+#define GUARD_PLTEventFilter_h
+
+// Selection of events and hits that PLTBinaryFileReader applies while it
+// decodes, so that what is not selected never becomes a PLTHit.
+//
+// Event level: event number range, BX (any set of bunch crossings, e.g. the
+// colliding bunches) and time window. Event number and BX are known at the
+// header, so the words of an event that fails them are not decoded at all;
+// the time is only known at the trailer, where it is checked before the
+// collected words are decoded (for the modern binary decoder) or the event is
+// dropped after the fact (everywhere else).
+//
+// Hit level: FED channel and ROC (0-2). Words of other channels/ROCs are
+// dropped before a hit is made from them. Errors and desync channels are
+// always kept.
+//
+// Everything passes until something is selected.
+
+#include <vector>
+#include <stdint.h>
+
+class PLTEventFilter
+{
+  public:
+    PLTEventFilter ()
+    {
+      Clear();
+    }
+    ~PLTEventFilter () {}
+
+    void Clear ()
+    {
+      fChannelBits = ~(uint64_t) 0;
+      fROCBits = ~0u;
+      for (int i = 0; i != NBXWORDS; ++i) {
+        fBXBits[i] = ~(uint64_t) 0;
+      }
+      fFirstEvent = 0;
+      fLastEvent = ~0ul;
+      fBeginTime = 0;
+      fEndTime = 0xffffffff;
+      fHasChannels = false;
+      fHasBX = false;
+      return;
+    }
+
+    // Channels: the first call replaces "all channels" by just the one given
+    void SelectChannel (int const Channel)
+    {
+      if (!fHasChannels) {
+        fChannelBits = 0;
+        fHasChannels = true;
+      }
+      if (Channel >= 0 && Channel < 64) {
+        fChannelBits |= (uint64_t) 1 << Channel;
+      }
+      return;
+    }
+
+    void SelectChannels (std::vector<int> const& Channels)
+    {
+      for (std::vector<int>::const_iterator it = Channels.begin(); it != Channels.end(); ++it) {
+        SelectChannel(*it);
+      }
+      return;
+    }
+
+    // ROCs as a bit mask, bit 0 for ROC 0
+    void SelectROCs (unsigned const Mask)
+    {
+      fROCBits = Mask;
+      return;
+    }
+
+    // BX: the first call replaces "all BX" by just the ones given
+    void SelectBXRange (uint32_t const FirstBX, uint32_t const LastBX)
+    {
+      if (!fHasBX) {
+        for (int i = 0; i != NBXWORDS; ++i) {
+          fBXBits[i] = 0;
+        }
+        fHasBX = true;
+      }
+      for (uint32_t bx = FirstBX; bx <= LastBX && bx < 64 * NBXWORDS; ++bx) {
+        fBXBits[bx >> 6] |= (uint64_t) 1 << (bx & 63);
+      }
+      return;
+    }
+
+    void SelectBX (uint32_t const BX)
+    {
+      SelectBXRange(BX, BX);
+      return;
+    }
+
+    // Event numbers FirstEvent to LastEvent, inclusive
+    void SetEventRange (unsigned long const FirstEvent, unsigned long const LastEvent)
+    {
+      fFirstEvent = FirstEvent;
+      fLastEvent = LastEvent;
+      return;
+    }
+
+    // Times in [BeginTime, EndTime), as the reader returns them (for files that is
+    // after the day rollover correction, for buffers it is the raw trailer time)
+    void SetTimeRange (uint32_t const BeginTime, uint32_t const EndTime)
+    {
+      fBeginTime = BeginTime;
+      fEndTime = EndTime;
+      return;
+    }
+
+    bool PassHeader (unsigned long const Event, uint32_t const BX) const
+    {
+      return Event >= fFirstEvent && Event <= fLastEvent && BX < 64 * NBXWORDS && ((fBXBits[BX >> 6] >> (BX & 63)) & 1);
+    }
+
+    bool PassTime (uint32_t const Time) const
+    {
+      return Time >= fBeginTime && Time < fEndTime;
+    }
+
+    bool PassEvent (unsigned long const Event, uint32_t const BX, uint32_t const Time) const
+    {
+      return PassHeader(Event, BX) && PassTime(Time);
+    }
+
+    bool PassHit (int const Channel, int const ROC) const
+    {
+      return (unsigned) Channel < 64 && ((fChannelBits >> Channel) & 1) && (unsigned) ROC < 32 && ((fROCBits >> ROC) & 1);
+    }
+
+    bool SelectsEvents () const
+    {
+      return fHasBX || fFirstEvent != 0 || fLastEvent != ~0ul || fBeginTime != 0 || fEndTime != 0xffffffff;
+    }
+
+    bool SelectsHits () const
+    {
+      return fHasChannels || fROCBits != ~0u;
+    }
+
+  private:
+    static int const NBXWORDS = 64; // BX is a 12 bit field
+
+    uint64_t fChannelBits;
+    unsigned fROCBits;
+    uint64_t fBXBits[NBXWORDS];
+    unsigned long fFirstEvent;
+    unsigned long fLastEvent;
+    uint32_t fBeginTime;
+    uint32_t fEndTime;
+    bool fHasChannels;
+    bool fHasBX;
+};
+
+
+#endif
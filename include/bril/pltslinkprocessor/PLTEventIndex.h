@@ -0,0 +1,59 @@
+#ifndef GUARD_PLTEventIndex_h
+#define GUARD_PLTEventIndex_h
+
+// Index of the events in a slink binary file: for every event header we keep
+// the byte offset of the header in the file, the event number, the BX and the
+// (day-corrected) trailer time as returned by PLTBinaryFileReader. The index is
+// kept in a small sidecar file next to the data file (<file>.idx) so that it
+// only has to be built once per file.
+//
+// Sidecar layout (little endian, as written by this machine):
+//   char[8]  magic "PLTIDX01"
+//   uint64_t size of the indexed data file in bytes (used to detect stale indices)
+//   uint64_t number of entries
+//   entries, 18 bytes each: uint64_t offset, uint32_t event, uint32_t time, uint16_t bx
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+class PLTEventIndex
+{
+  public:
+    PLTEventIndex ();
+    ~PLTEventIndex ();
+
+    struct Entry {
+      uint64_t Offset; // byte offset of the event header in the data file
+      uint32_t Event;
+      uint32_t Time;
+      uint16_t BX;
+    };
+
+    void   Clear ();
+    void   AddEntry (uint64_t const, uint32_t const, uint32_t const, uint16_t const);
+    size_t NEvents () const { return fEntries.size(); }
+    const Entry& GetEntry (size_t const i) const { return fEntries[i]; }
+
+    // Lookups: all return the ordinal of the entry, or NEvents() if there is none
+    size_t FindEvent (unsigned long const) const;
+    size_t FindTime (uint32_t const) const;
+    size_t FindTimeAfter (uint32_t const) const;
+
+    bool Write (std::string const, uint64_t const);
+    bool Read (std::string const, uint64_t const);
+
+    uint64_t DataFileSize () const { return fDataFileSize; }
+
+    static std::string SidecarName (std::string const);
+
+  private:
+    std::vector<Entry> fEntries;
+    uint64_t fDataFileSize;
+
+    // Where each run of non-decreasing event numbers begins, for FindEvent
+    std::vector<size_t> fEventRuns;
+};
+
+
+#endif
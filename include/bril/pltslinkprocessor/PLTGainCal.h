@@ -6,6 +6,8 @@
 #include <string>
 #include <sstream>
 #include <map>
+#include <vector>
+#include <stdint.h>
 
 #include "TString.h"
 #include "TMath.h"
@@ -33,6 +35,16 @@ class PLTGainCal
 
     void  SetCharge (PLTHit&);
     float GetCharge(int const ch, int const roc, int const col, int const row, int adc);
+
+    // GetCharge for NHits hits given as arrays, into Charge. The hits of
+    // channels in the charge table get their charge from there, as with
+    // SetCharge, and only the others are computed. For 5 parameter fits the
+    // coefficients are gathered and the fit function evaluated 16 or 8 hits at
+    // a time where the CPU has AVX-512 or AVX2 and FMA (checked at run time),
+    // one at a time and exactly as GetCharge otherwise. The vectors work in
+    // float with a polynomial exp; see GetCharges5 for how far that is from
+    // GetCharge.
+    void  GetCharges (size_t const NHits, int const* ch, int const* roc, int const* col, int const* row, int const* adc, float* Charge);
     void  ReadGainCalFile (std::string const GainCalFileName);
   //void  ReadGainCalFile3 (std::string const GainCalFileName);
     void  ReadGainCalFile5 (std::string const GainCalFileName);
@@ -41,6 +53,23 @@ class PLTGainCal
 
     void CheckGainCalFile (std::string const GainCalFileName, int const Channel);
 
+    // Charge table: the charge of every pixel of the given channels at every
+    // ADC value, so that SetCharge is one load for their hits instead of the
+    // fit function. An empty list is all the channels of the gaincal file.
+    // Channels are taken in order while they fit in MaxBytes, 12.8 MB each in
+    // float and half that in half precision (relative error below 5E-4); the
+    // hits of the others still go through GetCharge. It pays as long as the
+    // parts of the table in use stay in the cache; pltbench measures both.
+    // Build it after reading the gaincal file, which clears it. Returns the
+    // number of channels.
+    enum ChargeTablePrecision {
+      kChargeTable_Float = 0,
+      kChargeTable_Half
+    };
+    int    BuildChargeTable (std::vector<int> const& Channels, size_t const MaxBytes, ChargeTablePrecision const Precision = kChargeTable_Float);
+    void   ClearChargeTable ();
+    size_t ChargeTableBytes () const;
+
     void PrintGainCal5 ();
 
     static int RowIndex (int const);
@@ -81,6 +110,41 @@ class PLTGainCal
     // Map for hardware locations by fed channel
     std::map<int, int> fHardwareMap;
 
+    // Charge table, [slot][roc][col][row][adc] as float or half, and the
+    // slot of each channel index or -1. The lookups are all over the table,
+    // so it is mapped on its own and in huge pages where the kernel can.
+    static int const NADCS = 256;
+    long ChargeTableIndex (int const ch, int const roc, int const col, int const row, int const adc) const;
+    static uint16_t FloatToHalf (float const);
+    static float    HalfToFloat (uint16_t const);
+
+    // GetCharges without the charge table, and the vectors for it. Against
+    // GetCharge (double, TMath::Exp) the float exp is within 1.2E-7 relative
+    // (its argument is clamped to +-88.4, and it is infinity above 88.7 as
+    // expf is), so the charge is within a few float roundings of its largest
+    // term: 3E-3 electrons at most over every pixel and ADC value of the
+    // pltbench fits, whose charges go up to 13000 electrons.
+    void ComputeCharges (size_t const NHits, int const* ch, int const* roc, int const* col, int const* row, int const* adc, float* Charge);
+#if defined(__x86_64__)
+    int  GetCharges5 (size_t const NHits, int const* ch, int const* roc, int const* col, int const* row, int const* adc, float* Charge);
+    __attribute__((target("avx512f")))
+    static size_t GetCharges5AVX512 (size_t const NHits, int const* ch, int const* roc, int const* col, int const* row, int const* adc, float const* Coefs, float* Charge, std::vector<size_t>& OutOfRange);
+    __attribute__((target("avx2,fma")))
+    static size_t GetCharges5AVX2 (size_t const NHits, int const* ch, int const* roc, int const* col, int const* row, int const* adc, float const* Coefs, float* Charge, std::vector<size_t>& OutOfRange);
+    std::vector<size_t> fOutOfRange;
+#endif
+
+    // Hits of GetCharges that are not in the charge table: their indices, and
+    // their ch, roc, col, row and adc arrays one after the other
+    std::vector<size_t> fMissIndex;
+    std::vector<int>    fMissHits;
+    std::vector<float>  fMissCharge;
+
+    int    fChargeTableSlot[MAXCHNS];
+    void*  fChargeTable;
+    size_t fChargeTableBytes;
+    bool   fChargeTableIsHalf;
+
 };
 
 
@@ -0,0 +1,94 @@
+#ifndef GUARD_PLTGzipInput_h
+#define GUARD_PLTGzipInput_h
+
+// Word stream over a gzip-compressed slink file (plain files work too, zlib
+// just passes them through). A separate thread inflates the file into a ring
+// of NBUFFERS buffers while the reader works through the buffer before, so
+// decompression and decoding overlap.
+//
+// The reader sees a plain sequence of 32-bit words through NextWord() and
+// PeekWord(); crossing from one buffer to the next is handled here, so the
+// header/trailer logic of the reader does not need to know about buffers.
+//
+// Seek() repositions the stream at an offset in the uncompressed data, e.g.
+// from the event index. gzip has no random access, so unless the offset is in
+// the buffer being read this inflates the file again up to the offset: from
+// the current inflate position when seeking forward, from the start otherwise.
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stdint.h>
+
+#include <zlib.h>
+
+class PLTGzipInput
+{
+  public:
+    PLTGzipInput ();
+    ~PLTGzipInput ();
+
+    bool Open (std::string const);
+    void Close ();
+    bool Seek (uint64_t const);
+
+    bool NextWord (uint32_t& Word)
+    {
+      if (fPos == fEnd && !NextBuffer()) {
+        return false;
+      }
+      Word = fWords[fPos++];
+      return true;
+    }
+
+    bool PeekWord (uint32_t& Word)
+    {
+      if (fPos == fEnd && !NextBuffer()) {
+        return false;
+      }
+      Word = fWords[fPos];
+      return true;
+    }
+
+    // Offset in bytes of the next word in the uncompressed stream
+    uint64_t Offset () const { return fBufferOffset + fPos * sizeof(uint32_t); }
+
+    static size_t const NBUFFERS = 4;
+    static size_t const BUFFERSIZE = 1 << 22; // bytes, multiple of 4
+
+  private:
+    void Start (uint64_t const);
+    void Stop ();
+    void Inflate ();
+    bool NextBuffer ();
+
+    gzFile fFile;
+    std::thread fThread;
+    std::mutex fMutex;
+    std::condition_variable fFilledCondition;
+    std::condition_variable fFreeCondition;
+
+    // Ring of buffers. The inflate thread fills fBuffers[fFillIndex] and the
+    // reader works on fBuffers[fReadIndex]; fNFull counts the buffers that have
+    // been filled and not yet handed back by the reader.
+    std::vector< std::vector<uint32_t> > fBuffers;
+    std::vector<size_t> fBufferWords;
+    size_t fFillIndex;
+    size_t fReadIndex;
+    size_t fNFull;
+    bool fDone;     // inflate thread has reached the end of the file (or an error)
+    bool fStop;     // asked the inflate thread to stop
+    bool fHaveBuffer; // the reader holds fBuffers[fReadIndex]
+
+    // The reader's position in its current buffer
+    const uint32_t* fWords;
+    size_t fPos;
+    size_t fEnd;
+    uint64_t fBufferOffset;
+};
+
+
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef GUARD_PLTHitArrays_h
+#define GUARD_PLTHitArrays_h
+
+// Decoded hits of one event stored as a structure of arrays (one array per
+// field) rather than as individual PLTHit objects. This is what the batch
+// decoder PLTBinaryFileReader::DecodeSpyDataFifoBatch fills; the arrays are
+// meant to be reused from event to event so that they don't reallocate.
+
+#include <vector>
+#include <cstddef>
+
+class PLTHitArrays
+{
+  public:
+    PLTHitArrays () {}
+    ~PLTHitArrays () {}
+
+    size_t NHits () const { return fChannel.size(); }
+
+    void Clear ()
+    {
+      fChannel.clear();
+      fROC.clear();
+      fColumn.clear();
+      fRow.clear();
+      fADC.clear();
+      return;
+    }
+
+    void Resize (size_t const n)
+    {
+      fChannel.resize(n);
+      fROC.resize(n);
+      fColumn.resize(n);
+      fRow.resize(n);
+      fADC.resize(n);
+      return;
+    }
+
+    std::vector<int> fChannel;
+    std::vector<int> fROC;
+    std::vector<int> fColumn;
+    std::vector<int> fRow;
+    std::vector<int> fADC;
+};
+
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef GUARD_PLTPixelMask_h
+#define GUARD_PLTPixelMask_h
+
+// Set of masked pixels stored as a dense bitmap, one bit per pixel of every
+// channel/ROC. Within a ROC the bits run column by column (col*NROW + row) so a
+// range of rows in a column is a contiguous run of bits and can be set with a
+// few word operations. For 37 channels (0-36) x 3 ROCs x 52 x 80 pixels this is
+// about 56 KB, and a lookup is a shift and a mask.
+//
+// Pixels can also be given by the usual "ChannelPixel" key
+// ch*100000 + roc*10000 + col*100 + row. Anything outside the bitmap is simply
+// never masked.
+
+#include <vector>
+#include <stdint.h>
+
+#include "bril/pltslinkprocessor/PLTU.h"
+
+class PLTPixelMask
+{
+  public:
+    PLTPixelMask ();
+    ~PLTPixelMask ();
+
+    static int const NCHANNELS = 37;
+    static int const NROCS = 3;
+
+    void Clear ();
+
+    // Mask (or unmask) a single pixel, or all pixels in a rectangle of columns and rows
+    void Mask (int const, int const, int const, int const);
+    void Unmask (int const, int const, int const, int const);
+    void MaskRange (int const, int const, int const, int const, int const, int const, bool const Masked = true);
+
+    bool IsMasked (int const Channel, int const ROC, int const Col, int const Row) const
+    {
+      if ((unsigned) Channel >= (unsigned) NCHANNELS || (unsigned) ROC >= (unsigned) NROCS ||
+          (unsigned) Col >= (unsigned) PLTU::NCOL || (unsigned) Row >= (unsigned) PLTU::NROW) {
+        return false;
+      }
+      size_t const Bit = BitIndex(Channel, ROC, Col, Row);
+      return (fBits[Bit >> 6] >> (Bit & 63)) & 1;
+    }
+
+    bool IsMasked (int const ChannelPixel) const
+    {
+      if (ChannelPixel < 0) {
+        return false;
+      }
+      return IsMasked(ChannelPixel / 100000, (ChannelPixel / 10000) % 10, (ChannelPixel / 100) % 100, ChannelPixel % 100);
+    }
+
+    // std::set-like lookup so code written against the old std::set<int> mask still reads the same
+    size_t count (int const ChannelPixel) const
+    {
+      return IsMasked(ChannelPixel) ? 1 : 0;
+    }
+
+    size_t NMasked () const;
+    bool   Empty () const { return NMasked() == 0; }
+
+  private:
+    static int const NBITSPERROC = PLTU::NCOL * PLTU::NROW;
+    static int const NWORDSPERROC = (NBITSPERROC + 63) / 64;
+
+    static size_t BitIndex (int const Channel, int const ROC, int const Col, int const Row)
+    {
+      // Each ROC starts on a word boundary
+      return (size_t) (Channel * NROCS + ROC) * NWORDSPERROC * 64 + Col * PLTU::NROW + Row;
+    }
+
+    void SetBits (size_t const, size_t const, bool const);
+
+    std::vector<uint64_t> fBits;
+};
+
+
+
+#endif
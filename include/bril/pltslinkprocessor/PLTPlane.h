@@ -10,6 +10,7 @@
 
 #include "TH2F.h"
 
+class PLTEventArena;
 
 class PLTPlane
 {
@@ -78,6 +79,9 @@ class PLTPlane
     void SetChannel (int const);
     void SetROC (int const);
 
+    // If the plane has an arena the clusters come from there, otherwise the
+    // plane makes and deletes them itself
+    void SetArena (PLTEventArena*);
     void Clear ();
 
 
@@ -90,6 +94,9 @@ class PLTPlane
     std::vector<PLTHit*> fUnclusteredHits;
     std::vector<PLTCluster*> fClusters;
 
+    PLTEventArena* fArena;
+    PLTCluster* NewCluster ();
+
 };
 
 
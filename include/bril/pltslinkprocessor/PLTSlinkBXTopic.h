@@ -0,0 +1,35 @@
+#ifndef GUARD_PLTSlinkBXTopic_h
+#define GUARD_PLTSlinkBXTopic_h
+
+// The per bunch crossing counts of the fast luminosity path, published once
+// per lumisection on a topic of their own next to pltslinklumi (see
+// BXHistograms):
+//
+//   channels   FED channel of each zeros row, 0 for the unused rows
+//   triggers   triggered crossings per BX
+//   zeros      per channel row, the crossings per BX without a triple
+//              coincidence (16 rows of 3564, unused rows 0)
+//   mu         zero-counting mu per BX, averaged over the channels
+//
+// The dictionary sizes are NBX = 3564 and 16 channel rows, which covers all
+// the PLT telescopes.
+
+#include "interface/bril/CommonDataFormat.h"
+
+namespace interface
+{
+    namespace bril
+    {
+        DEFINE_COMPOUND_TOPIC(pltslinkbx, "channels:uint32:16 triggers:uint32:3564 zeros:uint32:57024 mu:float:3564", "pltslinkbx");
+    }
+}
+
+namespace bril
+{
+    namespace pltslinkprocessor
+    {
+        static const unsigned PLTSLINKBX_NCHANNELS = 16;
+    }
+}
+
+#endif
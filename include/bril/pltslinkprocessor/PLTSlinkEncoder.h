@@ -0,0 +1,99 @@
+#ifndef GUARD_PLTSlinkEncoder_h
+#define GUARD_PLTSlinkEncoder_h
+
+// Slink words as the FED sends them and PLTBinaryFileReader decodes them, for
+// making synthetic data. An event is a 64 bit header, the data words and a 64
+// bit trailer, each 64 bit word written low half first:
+//
+//   header   BX << 20 | FEDID << 8,  0x50000000 | event number (24 bits)
+//   data     channel << 26 | (ROC + 1) << 21 | double column << 16 | pixel << 8 | ADC
+//   trailer  time (ms),  0xa0000000 | event length in 64 bit words
+//
+// The data words are padded with an all-zero word to a whole number of 64 bit
+// words, which the decoders skip. Among the hits there can be error words (ROC
+// field 28-31, see DecodeSpyDataFifo), and before an event a TDC block, which
+// the decoders step over:
+//
+//   0x53333333, 0x53333333, data words, 0xa0000000 | length, 0
+
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+
+class PLTSlinkEncoder
+{
+  public:
+    // ROC is 0-2, Column 0-51 and Row 0-79 as in PLTHit
+    static uint32_t HitWord (int const Channel, int const ROC, int const Column, int const Row, int const ADC)
+    {
+      // The inverse of DecodeSpyDataFifo: odd columns have odd pixel numbers
+      uint32_t const Pixel = 2 * (80 - Row) + (Column % 2);
+      return ((uint32_t) Channel << 26) | ((uint32_t) (ROC + 1) << 21) | ((uint32_t) (Column / 2) << 16) | (Pixel << 8) | ((uint32_t) ADC & 0xff);
+    }
+
+    // Starts an event at the end of Words
+    static void BeginEvent (std::vector<uint32_t>& Words, unsigned long const Event, uint32_t const BX, int const FEDID)
+    {
+      Words.push_back((BX & 0xfff) << 20 | ((uint32_t) FEDID & 0xfff) << 8);
+      Words.push_back(0x50000000 | (Event & 0xffffff));
+      return;
+    }
+
+    // Error words, one per call except for the time out which is two
+    static uint32_t NearFullWord (int const Bits)
+    {
+      return 28u << 21 | ((uint32_t) Bits & 0xff);
+    }
+
+    static uint32_t TrailerErrorWord (int const Channel, int const FEDBits, int const TBMBits)
+    {
+      return (uint32_t) Channel << 26 | 30u << 21 | ((uint32_t) FEDBits & 0xf) << 8 | ((uint32_t) TBMBits & 0xff);
+    }
+
+    static uint32_t EventNumberErrorWord (int const Channel, int const TBMEvent)
+    {
+      return (uint32_t) Channel << 26 | 31u << 21 | ((uint32_t) TBMEvent & 0xff);
+    }
+
+    static void AddTimeOut (std::vector<uint32_t>& Words, int const Channel, int const Counter)
+    {
+      // The channel is a bit in a mask of five for one of eight groups
+      static int const Offsets[8] = {0, 4, 9, 13, 18, 22, 27, 31};
+      int Group = 7;
+      while (Group > 0 && Channel - 1 < Offsets[Group]) {
+        --Group;
+      }
+      Words.push_back(0x3b00000);
+      Words.push_back(0x3a00000 | ((uint32_t) Counter & 0xff) << 11 | (uint32_t) Group << 8 | 1u << (Channel - 1 - Offsets[Group]));
+      return;
+    }
+
+    // A TDC block; data words must not have 0xa in the top four bits
+    static void AddTDC (std::vector<uint32_t>& Words, uint32_t const* Data, size_t const NData)
+    {
+      Words.push_back(0x53333333);
+      Words.push_back(0x53333333);
+      Words.insert(Words.end(), Data, Data + NData);
+      if (NData % 2) {
+        Words.push_back(0);
+      }
+      Words.push_back(0xa0000000 | (uint32_t) (NData / 2 + 2));
+      Words.push_back(0);
+      return;
+    }
+
+    // Ends the event whose header is at Words[Begin]
+    static void EndEvent (std::vector<uint32_t>& Words, size_t const Begin, uint32_t const Time)
+    {
+      if ((Words.size() - Begin) % 2) {
+        Words.push_back(0);
+      }
+      uint32_t const Length = (Words.size() - Begin) / 2 + 1;
+      Words.push_back(Time);
+      Words.push_back(0xa0000000 | (Length & 0xffffff));
+      return;
+    }
+};
+
+
+#endif
@@ -0,0 +1,130 @@
+#ifndef GUARD_PLTSlinkGenerator_h
+#define GUARD_PLTSlinkGenerator_h
+
+// Synthetic slink events for load tests, at any pileup. In every crossing each
+// telescope gets a Poisson number of tracks, mu in filled bunches and none in
+// the others. A track's slopes and the residuals of its hits are drawn from the
+// measured distributions of its channel, and it is projected through the
+// alignment onto the pixels of the three planes (the inverse of AlignHit).
+// On top of that come noise hits in single planes and accidentals, hits in all
+// three planes of a telescope at unrelated places. Masked pixels never give a
+// hit, as in the detector.
+//
+// The events are encoded with PLTSlinkEncoder: header, the hits channel by
+// channel, error words at a given rate, trailer, and every so often a TDC block
+// before the header. BXs are random, and the event time goes up with the
+// trigger rate.
+//
+// Everything comes from one seed, so the same settings give the same events.
+
+#include <vector>
+#include <string>
+#include <map>
+#include <random>
+#include <stdint.h>
+
+#include "bril/pltslinkprocessor/PLTAlignment.h"
+#include "bril/pltslinkprocessor/PLTPixelMask.h"
+#include "bril/pltslinkprocessor/PLTSlinkEncoder.h"
+
+
+class PLTSlinkGenerator
+{
+  public:
+    // The alignment must be there as long as the generator
+    PLTSlinkGenerator (PLTAlignment&, std::vector<int> const& Channels, unsigned long const Seed = 1);
+    ~PLTSlinkGenerator ();
+
+    static int const NBX = 3564;
+
+    // Per channel slopes and residuals, either a TrackDistributions file
+    // ("SlopeX_Ch2 mean sigma" lines) or a tracks.csv as EventAnalyzer reads.
+    // Channels not in the file keep the defaults, the average of 2016.
+    bool ReadTrackDistributions (std::string const);
+
+    void SetPixelMask (PLTPixelMask const& in) { fPixelMask = in; }
+
+    // Filled bunches, e.g. "0-11,100,200-211" (0-based BX numbers); "" for all
+    bool SetBXPattern (std::string const);
+
+    // Mean number of tracks per telescope in a filled crossing
+    void SetMu (double const in) { fMu = in; }
+
+    // Mean number of noise hits per plane, and of accidentals per telescope, per crossing
+    void SetNoise (double const in) { fNoise = in; }
+    void SetAccidentals (double const in) { fAccidentals = in; }
+
+    // Probability of a plane seeing a track
+    void SetEfficiency (double const in) { fEfficiency = in; }
+
+    // Probability per channel and event of an error word
+    void SetErrorRate (double const in) { fErrorRate = in; }
+
+    // A TDC block before every Nth event, 0 for none
+    void SetTDCInterval (unsigned const in) { fTDCInterval = in; }
+
+    void SetTriggerRate (double const in) { fTriggerRate = in; }
+    void SetFEDID (int const in) { fFEDID = in; }
+
+    // Appends the next event to Words
+    void NextEvent (std::vector<uint32_t>& Words);
+
+    unsigned long NEvents () const { return fNEvents; }
+    unsigned long NTracks () const { return fNTracks; }
+    unsigned long NHits () const { return fNHits; }
+    unsigned long NErrors () const { return fNErrors; }
+
+  private:
+    struct TrackDistribution {
+      float SlopeX[2], SlopeY[2];  // mean and sigma
+      float ResidualX[3][2], ResidualY[3][2];  // per ROC, local coordinates
+    };
+
+    struct Hit {
+      int ROC, Column, Row, ADC;
+    };
+
+    TrackDistribution& Distribution (int const);
+    static bool CompareROC (Hit const&, Hit const&);
+
+    void AddTrack (int const Channel, TrackDistribution const&);
+    void AddAccidental (int const Channel);
+    void AddHit (int const Channel, int const ROC, int const Column, int const Row, int const ADC);
+    void AddErrorWord (std::vector<uint32_t>&, int const Channel);
+    int  ADC ();
+    int  Poisson (double const);
+
+    PLTAlignment& fAlignment;
+    std::vector<int> fChannels;
+    std::map<int, TrackDistribution> fDistributions;
+    TrackDistribution fDefaultDistribution;
+    PLTPixelMask fPixelMask;
+    std::vector<bool> fFilled;
+
+    double fMu;
+    double fNoise;
+    double fAccidentals;
+    double fEfficiency;
+    double fErrorRate;
+    unsigned fTDCInterval;
+    double fTriggerRate;
+    int fFEDID;
+
+    std::mt19937 fRandom;
+    std::uniform_real_distribution<double> fUniform;
+    std::normal_distribution<double> fGauss;
+
+    // The hits of the channel being made, and the crossing's time
+    std::vector<Hit> fHits;
+    double fTime;
+
+    unsigned long fNEvents;
+    unsigned long fNTracks;
+    unsigned long fNHits;
+    unsigned long fNErrors;
+};
+
+
+
+
+#endif
@@ -0,0 +1,250 @@
+#ifndef GUARD_PLTStageTimer_h
+#define GUARD_PLTStageTimer_h
+
+// Where the time of an event goes, stage by stage. A PLTStageTimer put at the
+// top of a block adds the time until the end of the block to the current event
+// of a PLTStageTimes; when the event is over (EndEvent) every stage it went
+// through gets one entry, the sum of its time in that event, in a histogram of
+// that stage. Quantiles come from the histograms.
+//
+// Time is counted in CPU time stamp counter ticks, which cost a few ns to read;
+// NanosecondsPerTick() converts them. The histogram buckets are logarithmic
+// with four per power of two, so a quantile is good to about 25%, and filling
+// one is a couple of instructions.
+//
+// The timers are only there when built with -DPLT_STAGE_TIMING; otherwise
+// PLT_STAGE_TIMER is empty, nothing is ever added and the histograms stay
+// empty.
+//
+// A PLTStageTimes has one writer. Threads helping with an event time into
+// their own and the owner collects them with TakePending.
+
+#include <chrono>
+#include <thread>
+#include <cmath>
+#include <cstring>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+enum PLTStage {
+  kStage_Decode,
+  kStage_GainCal,
+  kStage_Align,
+  kStage_Clusterize,
+  kStage_Tracking,
+  kStage_Analyze,
+  kNStages
+};
+
+
+class PLTStageTimes
+{
+  public:
+    PLTStageTimes ()
+    {
+      Clear();
+    }
+
+    static const char* StageName (int const Stage)
+    {
+      static const char* const Names[kNStages] = {"decode", "gaincal", "align", "clusterize", "tracking", "analyze"};
+      return Stage >= 0 && Stage < kNStages ? Names[Stage] : "unknown";
+    }
+
+    static uint64_t Now ()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+      return __rdtsc();
+#else
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    // Measured once, the first time it is asked for, against the steady clock
+    static double NanosecondsPerTick ()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+      static double const NsPerTick = Calibrate();
+      return NsPerTick;
+#else
+      return 1.;
+#endif
+    }
+
+    // Everything, the current event included
+    void Clear ()
+    {
+      memset(fCounts, 0, sizeof(fCounts));
+      memset(fEntries, 0, sizeof(fEntries));
+      memset(fMax, 0, sizeof(fMax));
+      memset(fPending, 0, sizeof(fPending));
+      fPendingMask = 0;
+      return;
+    }
+
+    // Time of the current event; several calls for a stage add up
+    void AddTicks (PLTStage const Stage, uint64_t const Ticks)
+    {
+      fPending[Stage] += Ticks;
+      fPendingMask |= 1u << Stage;
+      return;
+    }
+
+    // Move the current event's time in Other (e.g. a worker's) to ours
+    void TakePending (PLTStageTimes& Other)
+    {
+      if (Other.fPendingMask == 0) {
+        return;
+      }
+      for (int i = 0; i != kNStages; ++i) {
+        fPending[i] += Other.fPending[i];
+        Other.fPending[i] = 0;
+      }
+      fPendingMask |= Other.fPendingMask;
+      Other.fPendingMask = 0;
+      return;
+    }
+
+    // The current event is over: histogram its time per stage
+    void EndEvent ()
+    {
+      if (fPendingMask == 0) {
+        return;
+      }
+      for (int i = 0; i != kNStages; ++i) {
+        if (fPendingMask & (1u << i)) {
+          ++fCounts[i][Bucket(fPending[i])];
+          ++fEntries[i];
+          if (fPending[i] > fMax[i]) {
+            fMax[i] = fPending[i];
+          }
+          fPending[i] = 0;
+        }
+      }
+      fPendingMask = 0;
+      return;
+    }
+
+    // Add the histograms of Other (not its current event)
+    void Add (PLTStageTimes const& Other)
+    {
+      for (int i = 0; i != kNStages; ++i) {
+        for (int j = 0; j != NBUCKETS; ++j) {
+          fCounts[i][j] += Other.fCounts[i][j];
+        }
+        fEntries[i] += Other.fEntries[i];
+        if (Other.fMax[i] > fMax[i]) {
+          fMax[i] = Other.fMax[i];
+        }
+      }
+      return;
+    }
+
+    // Number of events that went through the stage, and their time in ticks
+    uint64_t NEntries (int const Stage) const
+    {
+      return fEntries[Stage];
+    }
+
+    uint64_t Max (int const Stage) const
+    {
+      return fMax[Stage];
+    }
+
+    // Upper edge of the bucket holding quantile q (0-1), never above Max
+    uint64_t Quantile (int const Stage, double const q) const
+    {
+      if (fEntries[Stage] == 0) {
+        return 0;
+      }
+      uint64_t Rank = (uint64_t) std::ceil(q * fEntries[Stage]);
+      if (Rank < 1) {
+        Rank = 1;
+      }
+      uint64_t Sum = 0;
+      for (int i = 0; i != NBUCKETS; ++i) {
+        Sum += fCounts[Stage][i];
+        if (Sum >= Rank) {
+          uint64_t const Upper = i + 1 < NBUCKETS ? BucketLow(i + 1) - 1 : fMax[Stage];
+          return Upper < fMax[Stage] ? Upper : fMax[Stage];
+        }
+      }
+      return fMax[Stage];
+    }
+
+  private:
+    // Buckets 0-3 are 0-3 ticks, then four per power of two up to 2^64
+    static int const NBUCKETS = 252;
+
+    static int Bucket (uint64_t const Ticks)
+    {
+      if (Ticks < 4) {
+        return (int) Ticks;
+      }
+      int const Log = 63 - __builtin_clzll(Ticks);
+      return 4 * (Log - 1) + (int) ((Ticks >> (Log - 2)) & 3);
+    }
+
+    static uint64_t BucketLow (int const i)
+    {
+      if (i < 4) {
+        return i;
+      }
+      return (uint64_t) (4 + i % 4) << (i / 4 - 1);
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    static double Calibrate ()
+    {
+      std::chrono::steady_clock::time_point const Start = std::chrono::steady_clock::now();
+      uint64_t const StartTicks = __rdtsc();
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      uint64_t const Ticks = __rdtsc() - StartTicks;
+      double const Ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - Start).count();
+      return Ticks > 0 ? Ns / Ticks : 1.;
+    }
+#endif
+
+    uint64_t fCounts[kNStages][NBUCKETS];
+    uint64_t fEntries[kNStages];
+    uint64_t fMax[kNStages];
+
+    uint64_t fPending[kNStages];
+    unsigned fPendingMask;
+};
+
+
+// Adds the time from here to the end of the block to Stage
+class PLTStageTimer
+{
+  public:
+    PLTStageTimer (PLTStageTimes& Times, PLTStage const Stage) : fTimes(Times), fStage(Stage), fStart(PLTStageTimes::Now())
+    {
+    }
+
+    ~PLTStageTimer ()
+    {
+      fTimes.AddTicks(fStage, PLTStageTimes::Now() - fStart);
+    }
+
+  private:
+    PLTStageTimer (PLTStageTimer const&);
+    PLTStageTimer& operator= (PLTStageTimer const&);
+
+    PLTStageTimes& fTimes;
+    PLTStage const fStage;
+    uint64_t const fStart;
+};
+
+
+#ifdef PLT_STAGE_TIMING
+#define PLT_STAGE_TIMER(Times, Stage) PLTStageTimer StageTimer_(Times, Stage)
+#else
+#define PLT_STAGE_TIMER(Times, Stage) do { } while (0)
+#endif
+
+
+#endif
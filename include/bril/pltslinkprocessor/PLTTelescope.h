@@ -11,6 +11,8 @@
 
 #include <stdint.h>
 
+class PLTEventArena;
+
 class PLTTelescope
 {
   public:
@@ -31,12 +33,15 @@ class PLTTelescope
     int       NHitPlanes ();
     void      AddTrack (PLTTrack*);
     void      FillAndOrderTelescope ();
+    void      SetArena (PLTEventArena*);
+    void      Clear ();
 
 
   private:
     std::vector<PLTPlane*> fPlanes;
     std::vector<PLTTrack*> fTracks;
     int fChannel;
+    PLTEventArena* fArena; // if set, the tracks belong to the arena
 
 
 };
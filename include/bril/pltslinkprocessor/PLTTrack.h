@@ -11,6 +11,7 @@
 #include "bril/pltslinkprocessor/PLTAlignment.h"
 #include "bril/pltslinkprocessor/PLTPlane.h"
 #include "bril/pltslinkprocessor/PLTU.h"
+#include "bril/pltslinkprocessor/PLTPixelMask.h"
 
 
 class PLTTrack
@@ -20,6 +21,7 @@ class PLTTrack
     ~PLTTrack ();
 
     void AddCluster (PLTCluster*);
+    void Clear ();
     int  MakeTrack (PLTAlignment&);
 
     size_t NClusters ();
@@ -33,7 +35,7 @@ class PLTTrack
 
     bool IsFiducial (PLTPlane*, PLTAlignment&, PLTPlane::FiducialRegion);
     bool IsFiducial (int const, int const, PLTAlignment&, PLTPlane::FiducialRegion);
-    bool IsFiducial (int const, int const , PLTAlignment&, std::set<int> const &);
+    bool IsFiducial (int const, int const , PLTAlignment&, PLTPixelMask const &);
 
     float TX (float const);
     float TY (float const);
@@ -11,6 +11,7 @@
 #include "bril/pltslinkprocessor/PLTAlignment.h"
 #include "bril/pltslinkprocessor/PLTU.h"
 
+class PLTEventArena;
 
 class PLTTracking
 {
@@ -27,8 +28,10 @@ class PLTTracking
     ~PLTTracking ();
 
     void SetTrackingAlignment (PLTAlignment*);
+    PLTAlignment* GetTrackingAlignment ();
     void SetTrackingAlgorithm (TrackingAlgorithm const);
     int  GetTrackingAlgorithm ();
+    void SetTrackingArena (PLTEventArena*);
     static bool CompareTrackD2 (PLTTrack*, PLTTrack*);
 
 
@@ -42,6 +45,14 @@ class PLTTracking
     PLTAlignment* fAlignment;
     TrackingAlgorithm fTrackingAlgorithm;
 
+    // If set, tracks come from (and belong to) the arena instead of the heap
+    PLTEventArena* fArena;
+    PLTTrack* NewTrack ();
+
+    // Scratch space reused from telescope to telescope
+    std::vector<PLTTrack*> fCandidateTracks;
+    PLTTrack fTrack01;
+
     static bool const DEBUG = false;
 };
 
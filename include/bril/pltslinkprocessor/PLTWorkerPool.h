@@ -0,0 +1,65 @@
+#ifndef GUARD_PLTWorkerPool_h
+#define GUARD_PLTWorkerPool_h
+
+// Fixed pool of worker threads for work that splits into independent tasks
+// within one event, e.g. one task per telescope. Run(NTasks, Task) calls
+// Task(i, Worker) once for every i in [0, NTasks) and returns when all of them
+// are done; the calling thread takes part as worker 0, the pool threads are
+// workers 1 to NWorkers()-1. A task knows which worker runs it, so it can use
+// scratch space that belongs to that worker without any locking.
+//
+// Tasks are handed out one at a time from a shared counter, so a busy telescope
+// does not hold up the others. Between runs the threads spin for a short while
+// (events come in quick succession) and then go to sleep.
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <cstddef>
+#include <stdint.h>
+
+class PLTWorkerPool
+{
+  public:
+    typedef std::function<void (size_t, int)> Task;
+
+    // NWorkers counts the calling thread, so 1 means no extra threads at all
+    PLTWorkerPool (int const NWorkers);
+    ~PLTWorkerPool ();
+
+    int NWorkers () const
+    {
+      return (int) fThreads.size() + 1;
+    }
+
+    void Run (size_t const NTasks, Task const&);
+
+  private:
+    PLTWorkerPool (PLTWorkerPool const&);
+    PLTWorkerPool& operator= (PLTWorkerPool const&);
+
+    void Work (int const Worker);
+    void DoTasks (int const Worker);
+
+    // The state of the current run in one word, so that a worker can never
+    // take a task from a run that is already over:
+    // generation (24 bits) | number of tasks (20 bits) | next task (20 bits)
+    static int const TASKBITS = 20;
+    static uint64_t const TASKMASK = (1 << TASKBITS) - 1;
+    static int const NSPIN = 2000;
+
+    std::atomic<uint64_t> fState;
+    std::atomic<size_t> fNDone;
+    Task const* fTask;
+
+    std::vector<std::thread> fThreads;
+    std::mutex fMutex;
+    std::condition_variable fCondition;
+    bool fStop;
+};
+
+
+#endif
@@ -0,0 +1,198 @@
+#ifndef GUARD_PipelineMetrics_h
+#define GUARD_PipelineMetrics_h
+
+// Counters of what the slink pipeline has done since it started, for
+// monitoring while it runs. Every counter has exactly one thread writing it
+// (zmqClient or the publishing workloop), so an update is a relaxed atomic
+// load and store: no lock and no locked instruction in the hot path. Any
+// thread, e.g. the web server, can read them at any time.
+//
+// WriteText() gives one "name value" line per counter, with the FED channel
+// and error type as labels where there are several, e.g.
+//     plt_hits{channel="13"} 123456
+
+#include <atomic>
+#include <ostream>
+#include <stdint.h>
+
+#include "bril/pltslinkprocessor/PLTEventBatch.h"
+#include "bril/pltslinkprocessor/PLTError.h"
+#include "bril/pltslinkprocessor/PLTStageTimer.h"
+
+class PipelineMetrics
+{
+    public:
+        static const unsigned NCHANNELS = 37;
+        static const unsigned NERRORTYPES = kUnknownError + 1;
+
+        typedef std::atomic<unsigned long> Counter;
+
+        PipelineMetrics()
+        {
+            Zero(&messages, 1);
+            Zero(&bytes, 1);
+            Zero(&events, 1);
+            Zero(&oddSize, 1);
+            Zero(&noHeader, 1);
+            Zero(&noTrailer, 1);
+            Zero(&truncatedTDC, 1);
+            Zero(hits, NCHANNELS);
+            Zero(clusters, NCHANNELS);
+            Zero(tracks, NCHANNELS);
+            Zero(desyncs, NCHANNELS);
+            Zero(errors, NERRORTYPES);
+            Zero(&channelErrors[0][0], NCHANNELS * NERRORTYPES);
+            Zero(&lsQueued, 1);
+            Zero(&lsPublished, 1);
+            Zero(&lsLatencyLast, 1);
+            Zero(&lsLatencyMax, 1);
+            Zero(stageEvents, kNStages);
+            Zero(stageP50, kNStages);
+            Zero(stageP99, kNStages);
+            Zero(stageMax, kNStages);
+        }
+
+        // Updates, for the one thread that owns the counter
+        static void Add(Counter& counter, unsigned long n)
+        {
+            counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+        }
+
+        static void Set(Counter& counter, unsigned long value)
+        {
+            counter.store(value, std::memory_order_relaxed);
+        }
+
+        // One slink message decoded into batch
+        void CountBatch(const PLTEventBatch& batch, size_t nBytes)
+        {
+            Add(messages, 1);
+            Add(bytes, nBytes);
+            Set(events, batch.fNEvents);
+            Set(oddSize, batch.fNOddSize);
+            Set(noHeader, batch.fNNoHeader);
+            Set(noTrailer, batch.fNNoTrailer);
+            Set(truncatedTDC, batch.fNTruncatedTDC);
+            for (size_t i = 0; i != batch.fErrors.size(); ++i) {
+                const PLTError& error = batch.fErrors[i];
+                Add(errors[error.GetErrorType()], 1);
+                if (error.GetChannel() < NCHANNELS) {
+                    Add(channelErrors[error.GetChannel()][error.GetErrorType()], 1);
+                }
+            }
+            for (size_t i = 0; i != batch.fDesyncChannels.size(); ++i) {
+                if ((unsigned) batch.fDesyncChannels[i] < NCHANNELS) {
+                    Add(desyncs[batch.fDesyncChannels[i]], 1);
+                }
+            }
+        }
+
+        // zmqClient
+        Counter messages;       // slink messages decoded
+        Counter bytes;          // and their size
+        Counter events;
+        Counter oddSize;        // buffer layout problems, see PLTEventBatch
+        Counter noHeader;
+        Counter noTrailer;
+        Counter truncatedTDC;
+        Counter hits[NCHANNELS];
+        Counter clusters[NCHANNELS]; // with full reconstruction only
+        Counter tracks[NCHANNELS];
+        Counter desyncs[NCHANNELS];
+        Counter errors[NERRORTYPES];
+        Counter channelErrors[NCHANNELS][NERRORTYPES];
+        Counter lsQueued;       // lumisections handed to the publishing workloop
+
+        // publishing workloop
+        Counter lsPublished;
+        Counter lsLatencyLast;  // microseconds from the LS boundary to publication done
+        Counter lsLatencyMax;
+
+        // Time per event in each stage in the last lumisection (ns), see PLTStageTimer.h
+        Counter stageEvents[kNStages];
+        Counter stageP50[kNStages];
+        Counter stageP99[kNStages];
+        Counter stageMax[kNStages];
+
+        void SetStageTimes(const PLTStageTimes& times)
+        {
+            double const nsPerTick = PLTStageTimes::NanosecondsPerTick();
+            for (int stage = 0; stage < kNStages; ++stage) {
+                Set(stageEvents[stage], times.NEntries(stage));
+                Set(stageP50[stage], times.Quantile(stage, 0.50) * nsPerTick);
+                Set(stageP99[stage], times.Quantile(stage, 0.99) * nsPerTick);
+                Set(stageMax[stage], times.Max(stage) * nsPerTick);
+            }
+        }
+
+        static const char* ErrorName(unsigned type)
+        {
+            static const char* const names[NERRORTYPES] = {"timeout", "event_number", "near_full", "fed_trailer", "tbm", "unknown"};
+            return type < NERRORTYPES ? names[type] : "unknown";
+        }
+
+        void WriteText(std::ostream& out) const
+        {
+            Line(out, "plt_messages", messages);
+            Line(out, "plt_message_bytes", bytes);
+            Line(out, "plt_events", events);
+            Line(out, "plt_buffer_odd_size", oddSize);
+            Line(out, "plt_buffer_no_header", noHeader);
+            Line(out, "plt_buffer_no_trailer", noTrailer);
+            Line(out, "plt_buffer_truncated_tdc", truncatedTDC);
+            for (unsigned type = 0; type < NERRORTYPES; ++type) {
+                out << "plt_errors{type=\"" << ErrorName(type) << "\"} " << errors[type].load(std::memory_order_relaxed) << "\n";
+            }
+            for (unsigned ch = 0; ch < NCHANNELS; ++ch) {
+                ChannelLine(out, "plt_hits", ch, hits[ch]);
+                ChannelLine(out, "plt_clusters", ch, clusters[ch]);
+                ChannelLine(out, "plt_tracks", ch, tracks[ch]);
+                ChannelLine(out, "plt_desyncs", ch, desyncs[ch]);
+                for (unsigned type = 0; type < NERRORTYPES; ++type) {
+                    unsigned long const n = channelErrors[ch][type].load(std::memory_order_relaxed);
+                    if (n != 0) {
+                        out << "plt_channel_errors{channel=\"" << ch << "\",type=\"" << ErrorName(type) << "\"} " << n << "\n";
+                    }
+                }
+            }
+            Line(out, "plt_ls_queued", lsQueued);
+            Line(out, "plt_ls_published", lsPublished);
+            Line(out, "plt_ls_queue_depth", lsQueued.load(std::memory_order_relaxed) - lsPublished.load(std::memory_order_relaxed));
+            Line(out, "plt_ls_latency_us", lsLatencyLast);
+            Line(out, "plt_ls_latency_max_us", lsLatencyMax);
+            for (int stage = 0; stage < kNStages; ++stage) {
+                const char* name = PLTStageTimes::StageName(stage);
+                out << "plt_stage_events{stage=\"" << name << "\"} " << stageEvents[stage].load(std::memory_order_relaxed) << "\n";
+                out << "plt_stage_latency_ns{stage=\"" << name << "\",quantile=\"0.5\"} " << stageP50[stage].load(std::memory_order_relaxed) << "\n";
+                out << "plt_stage_latency_ns{stage=\"" << name << "\",quantile=\"0.99\"} " << stageP99[stage].load(std::memory_order_relaxed) << "\n";
+                out << "plt_stage_latency_ns{stage=\"" << name << "\",quantile=\"1\"} " << stageMax[stage].load(std::memory_order_relaxed) << "\n";
+            }
+        }
+
+        static void Line(std::ostream& out, const char* name, unsigned long value)
+        {
+            out << name << " " << value << "\n";
+        }
+
+    private:
+        PipelineMetrics(const PipelineMetrics&);
+        PipelineMetrics& operator=(const PipelineMetrics&);
+
+        static void Zero(Counter* counters, size_t n)
+        {
+            for (size_t i = 0; i != n; ++i) {
+                counters[i].store(0, std::memory_order_relaxed);
+            }
+        }
+
+        // Channels without anything are left out to keep the output short
+        static void ChannelLine(std::ostream& out, const char* name, unsigned ch, const Counter& counter)
+        {
+            unsigned long const n = counter.load(std::memory_order_relaxed);
+            if (n != 0) {
+                out << name << "{channel=\"" << ch << "\"} " << n << "\n";
+            }
+        }
+};
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef GUARD_ReplayDriver_h
+#define GUARD_ReplayDriver_h
+
+// Offline reprocessing of a single slink file on several cores. The file is
+// split into event-aligned chunks using the event index (see PLTEventIndex),
+// and each chunk is decoded, reconstructed and analyzed by its own worker
+// thread with its own PLTEvent and EventAnalyzer. At the end the analyzers are
+// merged in file order, so the result is the same as a single-threaded pass.
+
+#include <vector>
+#include <string>
+
+#include "PLTEvent.h"
+#include "EventAnalyzer.h"
+
+using namespace std;
+
+class ReplayDriver
+{
+    public:
+        ReplayDriver(string, string, vector<unsigned>);
+        ~ReplayDriver();
+
+        void SetPixelMask(string maskFile) { _maskFile = maskFile; }
+        void SetAnalyzerAlignment(string alignmentFile) { _analyzerAlignmentFile = alignmentFile; }
+
+        // The clustering and fiducial regions default to what the EventAnalyzer
+        // sets, as online; set here they override it
+        void SetPlaneClustering(PLTPlane::Clustering clustering, PLTPlane::FiducialRegion fiducial) { _clustering = clustering; _clusterFiducial = fiducial; }
+        void SetPlaneFiducialRegion(PLTPlane::FiducialRegion fiducial) { _hitFiducial = fiducial; }
+        void SetTrackingAlgorithm(PLTTracking::TrackingAlgorithm algorithm) { _tracking = algorithm; }
+
+        // Process the whole file with nThreads workers; returns the number of events
+        // processed, or -1 if the file could not be opened or indexed
+        long          Run(string, unsigned);
+
+        // The merged analyzer (valid after Run)
+        EventAnalyzer* GetAnalyzer() { return _analyzers.empty() ? 0 : _analyzers[0]; }
+
+    private:
+        void          Reset();
+        void          ProcessChunk(unsigned, size_t, size_t);
+
+        string _gainCalFile;
+        string _alignmentFile;
+        string _maskFile;
+        string _analyzerAlignmentFile;
+        vector<unsigned> _channels;
+
+        PLTPlane::Clustering          _clustering;
+        PLTPlane::FiducialRegion      _clusterFiducial;
+        PLTPlane::FiducialRegion      _hitFiducial;
+        PLTTracking::TrackingAlgorithm _tracking;
+
+        // one of each per worker
+        vector<PLTEvent*>      _events;
+        vector<EventAnalyzer*> _analyzers;
+        vector<unsigned long>  _nEvents;
+};
+
+#endif
@@ -0,0 +1,124 @@
+#ifndef GUARD_SlinkPipeline_h
+#define GUARD_SlinkPipeline_h
+
+// The online processing of slink data, with nothing XDAQ about it: slink
+// messages in (one or more events back to back, as they come from the FED),
+// one summary per lumisection out. Application::zmqClient feeds it from zmq
+// and pltslinkreplay from files, so both run exactly the same chain: PLTEvent
+// on buffers with the gaincal, alignment and pixel mask, no clustering,
+// AllCombs tracking, and EventAnalyzer for the lumi, efficiencies and
+// accidental rates.
+//
+// One thread drives it: DecodeMessage and ProcessEvents for every message,
+// EndLumiSection at every lumisection boundary. The counters go to the
+// PipelineMetrics it is given.
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <chrono>
+#include <stdint.h>
+
+#include "PLTEvent.h"
+#include "EventAnalyzer.h"
+#include "BXHistograms.h"
+#include "PLTStageTimer.h"
+#include "PipelineMetrics.h"
+
+using namespace std;
+
+// What is published for one lumisection, snapshotted at the LS boundary; eff
+// holds three planes per channel, and bxHistograms and stageTimes cover just
+// this lumisection. The ring fields are for whoever feeds the pipeline.
+//
+// The two lumi estimates are kept apart: pzero is good tracks per crossing
+// (EventAnalyzer::GetZeroCounting), only there with full reconstruction, and
+// mu is -ln of the fraction of crossings without a triple coincidence
+// (EventAnalyzer::GetFastZeroCounting, the same as the per-BX histograms).
+// mu is always there and is what gets published.
+struct LumiSectionSummary {
+    int fill, run, ls, nibble;
+    int nevents;
+    unsigned long bufferProblems;
+    size_t ringHighWater, ringSlots;
+    unsigned long ringDropped;
+    vector<unsigned> channels;
+    vector<float> eff, acc, pzero, mu;
+    BXHistograms bxHistograms;
+    PLTStageTimes stageTimes;
+    std::chrono::steady_clock::time_point boundaryTime;
+};
+
+class SlinkPipeline
+{
+    public:
+        // The mask file can be empty for no pixel mask
+        SlinkPipeline(string, string, string, vector<unsigned>, PipelineMetrics&);
+        ~SlinkPipeline();
+
+        // Clusters and tracks for the efficiencies and accidentals, on
+        // nThreads threads (the caller's included); without it only the fast
+        // zero-counting lumi is made. Set before the first message.
+        void SetFullReconstruction(bool full, unsigned nThreads);
+
+        // Charges of the channels' hits from a table of at most maxBytes,
+        // see PLTGainCal::BuildChargeTable; 0 for none. Set before the first
+        // message.
+        void SetChargeTable(size_t maxBytes, bool halfPrecision);
+
+        // 48 occupancy plots, three ROCs per readout channel, or 0 for none
+        void SetOccupancyPlots(TH2F** plots) { _occupancyPlots = plots; }
+
+        // Decode a message; its data is not used any more afterwards, so it
+        // can be freed before ProcessEvents. Returns the number of events.
+        int           DecodeMessage(const void* data, size_t size);
+        void          ProcessEvents();
+
+        // Everything since the last boundary, for the caller to delete
+        LumiSectionSummary* EndLumiSection(int fill, int run, int ls, int nibble);
+
+        int           NEvents() const { return _nEvents; }
+        PLTEvent*     GetEvent() { return _event; }
+        EventAnalyzer* GetAnalyzer() { return _analyzer; }
+
+    private:
+        SlinkPipeline(const SlinkPipeline&);
+        SlinkPipeline& operator=(const SlinkPipeline&);
+
+        PipelineMetrics& _metrics;
+        PLTEvent*        _event;
+        EventAnalyzer*   _analyzer;
+        vector<unsigned> _channels;
+        bool             _fullReconstruction;
+        TH2F**           _occupancyPlots;
+
+        int              _nEvents;   // since the start
+        int              _nBatch;    // in the last message decoded
+        uint8_t          _planeMasks[PLTEventBatch::NCHANNELS];
+        unsigned long    _channelHits[PipelineMetrics::NCHANNELS];
+};
+
+// The per-run CSV files of what is published, for validation: efficiencies,
+// accidental rates, lumi rates and the zeros per BX, one line per lumisection
+// (per channel for the zeros). The lumi rates have pzero as chN (empty without
+// full reconstruction) and mu as chN_mu.
+class LumiSectionFiles
+{
+    public:
+        LumiSectionFiles(string baseDir) : _baseDir(baseDir), _run(0) {}
+
+        // Starts new files when the run changes
+        void Write(const LumiSectionSummary&);
+
+    private:
+        void Open(int run, const vector<unsigned>& channels);
+
+        string   _baseDir;
+        int      _run;
+        ofstream _effFile;
+        ofstream _accFile;
+        ofstream _lumiFile;
+        ofstream _bxFile;
+};
+
+#endif
@@ -0,0 +1,116 @@
+#ifndef GUARD_SlinkRing_h
+#define GUARD_SlinkRing_h
+
+// Single-producer single-consumer ring of slink messages between the thread
+// receiving them and the thread processing them. The slots (e.g.
+// zmq::message_t) are made up front and reused, and the two threads only
+// share two atomic indices, so neither side ever takes a lock or waits for
+// the other. A message is received straight into its slot and decoded
+// straight from it, so it is never copied and can be of any size.
+//
+// What a slot holds is up to the slot type: a zmq::message_t gets its data
+// from zmq, which allocates it for every message it receives, and the consumer
+// frees it again. The ring saves the copy and the locking, not that allocation.
+//
+// Producer:  Slot* slot = ring.WriteSlot();   (0 if the ring is full)
+//            ... receive into *slot ...
+//            ring.Commit();
+// or, if there is no free slot, ring.Drop() to count the message as lost.
+//
+// Consumer:  Slot* slot = ring.ReadSlot();    (0 if empty)
+//            ... use *slot, then free what it holds ...
+//            ring.Release();
+//
+// The counters are written by one thread only and can be read from any
+// thread, e.g. for monitoring.
+
+#include <vector>
+#include <atomic>
+#include <cstddef>
+
+template <class Slot> class SlinkRing
+{
+    public:
+        // nSlots is rounded up to a power of two
+        SlinkRing(size_t nSlots)
+        {
+            size_t n = 1;
+            while (n < nSlots) n <<= 1;
+            _mask      = n - 1;
+            _slots     = new Slot[n];
+            _head      = 0;
+            _tail      = 0;
+            _received  = 0;
+            _dropped   = 0;
+            _highWater = 0;
+        }
+        ~SlinkRing() { delete [] _slots; }
+
+        size_t NSlots() const { return _mask + 1; }
+
+        // Producer side
+        Slot* WriteSlot()
+        {
+            size_t const head = _head.load(std::memory_order_relaxed);
+            if (head - _tail.load(std::memory_order_acquire) > _mask) {
+                return 0;
+            }
+            return &_slots[head & _mask];
+        }
+
+        void Commit()
+        {
+            size_t const head = _head.load(std::memory_order_relaxed);
+            _head.store(head + 1, std::memory_order_release);
+
+            _received.store(_received.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            size_t const occupancy = head + 1 - _tail.load(std::memory_order_relaxed);
+            if (occupancy > _highWater.load(std::memory_order_relaxed)) {
+                _highWater.store(occupancy, std::memory_order_relaxed);
+            }
+        }
+
+        void Drop()
+        {
+            _dropped.store(_dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+
+        // Consumer side
+        Slot* ReadSlot()
+        {
+            size_t const tail = _tail.load(std::memory_order_relaxed);
+            if (tail == _head.load(std::memory_order_acquire)) {
+                return 0;
+            }
+            return &_slots[tail & _mask];
+        }
+
+        void Release()
+        {
+            _tail.store(_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        // Monitoring
+        size_t        Occupancy() const { return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire); }
+        size_t        HighWater() const { return _highWater.load(std::memory_order_relaxed); }
+        unsigned long Received() const  { return _received.load(std::memory_order_relaxed); }
+        unsigned long Dropped() const   { return _dropped.load(std::memory_order_relaxed); }
+
+    private:
+        SlinkRing(const SlinkRing&);
+        SlinkRing& operator=(const SlinkRing&);
+
+        Slot*  _slots;
+        size_t _mask;
+
+        // Keep the producer and consumer indices on separate cache lines
+        alignas(64) std::atomic<size_t> _head;
+        alignas(64) std::atomic<size_t> _tail;
+
+        // producer-side counters
+        alignas(64) std::atomic<unsigned long> _received;
+        std::atomic<unsigned long> _dropped;
+        std::atomic<size_t>        _highWater;
+};
+
+#endif
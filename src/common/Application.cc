@@ -30,6 +30,9 @@
 #include <boost/property_tree/json_parser.hpp>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <unistd.h>
+#include <thread>
+#include <chrono>
 
 // xdaq stuff
 #include "cgicc/CgiDefs.h"
@@ -45,6 +48,7 @@
 #include "xcept/tools.h"
 #include "xdata/InfoSpaceFactory.h"
 #include "toolbox/TimeVal.h"
+#include "toolbox/string.h"
 #include "toolbox/task/TimerFactory.h"
 
 #include "b2in/nub/Method.h"
@@ -64,6 +68,7 @@
 #include "bril/pltslinkprocessor/Application.h"
 #include "bril/pltslinkprocessor/exception/Exception.h"
 #include "interface/bril/PLTSlinkTopics.hh"
+#include "bril/pltslinkprocessor/PLTSlinkBXTopic.h"
 
 
 using boost::property_tree::ptree;
@@ -71,12 +76,19 @@ using boost::property_tree::write_json;
 
 XDAQ_INSTANTIATOR_IMPL (bril::pltslinkprocessor::Application) 
 
+// Between the slink receive thread and zmqClient: the receiver says when the
+// ring stops being empty and zmqClient tells it to stop
+static const char* const SLINK_RING_ENDPOINT = "inproc://pltslinkring";
+// For the destructor to stop zmqClient
+static const char* const ZMQCLIENT_STOP_ENDPOINT = "inproc://pltslinkstop";
+
     using namespace interface::bril;
 
-bril::pltslinkprocessor::Application::Application (xdaq::ApplicationStub* s) throw (xdaq::exception::Exception): xdaq::Application(s), xgi::framework::UIManager(this), eventing::api::Member(this)
+bril::pltslinkprocessor::Application::Application (xdaq::ApplicationStub* s) throw (xdaq::exception::Exception): xdaq::Application(s), xgi::framework::UIManager(this), eventing::api::Member(this), m_outputFiles("/nfshome0/naodell/test_data")
 {
     this->getEventingBus("brildata").addActionListener(this);
     xgi::framework::deferredbind(this,this,&bril::pltslinkprocessor::Application::Default, "Default");
+    xgi::bind(this, &bril::pltslinkprocessor::Application::Metrics, "metrics");
     m_poolFactory   = toolbox::mem::getMemoryPoolFactory();
     m_appDescriptor = getApplicationDescriptor();
     m_classname     = m_appDescriptor->getClassName();
@@ -103,6 +115,14 @@ bril::pltslinkprocessor::Application::Application (xdaq::ApplicationStub* s) thr
         getApplicationInfoSpace()->fireItemAvailable("bus",&m_bus);
         getApplicationInfoSpace()->fireItemAvailable("workloopHost",&m_workloopHost);
         getApplicationInfoSpace()->fireItemAvailable("slinkHost",&m_slinkHost);
+        m_fullReconstruction = true;
+        getApplicationInfoSpace()->fireItemAvailable("fullReconstruction",&m_fullReconstruction);
+        m_reconstructionThreads = 1;
+        getApplicationInfoSpace()->fireItemAvailable("reconstructionThreads",&m_reconstructionThreads);
+        m_chargeTableMB = 0;
+        getApplicationInfoSpace()->fireItemAvailable("chargeTableMB",&m_chargeTableMB);
+        m_chargeTableHalf = false;
+        getApplicationInfoSpace()->fireItemAvailable("chargeTableHalf",&m_chargeTableHalf);
         getApplicationInfoSpace()->addListener(this, "urn:xdaq-event:setDefaultValues");
         m_publishing = toolbox::task::getWorkLoopFactory()->getWorkLoop(m_appDescriptor->getURN()+"_publishing","waiting");
     }
@@ -112,9 +132,36 @@ bril::pltslinkprocessor::Application::Application (xdaq::ApplicationStub* s) thr
 
     // output
     m_outtopicdicts.insert( std::make_pair(pltslinklumiT::topicname(),pltslinklumiT::payloaddict()) );
+    m_outtopicdicts.insert( std::make_pair(pltslinkbxT::topicname(),pltslinkbxT::payloaddict()) );
+
+    m_slinkRing = new SlinkRing<zmq::message_t>(SLINK_RING_SLOTS);
+    m_zmqContext = new zmq::context_t(1);
+    m_stopping = false;
 }
 
-bril::pltslinkprocessor::Application::~Application (){}
+bril::pltslinkprocessor::Application::~Application ()
+{
+    // Stop zmqClient, if it runs, and wait for it to return: it stops and
+    // joins the receive thread first, so then nothing uses the ring any more.
+    // If zmqClient has not bound its stop socket yet it sees m_stopping
+    // once it has.
+    m_stopping = true;
+    try {
+        zmq::socket_t stop_socket(*m_zmqContext, ZMQ_PUSH);
+        int const linger = 0;
+        stop_socket.setsockopt(ZMQ_LINGER, &linger, sizeof(linger));
+        stop_socket.connect(ZMQCLIENT_STOP_ENDPOINT);
+        char const stop = 0;
+        stop_socket.send(&stop, sizeof(stop), ZMQ_DONTWAIT);
+    } catch (zmq::error_t& e) {
+        LOG4CPLUS_WARN(getApplicationLogger(), std::string("Cannot signal zmqClient to stop: ") + e.what());
+    }
+    {
+        std::lock_guard<std::mutex> stopped(m_zmqClientRunning);
+    }
+    delete m_slinkRing;
+    delete m_zmqContext;
+}
 
 void bril::pltslinkprocessor::Application::actionPerformed(xdata::Event& e){
 
@@ -180,6 +227,11 @@ void bril::pltslinkprocessor::Application::Default (xgi::Input * in, xgi::Output
     *out << cgicc::td( pltslinklumiT::topicname());
     *out << cgicc::tr();
 
+    *out << cgicc::tr();
+    *out << cgicc::th("out_topics");
+    *out << cgicc::td( pltslinkbxT::topicname());
+    *out << cgicc::tr();
+
     *out << cgicc::tr();
     *out << cgicc::th("signalTopic");
     *out << cgicc::td( m_signalTopic.toString());
@@ -190,7 +242,101 @@ void bril::pltslinkprocessor::Application::Default (xgi::Input * in, xgi::Output
     *out << cgicc::br() << std::endl;
 
     *out << cgicc::img().set("src","/OccupancyPlot_CHA15_ROC2.pdf").set("alt", "Channel 15 ROC 2").set("height", "100").set("width","100") << std::endl;
+    *out << cgicc::br() << std::endl;
+
+    // Live pipeline counters; the same in plain text at <appurl>/metrics
+    *out << cgicc::table().set("class","xdaq-table-vertical");
+    *out << cgicc::caption("pipeline");
+    *out << cgicc::tbody();
+    const unsigned long published = m_metrics.lsPublished.load(std::memory_order_relaxed);
+    const std::pair<const char*, unsigned long> rows[] = {
+        std::make_pair("slink messages received",    m_slinkRing->Received()),
+        std::make_pair("slink messages dropped",     m_slinkRing->Dropped()),
+        std::make_pair("ring depth",                 (unsigned long) m_slinkRing->Occupancy()),
+        std::make_pair("ring high water",            (unsigned long) m_slinkRing->HighWater()),
+        std::make_pair("ring slots",                 (unsigned long) m_slinkRing->NSlots()),
+        std::make_pair("slink messages decoded",     m_metrics.messages.load(std::memory_order_relaxed)),
+        std::make_pair("events decoded",             m_metrics.events.load(std::memory_order_relaxed)),
+        std::make_pair("buffers with odd size",      m_metrics.oddSize.load(std::memory_order_relaxed)),
+        std::make_pair("events without header",      m_metrics.noHeader.load(std::memory_order_relaxed)),
+        std::make_pair("events without trailer",     m_metrics.noTrailer.load(std::memory_order_relaxed)),
+        std::make_pair("truncated TDC blocks",       m_metrics.truncatedTDC.load(std::memory_order_relaxed)),
+        std::make_pair("lumisections published",     published),
+        std::make_pair("lumisections queued",        m_metrics.lsQueued.load(std::memory_order_relaxed) - published),
+        std::make_pair("LS latency (us)",            m_metrics.lsLatencyLast.load(std::memory_order_relaxed)),
+        std::make_pair("LS latency max (us)",        m_metrics.lsLatencyMax.load(std::memory_order_relaxed))
+    };
+    for (unsigned i = 0; i < sizeof(rows)/sizeof(rows[0]); ++i) {
+        *out << cgicc::tr();
+        *out << cgicc::th(rows[i].first);
+        *out << cgicc::td(toolbox::toString("%lu", rows[i].second));
+        *out << cgicc::tr();
+    }
+    *out << cgicc::tbody(); 
+    *out << cgicc::table();
+    *out << cgicc::br() << std::endl;
+
+    *out << cgicc::table().set("class","xdaq-table");
+    *out << cgicc::caption("per channel");
+    *out << cgicc::thead() << cgicc::tr();
+    *out << cgicc::th("channel") << cgicc::th("hits") << cgicc::th("clusters") << cgicc::th("tracks") << cgicc::th("desyncs");
+    for (unsigned type = 0; type < PipelineMetrics::NERRORTYPES; ++type) {
+        *out << cgicc::th(std::string("errors ") + PipelineMetrics::ErrorName(type));
+    }
+    *out << cgicc::tr() << cgicc::thead();
+    *out << cgicc::tbody();
+    for (unsigned ch = 0; ch < PipelineMetrics::NCHANNELS; ++ch) {
+        if (m_metrics.hits[ch].load(std::memory_order_relaxed) == 0 && m_metrics.desyncs[ch].load(std::memory_order_relaxed) == 0) {
+            continue;
+        }
+        *out << cgicc::tr();
+        *out << cgicc::td(toolbox::toString("%u", ch));
+        *out << cgicc::td(toolbox::toString("%lu", m_metrics.hits[ch].load(std::memory_order_relaxed)));
+        *out << cgicc::td(toolbox::toString("%lu", m_metrics.clusters[ch].load(std::memory_order_relaxed)));
+        *out << cgicc::td(toolbox::toString("%lu", m_metrics.tracks[ch].load(std::memory_order_relaxed)));
+        *out << cgicc::td(toolbox::toString("%lu", m_metrics.desyncs[ch].load(std::memory_order_relaxed)));
+        for (unsigned type = 0; type < PipelineMetrics::NERRORTYPES; ++type) {
+            *out << cgicc::td(toolbox::toString("%lu", m_metrics.channelErrors[ch][type].load(std::memory_order_relaxed)));
+        }
+        *out << cgicc::tr();
+    }
+    *out << cgicc::tbody(); 
+    *out << cgicc::table();
+    *out << cgicc::br() << std::endl;
 
+    // Filled only when built with PLT_STAGE_TIMING
+    *out << cgicc::table().set("class","xdaq-table");
+    *out << cgicc::caption("time per event by stage, last lumisection (ns)");
+    *out << cgicc::thead() << cgicc::tr();
+    *out << cgicc::th("stage") << cgicc::th("events") << cgicc::th("p50") << cgicc::th("p99") << cgicc::th("max");
+    *out << cgicc::tr() << cgicc::thead();
+    *out << cgicc::tbody();
+    for (int stage = 0; stage < kNStages; ++stage) {
+        *out << cgicc::tr();
+        *out << cgicc::td(PLTStageTimes::StageName(stage));
+        *out << cgicc::td(toolbox::toString("%lu", m_metrics.stageEvents[stage].load(std::memory_order_relaxed)));
+        *out << cgicc::td(toolbox::toString("%lu", m_metrics.stageP50[stage].load(std::memory_order_relaxed)));
+        *out << cgicc::td(toolbox::toString("%lu", m_metrics.stageP99[stage].load(std::memory_order_relaxed)));
+        *out << cgicc::td(toolbox::toString("%lu", m_metrics.stageMax[stage].load(std::memory_order_relaxed)));
+        *out << cgicc::tr();
+    }
+    *out << cgicc::tbody(); 
+    *out << cgicc::table();
+}
+
+/*
+ * Plain-text pipeline counters, one "name value" line each, for scripts and
+ * monitoring to poll.
+ */
+void bril::pltslinkprocessor::Application::Metrics (xgi::Input * in, xgi::Output * out) throw (xgi::exception::Exception) {
+
+    out->getHTTPResponseHeader().addHeader("Content-Type", "text/plain");
+    PipelineMetrics::Line(*out, "plt_ring_received", m_slinkRing->Received());
+    PipelineMetrics::Line(*out, "plt_ring_dropped", m_slinkRing->Dropped());
+    PipelineMetrics::Line(*out, "plt_ring_depth", m_slinkRing->Occupancy());
+    PipelineMetrics::Line(*out, "plt_ring_high_water", m_slinkRing->HighWater());
+    PipelineMetrics::Line(*out, "plt_ring_slots", m_slinkRing->NSlots());
+    m_metrics.WriteText(*out);
 }
 
 // onMessage has been removed, since this version of the processor doesn't need to listen
@@ -226,10 +372,29 @@ void bril::pltslinkprocessor::Application::doPublish(const std::string& busname,
 
 bool bril::pltslinkprocessor::Application::publishing(toolbox::task::WorkLoop* wl)
 {
+    bool idle = true;
+
+    // Lumisections handed over by zmqClient
+    while (!m_lumiSections.empty()) {
+        LumiSectionSummary* summary = m_lumiSections.pop();
+        publishLumiSection(*summary);
+
+        unsigned long const latency = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - summary->boundaryTime).count();
+        PipelineMetrics::Set(m_metrics.lsLatencyLast, latency);
+        if (latency > m_metrics.lsLatencyMax.load(std::memory_order_relaxed)) {
+            PipelineMetrics::Set(m_metrics.lsLatencyMax, latency);
+        }
+        PipelineMetrics::Add(m_metrics.lsPublished, 1);
+
+        delete summary;
+        idle = false;
+    }
+
     for(QueueStoreIt it = m_topicoutqueues.begin(); it != m_topicoutqueues.end(); ++it){
         if(it->second->empty()) 
             continue;
 
+        idle = false;
         std::string topicname = it->first;
         LOG4CPLUS_INFO(getApplicationLogger(), "Publishing "+topicname);
         toolbox::mem::Reference* data = it->second->pop();
@@ -242,9 +407,128 @@ bool bril::pltslinkprocessor::Application::publishing(toolbox::task::WorkLoop* w
         if(data) 
             data->release();
     }
+
+    // Nothing to do: don't spin, a lumisection is 23 s long
+    if (idle) {
+        ::usleep(10000);
+    }
     return true;
 }
 
+void bril::pltslinkprocessor::Application::publishLumiSection(const LumiSectionSummary& summary)
+{
+    // Runs on the publishing workloop, which is the only user of the output files
+    m_outputFiles.Write(summary);
+
+    std::cout << "Publishing plots with fill " << summary.fill 
+        << " run " << summary.run 
+        << " LS " << summary.ls 
+        << " events " << summary.nevents
+        << " buffer layout problems " << summary.bufferProblems
+        << " ring high water " << summary.ringHighWater << "/" << summary.ringSlots
+        << " dropped " << summary.ringDropped;
+
+    // Time per event by stage, p50/p99/max in ns (only with PLT_STAGE_TIMING)
+    m_metrics.SetStageTimes(summary.stageTimes);
+    for (int stage = 0; stage < kNStages; ++stage) {
+        if (m_metrics.stageEvents[stage].load(std::memory_order_relaxed) != 0) {
+            std::cout << " " << PLTStageTimes::StageName(stage) << " "
+                << m_metrics.stageP50[stage].load(std::memory_order_relaxed) << "/"
+                << m_metrics.stageP99[stage].load(std::memory_order_relaxed) << "/"
+                << m_metrics.stageMax[stage].load(std::memory_order_relaxed);
+        }
+    }
+    std::cout << std::endl;
+    //makePlots();
+
+    // avg/avgraw are the zero-counting mu of the fast path, averaged over the
+    // channels like the per-BX mu on pltslinkbx; it is there with or without
+    // full reconstruction. The good-track rate only goes to the printout and
+    // the lumi_rates file.
+    float mu = 0.;
+    for (unsigned i = 0; i < summary.channels.size(); ++i) {
+        const float* eff = &summary.eff[3*i];
+        float acc = summary.acc[i];
+        mu += summary.mu[i];
+
+        cout << "channel " << summary.channels[i] 
+             << " :efficiency: " << eff[0] << ", " << eff[1] << ", " << eff[2] 
+             << " :accidental: " << acc;
+        if (i < summary.pzero.size()) {
+            cout << " :tracks: " << summary.pzero[i];
+        }
+        cout << " :mu: " << summary.mu[i] << endl;
+    }
+    if (!summary.channels.empty()) {
+        mu /= summary.channels.size();
+    }
+
+    toolbox::TimeVal timeStamp = toolbox::TimeVal::gettimeofday();
+
+    // prepare output buffer and publish
+    size_t bufferSize = pltslinklumiT::maxsize();
+    toolbox::mem::Reference* bufferRef = m_poolFactory->getFrame(m_memPool, bufferSize);
+    bufferRef->setDataSize(bufferSize);
+
+    pltslinklumiT* payload = (pltslinklumiT*) (bufferRef->getDataLocation());
+    payload->setTime(summary.fill, summary.run, summary.ls, summary.nibble, timeStamp.sec(), timeStamp.millisec());
+    payload->setResource(DataSource::PLT, 0, 1, StorageType::COMPOUND);
+    payload->setTotalsize(pltslinklumiT::maxsize());
+    //payload->setFrequency(4);
+
+    CompoundDataStreamer streamer(pltslinklumiT::payloaddict()); 
+    char calibtag[] = "default";
+    streamer.insert_field(payload->payloadanchor, "calibtag" , &calibtag);
+    streamer.insert_field(payload->payloadanchor, "avgraw", &mu);
+    streamer.insert_field(payload->payloadanchor, "avg", &mu);
+    doPublish("brildata", pltslinklumiT::topicname(), bufferRef);
+
+    publishBXHistograms(summary);
+    std::cout << "Done sending publishing data to 'brildata'" << std::endl;
+}
+
+
+void bril::pltslinkprocessor::Application::publishBXHistograms(const LumiSectionSummary& summary)
+{
+    // Triggers, zeros per channel and the zero-counting mu, per BX
+    const BXHistograms& bxHistograms = summary.bxHistograms;
+    const unsigned nchannels = std::min<size_t>(bxHistograms.Channels().size(), PLTSLINKBX_NCHANNELS);
+    vector<uint32_t> channels(PLTSLINKBX_NCHANNELS, 0);
+    vector<uint32_t> triggers(BXHistograms::NBX);
+    vector<uint32_t> zeros(PLTSLINKBX_NCHANNELS * BXHistograms::NBX, 0);
+    vector<float> mu(BXHistograms::NBX, 0.);
+    for (unsigned i = 0; i < nchannels; ++i) {
+        channels[i] = bxHistograms.Channels()[i];
+    }
+    for (unsigned bx = 0; bx < BXHistograms::NBX; ++bx) {
+        triggers[bx] = bxHistograms.Triggers(bx);
+        for (unsigned i = 0; i < nchannels; ++i) {
+            zeros[i * BXHistograms::NBX + bx] = bxHistograms.Zeros(i, bx);
+            mu[bx] += bxHistograms.ZeroCounting(i, bx);
+        }
+        if (nchannels != 0) {
+            mu[bx] /= nchannels;
+        }
+    }
+
+    toolbox::TimeVal timeStamp = toolbox::TimeVal::gettimeofday();
+
+    size_t bufferSize = pltslinkbxT::maxsize();
+    toolbox::mem::Reference* bufferRef = m_poolFactory->getFrame(m_memPool, bufferSize);
+    bufferRef->setDataSize(bufferSize);
+
+    pltslinkbxT* payload = (pltslinkbxT*) (bufferRef->getDataLocation());
+    payload->setTime(summary.fill, summary.run, summary.ls, summary.nibble, timeStamp.sec(), timeStamp.millisec());
+    payload->setResource(DataSource::PLT, 0, 1, StorageType::COMPOUND);
+    payload->setTotalsize(pltslinkbxT::maxsize());
+
+    CompoundDataStreamer streamer(pltslinkbxT::payloaddict());
+    streamer.insert_field(payload->payloadanchor, "channels", &channels[0]);
+    streamer.insert_field(payload->payloadanchor, "triggers", &triggers[0]);
+    streamer.insert_field(payload->payloadanchor, "zeros", &zeros[0]);
+    streamer.insert_field(payload->payloadanchor, "mu", &mu[0]);
+    doPublish("brildata", pltslinkbxT::topicname(), bufferRef);
+}
 
 void bril::pltslinkprocessor::Application::stopTimer(){
     toolbox::task::Timer* timer = toolbox::task::TimerFactory::getInstance()->getTimer(m_timername);
@@ -281,64 +565,123 @@ void bril::pltslinkprocessor::Application::timeExpired(toolbox::task::TimerEvent
     zmqClient();
 }
 
+void bril::pltslinkprocessor::Application::slinkReceiver(zmq::context_t* context)
+{
+    // Runs on its own thread and does nothing but move slink messages from zmq
+    // into the ring, so that it keeps up whatever the processing is doing. If
+    // the ring is full the message is still taken off the socket and counted
+    // as dropped, rather than being lost at the zmq high-water mark.
+    zmq::socket_t slink_socket(*context, ZMQ_SUB);
+    slink_socket.connect(m_slinkHost.c_str());
+    slink_socket.setsockopt(ZMQ_SUBSCRIBE, 0, 0);
+
+    // zmqClient waits on this when the ring is empty, and stops us through it
+    zmq::socket_t ring_socket(*context, ZMQ_PAIR);
+    ring_socket.connect(SLINK_RING_ENDPOINT);
+
+    zmq::pollitem_t pollItems[2] = {
+        {slink_socket, 0, ZMQ_POLLIN, 0},
+        {ring_socket, 0, ZMQ_POLLIN, 0}
+    };
+
+    // Each message is received straight into its slot, whatever its size
+    zmq::message_t scratch;
+    char const wake = 0;
+    while (1) {
+        zmq_poll(&pollItems[0], 2, -1);
+        if (pollItems[1].revents & ZMQ_POLLIN) {
+            break;
+        }
+
+        // All the messages there are, then back to waiting
+        while (1) {
+            zmq::message_t* slot = m_slinkRing->WriteSlot();
+            if (!slink_socket.recv(slot ? slot : &scratch, ZMQ_DONTWAIT)) {
+                break;
+            }
+            if (!slot) {
+                m_slinkRing->Drop();
+                continue;
+            }
+            m_slinkRing->Commit();
+
+            // Only the message that makes the ring non-empty needs a wake-up:
+            // zmqClient does not wait while there are messages in the ring.
+            // The fence pairs with the one in zmqClient: either it sees this
+            // message or we see that it emptied the ring.
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (m_slinkRing->Occupancy() == 1) {
+                ring_socket.send(&wake, sizeof(wake), ZMQ_DONTWAIT);
+            }
+        }
+    }
+}
+
 void bril::pltslinkprocessor::Application::zmqClient()
 {
-    // Use zmq_poll to get zmq messages from the multiple sources.
-    zmq::context_t zmq_context(1);
+    // The slink messages are received on a separate thread (slinkReceiver) and
+    // come in through m_slinkRing; this thread listens to the workloop and
+    // does all the processing. Both run until the destructor stops them.
+    std::lock_guard<std::mutex> running(m_zmqClientRunning);
+    zmq::socket_t stop_socket(*m_zmqContext, ZMQ_PULL);
+    stop_socket.bind(ZMQCLIENT_STOP_ENDPOINT);
+    if (m_stopping) {
+        return;
+    }
 
     // Workloop zmq listener: used for getting TCDS info from workloop
-    zmq::socket_t workloop_socket(zmq_context, ZMQ_SUB);
+    zmq::socket_t workloop_socket(*m_zmqContext, ZMQ_SUB);
     workloop_socket.connect(m_workloopHost.c_str());
     workloop_socket.setsockopt(ZMQ_SUBSCRIBE, 0, 0);
 
+    // Wake-ups from the receive thread, and its stop
+    zmq::socket_t ring_socket(*m_zmqContext, ZMQ_PAIR);
+    ring_socket.bind(SLINK_RING_ENDPOINT);
+
     uint32_t EventHisto[3573];
     uint32_t tcds_info[4];
     uint32_t channel;
     int old_run = 1; // Set these high so we don't immediately publish
     int old_ls  = 999999;   // the first LS
 
-    // Slink zmq listener: used for getting actual data from slink
-    zmq::socket_t slink_socket(zmq_context, ZMQ_SUB);
-    slink_socket.connect(m_slinkHost.c_str());
-    slink_socket.setsockopt(ZMQ_SUBSCRIBE, 0, 0);
-
-    uint32_t slinkBuffer[1024];
-    // Translation of pixel FED channel number to readout channel number.
-    int nevents = 0; // counter of slink items received
     const unsigned validChannels[] = {2, 4, 5, 8, 10, 11, 13, 14, 16, 17, 19, 20};
-    const int channelNumber[37] = {-1, 0, 1, -1, 2, 3, -1, 4, 5, -1, 6, 7,  // 0-11
-        -1, 8, 9, -1, 10, 11, -1, 12, 13, -1, 14, 15, // 12-23
-        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
-    };
 
     // Set up poll object
-    zmq::pollitem_t pollItems[2] = {
+    zmq::pollitem_t pollItems[3] = {
         {workloop_socket, 0, ZMQ_POLLIN, 0},
-        {slink_socket, 0, ZMQ_POLLIN, 0}
+        {ring_socket, 0, ZMQ_POLLIN, 0},
+        {stop_socket, 0, ZMQ_POLLIN, 0}
     };
 
-    // Set up the PLTEvent object to do the event decoding. Note: for testing
-    // purposes we don't have a gaincal, alignment, or tracking, but we will
-    // want to implement these in order to do more interesting things.
+    // Set up the pipeline that does the event decoding, reconstruction and
+    // analysis; the same runs offline in pltslinkreplay.
 
     // Maybe put these in the configuration xml
     string gcFile = "/nfshome0/naodell/plt/daq/bril/pltslinkprocessor/data/GainCalFits_20160501.155303.dat";
     string alFile = "/nfshome0/naodell/plt/daq/bril/pltslinkprocessor/data/Trans_Alignment_4895.dat";
+    string maskFile = "/nfshome0/naodell/plt/daq/bril/pltslinkprocessor/data/Mask_2016_VdM_v1.txt";
 
-    PLTEvent *event = new PLTEvent("", gcFile, alFile, kBuffer);
-    event->ReadOnlinePixelMask("/nfshome0/naodell/plt/daq/bril/pltslinkprocessor/data/Mask_2016_VdM_v1.txt");
-    event->SetPlaneClustering(PLTPlane::kClustering_NoClustering, PLTPlane::kFiducialRegion_All);
-    event->SetPlaneFiducialRegion(PLTPlane::kFiducialRegion_All);
-    event->SetTrackingAlgorithm(PLTTracking::kTrackingAlgorithm_01to2_AllCombs);
-    //event->SetTrackingAlgorithm(PLTTracking::kTrackingAlgorithm_NoTracking);
-
-    // Initialize tools
     vector<unsigned> channels(validChannels, validChannels + sizeof(validChannels)/sizeof(unsigned));
-    EventAnalyzer *eventAnalyzer = new EventAnalyzer(event, "", channels);
+    SlinkPipeline pipeline(gcFile, alFile, maskFile, channels, m_metrics);
+    pipeline.SetFullReconstruction(m_fullReconstruction, m_reconstructionThreads);
+    pipeline.SetChargeTable((size_t) (unsigned) m_chargeTableMB << 20, m_chargeTableHalf);
+    pipeline.SetOccupancyPlots(m_OccupancyPlots);
+
+    // Slink zmq listener: used for getting actual data from slink
+    std::thread receiver(&bril::pltslinkprocessor::Application::slinkReceiver, this, m_zmqContext);
 
     // Loop and receive messages
-    while (1) {
-        zmq_poll(&pollItems[0],  2,  -1);
+    char wake;
+    while (!m_stopping) {
+        // Don't wait if there are slink events to process; otherwise sleep
+        // until the workloop, the receive thread or the destructor wakes us
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        zmq_poll(&pollItems[0],  3,  m_slinkRing->Occupancy() > 0 ? 0 : -1);
+
+        if (pollItems[1].revents & ZMQ_POLLIN) {
+            while (ring_socket.recv(&wake, sizeof(wake), ZMQ_DONTWAIT) != 0) {
+            }
+        }
 
         // Check for workloop message
         if (pollItems[0].revents & ZMQ_POLLIN) {
@@ -355,135 +698,41 @@ void bril::pltslinkprocessor::Application::zmqClient()
             m_fill   = tcds_info[3];
 
             //std::cout << "Received tcds message ch " << channel << " fill " << m_fill << " run " << m_run << " LS " << m_ls << " nibble " << m_nibble << std::endl;
-            if (old_run == 1) {
-                this->initializeOutputFiles(m_run, channels);
-            } else if (m_run > old_run) {
-                effFile.close();
-                accFile.close();
-                lumiFile.close();
-                this->initializeOutputFiles(m_run, channels);
-            }
-
-            // If we've started a new run or a new lumisection, then go ahead
-            // and publish what we have.
+            // If we've started a new run or a new lumisection, then take a
+            // snapshot of what we have and leave the output files, printout and
+            // publication to the publishing workloop, so that slink data keeps
+            // being processed in the meantime.
             if (m_ls > old_ls or m_run > old_run) {
-                std::cout << "Publishing plots with fill " << m_fill 
-                    << " run " << m_run 
-                    << " LS " << m_ls 
-                    << " events " << nevents << std::endl;
-                //makePlots();
-
-                effFile << m_ls;
-                accFile << m_ls;
-                lumiFile << m_ls;
-
-                const unsigned nChannels = sizeof(validChannels) / sizeof(validChannels[0]);
-                vector<float> eff;
-                float acc = 0.;
-                float pzero = 0.;
-                for (unsigned i = 0; i < nChannels; ++i) {
-                    eff   = eventAnalyzer->GetTelescopeEfficiency(validChannels[i]);
-                    acc   = eventAnalyzer->GetTelescopeAccidentals(validChannels[i]);
-                    pzero = eventAnalyzer->GetZeroCounting(validChannels[i]);
-
-                    cout << "channel " << validChannels[i] 
-                         << " :efficiency: " << eff[0] << ", " << eff[1] << ", " << eff[2] 
-                         << " :accidental: " << acc
-                         << " :lumi: " << pzero << endl;
-
-                    effFile  << "," << eff[0] << "," << eff[1] << "," << eff[2];
-                    accFile  << "," << acc;
-                    lumiFile << "," << pzero;
-                }
-
-                effFile  << "\n" << std::flush;
-                accFile  << "\n" << std::flush;
-                lumiFile << "\n" << std::flush;
-
-                toolbox::TimeVal timeStamp = toolbox::TimeVal::gettimeofday();
-
-                // prepare output buffer and publish
-                xdata::Properties plist;
-                plist.setProperty("DATA_VERSION", DATA_VERSION);
-                plist.setProperty("PAYLOAD_DICT", pltslinklumiT::payloaddict());
-
-                size_t bufferSize = pltslinklumiT::maxsize();
-                toolbox::mem::Reference* bufferRef = m_poolFactory->getFrame(m_memPool, bufferSize);
-                bufferRef->setDataSize(bufferSize);
-
-                pltslinklumiT* payload = (pltslinklumiT*) (bufferRef->getDataLocation());
-                payload->setTime(m_fill, m_run, m_ls, m_nibble, timeStamp.sec(), timeStamp.millisec());
-                payload->setResource(DataSource::PLT, 0, 1, StorageType::COMPOUND);
-                payload->setTotalsize(pltslinklumiT::maxsize());
-                //payload->setFrequency(4);
-
-                CompoundDataStreamer streamer(pltslinklumiT::payloaddict()); 
-                char calibtag[] = "default";
-                streamer.insert_field(payload->payloadanchor, "calibtag" , &calibtag);
-                streamer.insert_field(payload->payloadanchor, "avgraw", &pzero);
-                streamer.insert_field(payload->payloadanchor, "avg", &pzero);
-                this->getEventingBus("brildata").publish("pltslinklumi", bufferRef, plist);
-                //doPublish("brildata", interface::bril::pltslinklumiT::topicname(), bufferRef);
-                std::cout << "Done sending publishing data to 'brildata'" << std::endl;
-
+                LumiSectionSummary* summary = pipeline.EndLumiSection(m_fill, m_run, m_ls, m_nibble);
+                summary->ringHighWater  = m_slinkRing->HighWater();
+                summary->ringSlots      = m_slinkRing->NSlots();
+                summary->ringDropped    = m_slinkRing->Dropped();
+                m_lumiSections.push(summary);
+                PipelineMetrics::Add(m_metrics.lsQueued, 1);
             }
             old_ls  = m_ls;
             old_run = m_run;
         }
 
-        // Check for slink message
-        if (pollItems[1].revents & ZMQ_POLLIN) {
-            int eventSize = slink_socket.recv((void*)slinkBuffer, sizeof(slinkBuffer)*sizeof(uint32_t), 0);
-
-            // feed it to Event.GetNextEvent()
-            event->GetNextEvent(slinkBuffer, eventSize/sizeof(uint32_t));
-
-            // Now the event is fully processed and we can do things with the
-            // processed information.  For now all we do is put the hits in the
-            // occupancy plots, but we can do all sorts of other things (work
-            // with tracks, pulse heights, etc.)
-
-            //if (event->NHits() > 20) {
-            //    std::cout << "Event " << event->EventNumber() << " BX " << event->BX() 
-            //        << " Time " << event->Time() << " has " << event->NHits() << " hits and " 
-            //        << event->GetErrors().size() << " errors" << std::endl;
-            //}
-
-            // Calculate efficiency and accidental rate per telescope
-            eventAnalyzer->AnalyzeEvent();
-
-            // fill occupancy plots
-            for (size_t ip = 0; ip != event->NPlanes(); ++ip) {
-                PLTPlane* Plane = event->Plane(ip);
-                int nhits = 0;
-                for (size_t ih = 0; ih != Plane->NHits(); ++ih) {
-                    PLTHit* Hit = Plane->Hit(ih);
-
-                    // Convert pixel FED channel number to readout channel number
-                    if (
-                            Hit->Channel() < 0 
-                            || Hit->Channel() > 36 
-                            || channelNumber[Hit->Channel()] < 0
-                       ) {
-                        // std::cout << "Found hit with invalid channel number: " << Hit->Channel();
-                    } else {
-                        int readoutChan = channelNumber[Hit->Channel()];
-                        // std::cout << "Hit  " << nhits << " FED chan " << Hit->Channel() << " readout chan " << readoutChan << " ROC " << Hit->ROC() << " col " << Hit->Column() << " row " << Hit->Row() << std::endl;
-                        nhits++;
-                        m_OccupancyPlots[(readoutChan*3) + Hit->ROC()]->Fill(Hit->Column(), Hit->Row());
-                    }
-                }
-            }
-
-            // const std::vector<PLTError>& errors = Event.GetErrors();
-            // if (errors.size() > 0) {
-            // 	for (std::vector<PLTError>::const_iterator it = errors.begin(); it != errors.end(); ++it) {
-            //  	  it->Print();
-            //  	}
-            // }
-            nevents++;
-        } // slink message
+        // Process the slink messages waiting in the ring, but not so many at a
+        // time that the workloop messages are held up
+        zmq::message_t* slinkMessage = 0;
+        for (size_t nslink = 0; nslink < 256 && (slinkMessage = m_slinkRing->ReadSlot()) != 0; ++nslink) {
+            // The message may hold several events back to back: they are
+            // decoded all at once, straight from the message data, into a
+            // batch that keeps its own copy of everything, so the message can
+            // be freed and its slot given back before the events are processed.
+            // rebuild() frees the data zmq allocated for the message.
+            pipeline.DecodeMessage(slinkMessage->data(), slinkMessage->size());
+            slinkMessage->rebuild();
+            m_slinkRing->Release();
+            pipeline.ProcessEvents();
+        } // slink messages
     } // message loop  
+
+    char const stop = 0;
+    ring_socket.send(&stop, sizeof(stop));
+    receiver.join();
 }
 
 void bril::pltslinkprocessor::Application::makePlots()
@@ -609,38 +858,3 @@ void bril::pltslinkprocessor::Application::makePlots()
     //std::cout << "Output complete. DQM files " << filenameJSN << ", " << filenameDAT << " and " << filenameROOT << " created." << std::endl;
 
 }
-
-void bril::pltslinkprocessor::Application::initializeOutputFiles(unsigned runNumber, vector<unsigned> channels)
-{
-    std::stringstream fname;
-    string baseDir = "/nfshome0/naodell/test_data";
-
-    fname << baseDir << "/efficiencies_" << m_run << ".csv";
-    string fname_str = fname.str();
-    effFile.open(fname_str.c_str(), ios::out);
-    fname.str("");
-
-    fname << baseDir << "/accidentals_" << m_run << ".csv";
-    fname_str = fname.str();
-    accFile.open(fname_str.c_str(), ios::out);
-    fname.str("");
-
-    fname << baseDir << "/lumi_rates_" << m_run << ".csv";
-    fname_str = fname.str();
-    lumiFile.open(fname_str.c_str(), ios::out);
-    fname.str("");
-
-    effFile  << "lumi_section";
-    accFile  << "lumi_section";
-    lumiFile << "lumi_section";
-
-    for (unsigned i = 0; i < channels.size(); ++i) {
-        unsigned ch = channels[i];
-        effFile  << ",ch" << ch << "_0,ch" << ch << "_1,ch" << ch << "_2";
-        accFile  << ",ch" << ch;
-        lumiFile << ",ch" << ch;
-    }
-    effFile  << "\n";
-    accFile  << "\n";
-    lumiFile << "\n";
-}
@@ -3,8 +3,11 @@
 
 EventAnalyzer::EventAnalyzer(PLTEvent *evt, std::string alignmentFile, vector<unsigned> channels)
 {
-    // Initialize the beam crossing counter
+    // Initialize the beam crossing counters
     _bxCounter = 0;
+    _bxStart   = 0;
+    _lumiBXCounter = 0;
+    std::fill(_coincidences, _coincidences + NCHANNELS, 0ul);
 
     // Point to the event object
     _event = evt; 
@@ -58,31 +61,36 @@ EventAnalyzer::EventAnalyzer(PLTEvent *evt, std::string alignmentFile, vector<un
                 >> residualYMean1 >> residualYSigma1 
                 >> residualYMean2 >> residualYSigma2; 
 
-            _meanSlopeX[channel]        = slopeXMean;
-            _meanSlopeY[channel]        = slopeYMean;
-            _sigmaSlopeX[channel]       = slopeXSigma;
-            _sigmaSlopeY[channel]       = slopeYSigma;
-            _meanResidualX[channel][0]  = residualXMean0;
-            _meanResidualX[channel][1]  = residualXMean1;
-            _meanResidualX[channel][2]  = residualXMean2;
-            _meanResidualY[channel][0]  = residualYMean0;
-            _meanResidualY[channel][1]  = residualYMean1;
-            _meanResidualY[channel][2]  = residualYMean2;
-            _sigmaResidualX[channel][0] = residualXSigma0;
-            _sigmaResidualX[channel][1] = residualXSigma1;
-            _sigmaResidualX[channel][2] = residualXSigma2;
-            _sigmaResidualY[channel][0] = residualYSigma0;
-            _sigmaResidualY[channel][1] = residualYSigma1;
-            _sigmaResidualY[channel][2] = residualYSigma2;
+            if (channel >= NCHANNELS) {
+                continue;
+            }
+            TrackQuality& quality = _trackQuality[channel];
+            quality.meanSlopeX        = slopeXMean;
+            quality.meanSlopeY        = slopeYMean;
+            quality.sigmaSlopeX       = slopeXSigma;
+            quality.sigmaSlopeY       = slopeYSigma;
+            quality.meanResidualX[0]  = residualXMean0;
+            quality.meanResidualX[1]  = residualXMean1;
+            quality.meanResidualX[2]  = residualXMean2;
+            quality.meanResidualY[0]  = residualYMean0;
+            quality.meanResidualY[1]  = residualYMean1;
+            quality.meanResidualY[2]  = residualYMean2;
+            quality.sigmaResidualX[0] = residualXSigma0;
+            quality.sigmaResidualX[1] = residualXSigma1;
+            quality.sigmaResidualX[2] = residualXSigma2;
+            quality.sigmaResidualY[0] = residualYSigma0;
+            quality.sigmaResidualY[1] = residualYSigma1;
+            quality.sigmaResidualY[2] = residualYSigma2;
         }
     }
 
     for (unsigned i = 0; i < channels.size(); ++i) {
         channel = channels[i];
-        _telescopeHits[channel]        = EffCounter();
-        _telescopeHitsDelayed[channel] = EffCounter();
-        _accidentalRates[channel]      = make_pair(0, 0);
+        if (channel < NCHANNELS) {
+            _channels.push_back(channel);
+        }
     }
+    _bxHistograms.SetChannels(_channels);
 
 
     cout << "EventAnalyzer initialization done!" << endl;
@@ -90,27 +98,61 @@ EventAnalyzer::EventAnalyzer(PLTEvent *evt, std::string alignmentFile, vector<un
 
 int EventAnalyzer::AnalyzeEvent()
 {
+    // Counts as part of the event's time, see PLTEvent::GetStageTimes
+    PLT_STAGE_TIMER(_event->GetStageTimes(), kStage_Analyze);
+
     // Increment the crossing counter
     ++_bxCounter;
 
-    // Loop over all telescopes 
-    for (size_t it = 0; it != _event->NTelescopes(); ++it) {
-        PLTTelescope* telescope = _event->Telescope(it);
+    // Loop over all telescopes. Each one only touches its own counters, so
+    // with reconstruction workers they are done in parallel.
+    PLTWorkerPool* pool = _event->GetWorkerPool();
+    if (pool) {
+        pool->Run(_event->NTelescopes(), [this] (size_t it, int) {
+            this->AnalyzeTelescope(*_event->Telescope(it));
+        });
+    } else {
+        for (size_t it = 0; it != _event->NTelescopes(); ++it) {
+            this->AnalyzeTelescope(*_event->Telescope(it));
+        }
+    }
+    return 0;
+}
 
-        // make them clean events
-        if (telescope->NHitPlanes() >= 2 && (unsigned)(telescope->NHitPlanes()) == telescope->NClusters()) {
+void EventAnalyzer::AnalyzeTelescope(PLTTelescope &telescope)
+{
+    if ((unsigned) telescope.Channel() >= NCHANNELS) {
+        return;
+    }
 
-            // Calculate rates for efficiencies 
-            this->CalculateTelescopeRates(0, *telescope);
-            this->CalculateTelescopeRates(1, *telescope);
-            this->CalculateTelescopeRates(2, *telescope);
+    // make them clean events
+    if (telescope.NHitPlanes() >= 2 && (unsigned)(telescope.NHitPlanes()) == telescope.NClusters()) {
 
-            if (telescope->NHitPlanes() == 3) {
-                this->CalculateAccidentalRates(*telescope);
-            }
+        // Calculate rates for efficiencies 
+        this->CalculateTelescopeRates(0, telescope);
+        this->CalculateTelescopeRates(1, telescope);
+        this->CalculateTelescopeRates(2, telescope);
+
+        if (telescope.NHitPlanes() == 3) {
+            this->CalculateAccidentalRates(telescope);
         }
     }
-    return 0;
+}
+
+void EventAnalyzer::AnalyzeLumi(const uint8_t* planeMasks, uint32_t bx)
+{
+    // Just counting, so that empty crossings cost next to nothing
+    ++_lumiBXCounter;
+    for (std::vector<unsigned>::const_iterator it = _channels.begin(); it != _channels.end(); ++it) {
+        _coincidences[*it] += (planeMasks[*it] == 7);
+    }
+    _bxHistograms.Fill(bx, planeMasks);
+}
+
+void EventAnalyzer::TakeBXHistograms(BXHistograms& out)
+{
+    out.Swap(_bxHistograms);
+    _bxHistograms.SetChannels(_channels);
 }
 
 void EventAnalyzer::CalculateTelescopeRates(unsigned iPlane, PLTTelescope &telescope)
@@ -118,6 +160,7 @@ void EventAnalyzer::CalculateTelescopeRates(unsigned iPlane, PLTTelescope &teles
     PLTPlane *tags[2] = {0x0, 0x0};
     PLTPlane *probe   = 0x0;
     unsigned channel  = telescope.Channel();
+    TelescopeCounters& counters = _telescopes[channel];
     unsigned ix = 0;
     for (size_t ip = 0; ip != telescope.NPlanes(); ++ip) {
         if (ip == iPlane) {
@@ -138,7 +181,7 @@ void EventAnalyzer::CalculateTelescopeRates(unsigned iPlane, PLTTelescope &teles
         // record two-hit track slopes
         std::pair<float, float> slopes;
         slopes = std::make_pair(twoHitTrack.fTVX/twoHitTrack.fTVZ, twoHitTrack.fTVY/twoHitTrack.fTVZ);
-        _twoHitTrackSlopes[channel].push_back(slopes);
+        counters.twoHitTrackSlopes.push_back(slopes);
 
         // Keep track of number of two/three-hit tracks for this plane
         if (
@@ -157,18 +200,18 @@ void EventAnalyzer::CalculateTelescopeRates(unsigned iPlane, PLTTelescope &teles
             LXY= _alignment->TtoLXY(twoHitTrack.TX(CP->LZ), twoHitTrack.TY(CP->LZ), channel, iPlane);
             PXY= _alignment->PXYfromLXY(LXY);
 
-            ++_telescopeHits[channel].denom[iPlane];
+            ++counters.hits.denom[iPlane];
             if (_bxCounter > 1e7) {
-                ++_telescopeHitsDelayed[channel].denom[iPlane];
+                ++counters.hitsDelayed.denom[iPlane];
             }
 
             if (probe->NClusters() > 0) {
                 std::pair<float, float> ResXY = twoHitTrack.LResiduals(*(probe->Cluster(0)), *_alignment);
                 std::pair<float, float> RPXY = _alignment->PXYDistFromLXYDist(ResXY);
                 if (fabs(RPXY.first) <= _pixelDist && fabs(RPXY.second) <= _pixelDist) {
-                    ++_telescopeHits[channel].numer[iPlane];
+                    ++counters.hits.numer[iPlane];
                     if (_bxCounter > 1e7) {
-                        ++_telescopeHitsDelayed[channel].numer[iPlane];
+                        ++counters.hitsDelayed.numer[iPlane];
                     }
                 }
             }
@@ -180,6 +223,8 @@ void EventAnalyzer::CalculateTelescopeRates(unsigned iPlane, PLTTelescope &teles
 void EventAnalyzer::CalculateAccidentalRates(PLTTelescope &telescope)
 {
     unsigned channel  = telescope.Channel();
+    TelescopeCounters& counters = _telescopes[channel];
+    const TrackQuality& quality = _trackQuality[channel];
     if (telescope.NTracks() > 0) {
         for (size_t itrack = 0; itrack < telescope.NTracks(); ++itrack) {
             PLTTrack *tr = telescope.Track(itrack);
@@ -189,30 +234,30 @@ void EventAnalyzer::CalculateAccidentalRates(PLTTelescope &telescope)
             float slopeY = tr->fTVY/tr->fTVZ;
             if (isnan(slopeX) || isnan(slopeY)) continue;
 
-            float dxSlope = fabs(slopeX - _meanSlopeX[channel])/_sigmaSlopeX[channel];
-            float dySlope = fabs(slopeY - _meanSlopeY[channel])/_sigmaSlopeY[channel];
-            float dxRes0 = (tr->LResidualX(0) - _meanResidualX[channel][0])/_sigmaResidualX[channel][0];
-            float dxRes1 = (tr->LResidualX(1) - _meanResidualX[channel][1])/_sigmaResidualX[channel][1];
-            float dxRes2 = (tr->LResidualX(2) - _meanResidualX[channel][2])/_sigmaResidualX[channel][2];
-            float dyRes0 = (tr->LResidualY(0) - _meanResidualY[channel][0])/_sigmaResidualY[channel][0];
-            float dyRes1 = (tr->LResidualY(1) - _meanResidualY[channel][1])/_sigmaResidualY[channel][1];
-            float dyRes2 = (tr->LResidualY(2) - _meanResidualY[channel][2])/_sigmaResidualY[channel][2];
+            float dxSlope = fabs(slopeX - quality.meanSlopeX)/quality.sigmaSlopeX;
+            float dySlope = fabs(slopeY - quality.meanSlopeY)/quality.sigmaSlopeY;
+            float dxRes0 = (tr->LResidualX(0) - quality.meanResidualX[0])/quality.sigmaResidualX[0];
+            float dxRes1 = (tr->LResidualX(1) - quality.meanResidualX[1])/quality.sigmaResidualX[1];
+            float dxRes2 = (tr->LResidualX(2) - quality.meanResidualX[2])/quality.sigmaResidualX[2];
+            float dyRes0 = (tr->LResidualY(0) - quality.meanResidualY[0])/quality.sigmaResidualY[0];
+            float dyRes1 = (tr->LResidualY(1) - quality.meanResidualY[1])/quality.sigmaResidualY[1];
+            float dyRes2 = (tr->LResidualY(2) - quality.meanResidualY[2])/quality.sigmaResidualY[2];
 
             if (
                     sqrt(pow(dxSlope,2) + pow(dySlope,2)) > 5.
                     && dxRes0 < 5. && dxRes1 < 5. && dxRes2 < 5.  
                     && dyRes0 < 5. && dyRes1 < 5. && dyRes2 < 5.
                ) {
-                ++_accidentalRates[channel].first;
+                ++counters.accidentals.first;
             } else {
-                ++_accidentalRates[channel].second;
+                ++counters.accidentals.second;
             }
 
             // record three-hit track slopes
             pair<float, float> slopes;
             slopes.first  = tr->fTVX/tr->fTVZ;
             slopes.second = tr->fTVY/tr->fTVZ;
-            _threeHitTrackSlopes[channel].push_back(slopes);
+            counters.threeHitTrackSlopes.push_back(slopes);
             //cout << "channel " << channel << ": " << slopes.first << " :: " << slopes.second << endl;
             
             break;
@@ -222,9 +267,12 @@ void EventAnalyzer::CalculateAccidentalRates(PLTTelescope &telescope)
 
 vector<float> EventAnalyzer::GetTelescopeEfficiency(int channel)
 {
-    EffCounter planeCounts        = _telescopeHits[channel];
-    EffCounter planeCountsDelayed = _telescopeHitsDelayed[channel];
     vector<float> eff (3, 0);
+    if (channel < 0 || (unsigned) channel >= NCHANNELS) {
+        return eff;
+    }
+    EffCounter planeCounts        = _telescopes[channel].hits;
+    EffCounter planeCountsDelayed = _telescopes[channel].hitsDelayed;
     for (unsigned i = 0; i < 3; ++i) {
         if (planeCounts.denom[i] - planeCountsDelayed.denom[i] > 0.) {
             eff[i]  = (planeCounts.numer[i] - planeCountsDelayed.numer[i]);
@@ -237,17 +285,65 @@ vector<float> EventAnalyzer::GetTelescopeEfficiency(int channel)
 float EventAnalyzer::GetTelescopeAccidentals(int channel)
 {
     float fakes = 0.;
-    if (_accidentalRates[channel].second > 0) {
-        fakes = _accidentalRates[channel].first/(_accidentalRates[channel].second + _accidentalRates[channel].second);
+    if (channel < 0 || (unsigned) channel >= NCHANNELS) {
+        return fakes;
+    }
+    const std::pair<unsigned, unsigned>& accidentals = _telescopes[channel].accidentals;
+    if (accidentals.second > 0) {
+        fakes = accidentals.first/(accidentals.second + accidentals.second);
     }
     return fakes;
 }
 
 float EventAnalyzer::GetZeroCounting(int channel)
 {
-    if (_bxCounter > 0.) {
-        return _accidentalRates[channel].second/_bxCounter;
+    if (_bxCounter > 0. && channel >= 0 && (unsigned) channel < NCHANNELS) {
+        return _telescopes[channel].accidentals.second/_bxCounter;
     } else {
         return 0.;
     }
 }
+
+float EventAnalyzer::GetFastZeroCounting(int channel)
+{
+    if (_lumiBXCounter == 0 || channel < 0 || (unsigned) channel >= NCHANNELS) {
+        return 0.;
+    }
+    unsigned long const zeros = _lumiBXCounter - _coincidences[channel];
+    if (zeros == 0) {
+        // every crossing had a coincidence, mu can't be measured
+        return 0.;
+    }
+    return -log(double(zeros)/_lumiBXCounter);
+}
+
+void EventAnalyzer::SetBXCounter(unsigned long bx)
+{
+    _bxCounter = bx;
+    _bxStart   = bx;
+}
+
+void EventAnalyzer::Merge(const EventAnalyzer& other)
+{
+    // Counters are plain sums; the slope lists are appended so that merging the
+    // pieces in file order gives the same lists as a single pass would.
+    _bxCounter += other._bxCounter - other._bxStart;
+    _lumiBXCounter += other._lumiBXCounter;
+    _bxHistograms.Add(other._bxHistograms);
+    for (unsigned i = 0; i < NCHANNELS; ++i) {
+        _coincidences[i] += other._coincidences[i];
+
+        TelescopeCounters& counters = _telescopes[i];
+        const TelescopeCounters& otherCounters = other._telescopes[i];
+        for (unsigned ip = 0; ip < 3; ++ip) {
+            counters.hits.denom[ip]        += otherCounters.hits.denom[ip];
+            counters.hits.numer[ip]        += otherCounters.hits.numer[ip];
+            counters.hitsDelayed.denom[ip] += otherCounters.hitsDelayed.denom[ip];
+            counters.hitsDelayed.numer[ip] += otherCounters.hitsDelayed.numer[ip];
+        }
+        counters.accidentals.first  += otherCounters.accidentals.first;
+        counters.accidentals.second += otherCounters.accidentals.second;
+        counters.twoHitTrackSlopes.insert(counters.twoHitTrackSlopes.end(), otherCounters.twoHitTrackSlopes.begin(), otherCounters.twoHitTrackSlopes.end());
+        counters.threeHitTrackSlopes.insert(counters.threeHitTrackSlopes.end(), otherCounters.threeHitTrackSlopes.begin(), otherCounters.threeHitTrackSlopes.end());
+    }
+}
@@ -250,7 +250,7 @@ float PLTAlignment::TtoLY (float const TX, float const TY, int const Channel, in
 std::pair<float, float> PLTAlignment::TtoLXY (float const TX, float const TY, int const Channel, int const ROC)
 {
   std::pair<int, int> CHROC = std::make_pair(Channel, ROC);
-  CP* C = fConstantMap.count(CHROC) == 1 ? &fConstantMap[CHROC] : (CP*) 0x0;
+  CP* C = GetCP(CHROC);
 
   if (!C) {
     std::cerr << "ERROR: cannot grab the constant mape for this CH ROC: " << CHROC.first << " " << CHROC.second << std::endl;
@@ -279,7 +279,7 @@ void PLTAlignment::VTtoVGXYZ (std::vector<float>& VOUT, float const TX, float co
 {
   // Get the constants for this telescope/plane etc
   std::pair<int, int> CHROC = std::make_pair(Channel, ROC);
-  CP* C = fConstantMap.count(CHROC) == 1 ? &fConstantMap[CHROC] : (CP*) 0x0;
+  CP* C = GetCP(CHROC);
 
   if (!C) {
     std::cerr << "ERROR: cannot grab the constant map for this CH ROC: " << CHROC.first << " " << CHROC.second << std::endl;
@@ -314,7 +314,7 @@ void PLTAlignment::VTtoVGXYZ (std::vector<float>& VOUT, float const TX, float co
 void PLTAlignment::LtoTXYZ (std::vector<float>& VOUT, float const LX, float const LY, int const Channel, int const ROC)
 {
   std::pair<int, int> CHROC = std::make_pair(Channel, ROC);
-  CP* C = fConstantMap.count(CHROC) == 1 ? &fConstantMap[CHROC] : (CP*) 0x0;
+  CP* C = GetCP(CHROC);
 
   if (!C) {
     std::cerr << "ERROR: cannot grab the constant mape for this CH ROC: " << CHROC.first << " " << CHROC.second << std::endl;
@@ -345,7 +345,7 @@ void PLTAlignment::TtoGXYZ (std::vector<float>& VOUT, float const TX, float cons
 {
   // Get the constants for this telescope/plane etc
   std::pair<int, int> CHROC = std::make_pair(Channel, ROC);
-  CP* C = fConstantMap.count(CHROC) == 1 ? &fConstantMap[CHROC] : (CP*) 0x0;
+  CP* C = GetCP(CHROC);
 
   if (!C) {
     std::cerr << "ERROR: cannot grab the constant mape for this CH ROC: " << CHROC.first << " " << CHROC.second << std::endl;
@@ -398,7 +398,7 @@ void PLTAlignment::GtoTXYZ (std::vector<float>& VOUT, float const GX, float cons
 
   // Get the constants for this telescope/plane etc
   std::pair<int, int> CHROC = std::make_pair(Channel, ROC);
-  CP* C = fConstantMap.count(CHROC) == 1 ? &fConstantMap[CHROC] : (CP*) 0x0;
+  CP* C = GetCP(CHROC);
 
   if (!C) {
     std::cerr << "ERROR: cannot grab the constant mape for this CH ROC: " << CHROC.first << " " << CHROC.second << std::endl;
@@ -498,18 +498,15 @@ float PLTAlignment::GZ (int const ch, int const roc)
 
 PLTAlignment::CP* PLTAlignment::GetCP (int const ch, int const roc)
 {
-  std::pair<int, int> CHROC = std::make_pair(ch, roc);
-  if (fConstantMap.count(CHROC)) {
-    return &fConstantMap[ CHROC ];
-  }
-
-  return (CP*) 0x0;
+  return GetCP(std::make_pair(ch, roc));
 }
 
 PLTAlignment::CP* PLTAlignment::GetCP (std::pair<int, int> const& CHROC)
 {
-  if (fConstantMap.count(CHROC)) {
-    return &fConstantMap[ CHROC ];
+  // Only looks, never inserts, so that several threads can share the alignment
+  std::map< std::pair<int, int>, CP >::iterator it = fConstantMap.find(CHROC);
+  if (it != fConstantMap.end()) {
+    return &it->second;
   }
 
   return (CP*) 0x0;
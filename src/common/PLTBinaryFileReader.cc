@@ -1,4 +1,16 @@
 #include "bril/pltslinkprocessor/PLTBinaryFileReader.h"
+#include "bril/pltslinkprocessor/PLTEventArena.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 PLTBinaryFileReader::PLTBinaryFileReader ()
 {
@@ -6,12 +18,36 @@ PLTBinaryFileReader::PLTBinaryFileReader ()
   fLastTime = 0;
   fTimeMult = 0;
   fInputType = kBinaryFile;
+  fArena = 0;
+  fMappedData = 0;
+  fMappedBytes = 0;
+  fMappedSize = 0;
+  fMappedPos = 0;
+  fTextPos = 0;
+  fTextEnd = 0;
+  fTextEOF = false;
+  fEventOffset = 0;
+  fStopOffset = NOSTOPOFFSET;
+  fDecodeHits = true;
+  fFormat = kFormatUnknown;
 }
 
 
 PLTBinaryFileReader::PLTBinaryFileReader (std::string const in, InputType inputType)
 {
   fInputType = inputType;
+  fArena = 0;
+  fMappedData = 0;
+  fMappedBytes = 0;
+  fMappedSize = 0;
+  fMappedPos = 0;
+  fTextPos = 0;
+  fTextEnd = 0;
+  fTextEOF = false;
+  fEventOffset = 0;
+  fStopOffset = NOSTOPOFFSET;
+  fDecodeHits = true;
+  fFormat = kFormatUnknown;
 
   Open(in);
   fPlaneFiducialRegion = PLTPlane::kFiducialRegion_All;
@@ -22,6 +58,7 @@ PLTBinaryFileReader::PLTBinaryFileReader (std::string const in, InputType inputT
 
 PLTBinaryFileReader::~PLTBinaryFileReader ()
 {
+  CloseMappedFile();
 }
 
 
@@ -35,6 +72,10 @@ bool PLTBinaryFileReader::Open (std::string const DataFileName)
   } else if (fInputType == kBuffer) {
     // nothing to do here
     return true;
+  } else if (fInputType == kMappedFile) {
+    return OpenMappedFile(DataFileName);
+  } else if (fInputType == kGzipFile) {
+    return OpenGzipFile(DataFileName);
   } else {
     std::cerr << "Unknown input type " << fInputType << std::endl;
     exit(1);
@@ -53,6 +94,14 @@ bool PLTBinaryFileReader::OpenBinary (std::string const DataFileName)
     return false;
   }
 
+  if (fFormat == kFormatUnknown) {
+    // Look at the start of the file through a second stream so fInfile stays at the beginning
+    std::ifstream Head(fFileName.c_str(), std::ios::in | std::ios::binary);
+    std::vector<uint32_t> Words(FORMATDETECTBYTES / sizeof(uint32_t));
+    Head.read((char*) &Words[0], FORMATDETECTBYTES);
+    fFormat = DetectFormat(&Words[0], Head.gcount() / sizeof(uint32_t));
+  }
+
   return true;
 }
 
@@ -67,11 +116,147 @@ bool PLTBinaryFileReader::OpenTextFile (std::string const DataFileName)
     return false;
   }
 
+  fTextBuffer.resize(TEXTBUFFERSIZE);
+  fTextPos = 0;
+  fTextEnd = 0;
+  fTextEOF = false;
+
+  return true;
+}
+
+
+
+bool PLTBinaryFileReader::FillTextBuffer ()
+{
+  // Move what is left of the buffer to the front and read the next block after it.
+  // Returns false if there was nothing more to read.
+  size_t const Left = fTextEnd - fTextPos;
+  if (Left != 0 && fTextPos != 0) {
+    memmove(&fTextBuffer[0], &fTextBuffer[fTextPos], Left);
+  }
+  fTextPos = 0;
+  fTextEnd = Left;
+
+  // A line longer than the whole buffer: make room for it
+  if (fTextEnd == fTextBuffer.size()) {
+    fTextBuffer.resize(2 * fTextBuffer.size());
+  }
+
+  fInfile.read(&fTextBuffer[fTextEnd], fTextBuffer.size() - fTextEnd);
+  size_t const NRead = fInfile.gcount();
+  fTextEnd += NRead;
+  if (NRead == 0 || fInfile.eof()) {
+    fTextEOF = true;
+  }
+
+  return NRead != 0;
+}
+
+
+
+static int ParseTextLine (char const* p, char const* const End, int* Values, int const MaxValues)
+{
+  // Parse up to MaxValues whitespace separated integers from [p, End) without
+  // allocating anything. Returns how many were found.
+  int N = 0;
+  while (N != MaxValues) {
+    while (p != End && (*p == ' ' || *p == '\t' || *p == '\r')) {
+      ++p;
+    }
+    if (p == End) {
+      break;
+    }
+
+    bool const Negative = *p == '-';
+    if (Negative || *p == '+') {
+      ++p;
+    }
+    if (p == End || *p < '0' || *p > '9') {
+      break;
+    }
+
+    int Value = 0;
+    for ( ; p != End && *p >= '0' && *p <= '9'; ++p) {
+      Value = 10 * Value + (*p - '0');
+    }
+    Values[N++] = Negative ? -Value : Value;
+  }
+
+  return N;
+}
+
+
+
+bool PLTBinaryFileReader::OpenGzipFile (std::string const DataFileName)
+{
+  fFileName = DataFileName;
+  return fGzip.Open(fFileName);
+}
+
+
+
+bool PLTBinaryFileReader::OpenMappedFile (std::string const DataFileName)
+{
+  // Map the whole slink file read-only so that ReadEventHitsMapped can walk
+  // through the words directly instead of doing one stream read per word.
+  CloseMappedFile();
+  fFileName = DataFileName;
+
+  int fd = open(fFileName.c_str(), O_RDONLY);
+  if (fd < 0) {
+    std::cerr << "ERROR: cannot open input file: " << fFileName << std::endl;
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    std::cerr << "ERROR: cannot stat input file: " << fFileName << std::endl;
+    close(fd);
+    return false;
+  }
+
+  if (st.st_size > 0) {
+    void* addr = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr == MAP_FAILED) {
+      std::cerr << "ERROR: cannot mmap input file: " << fFileName << std::endl;
+      close(fd);
+      return false;
+    }
+    // We read the file front to back, so tell the kernel to read ahead aggressively
+    madvise(addr, st.st_size, MADV_SEQUENTIAL);
+    fMappedData = (const uint32_t*) addr;
+    fMappedBytes = st.st_size;
+  }
+
+  // The mapping stays valid after the descriptor is closed
+  close(fd);
+
+  fMappedSize = fMappedBytes / sizeof(uint32_t);
+  fMappedPos = 0;
+
+  if (fFormat == kFormatUnknown) {
+    fFormat = DetectFormat(fMappedData, std::min(fMappedSize, (size_t) (FORMATDETECTBYTES / sizeof(uint32_t))));
+  }
+
   return true;
 }
 
 
 
+void PLTBinaryFileReader::CloseMappedFile ()
+{
+  if (fMappedData) {
+    munmap((void*) fMappedData, fMappedBytes);
+  }
+  fMappedData = 0;
+  fMappedBytes = 0;
+  fMappedSize = 0;
+  fMappedPos = 0;
+  return;
+}
+
+
+
 void PLTBinaryFileReader::SetInputType(InputType inputType)
 {
   fInputType = inputType;
@@ -80,6 +265,78 @@ void PLTBinaryFileReader::SetInputType(InputType inputType)
 
 
 
+SlinkFormat PLTBinaryFileReader::DetectFormat (const uint32_t* Words, size_t const NWords, size_t const MaxEvents)
+{
+  // Walk the first MaxEvents events the way the legacy decoder does and look for
+  // the old FEDStreamReader quirks; a single one means the file needs the legacy
+  // decoder. Without a complete event to look at we can't tell, so stay on the
+  // safe side.
+  size_t NEvents = 0;
+  size_t pos = 0;
+  while (NEvents < MaxEvents && pos + 2 <= NWords) {
+    uint32_t n2 = Words[pos++];
+    uint32_t n1 = Words[pos++];
+
+    if ((n1 == 0x53333333) && (n2 == 0x53333333)) {
+      //tdc buffer, skip it up to and including its trailer
+      while (pos < NWords && (Words[pos] & 0xf0000000) != 0xa0000000) {
+        ++pos;
+      }
+      pos += 2;
+      continue;
+    }
+    if ((n2 & 0xff000000) == 0x50000000 && (n1 & 0xff) == 0) {
+      // header words swapped
+      return kFormatLegacy;
+    }
+    if ((n1 & 0xff000000) != 0x50000000 || (n2 & 0xff) != 0) {
+      continue;
+    }
+
+    bool Trailer = false;
+    while (pos + 2 <= NWords) {
+      uint32_t const oldn1 = n1;
+      uint32_t const oldn2 = n2;
+      n2 = Words[pos++];
+      n1 = Words[pos++];
+      if ((n1 & 0xf0000000) == 0xa0000000) {
+        Trailer = true;
+        break;
+      }
+      if ((n2 & 0xf0000000) == 0xa0000000) {
+        // trailer words swapped
+        return kFormatLegacy;
+      }
+      if (pos < NWords && (Words[pos] & 0xff000000) == 0xa0000000) {
+        // odd number of words in the event
+        return kFormatLegacy;
+      }
+      if (n1 == oldn1 && n2 == oldn2 && ((n1 | n2) & 0xfffffff)) {
+        // duplicated pair
+        return kFormatLegacy;
+      }
+    }
+    if (!Trailer) {
+      break;
+    }
+    ++NEvents;
+  }
+
+  return NEvents != 0 ? kFormatModern : kFormatLegacy;
+}
+
+
+
+PLTHit* PLTBinaryFileReader::NewHit (int const Channel, int const ROC, int const Column, int const Row, int const ADC)
+{
+  if (fArena) {
+    return fArena->NewHit(Channel, ROC, Column, Row, ADC);
+  }
+  return new PLTHit(Channel, ROC, Column, Row, ADC);
+}
+
+
+
 int PLTBinaryFileReader::convPXL (int IN)
 {
   if (IN == 160 || IN == 161) return 0;
@@ -175,18 +432,13 @@ bool PLTBinaryFileReader::DecodeSpyDataFifo (uint32_t word, std::vector<PLTHit*>
       //kga changed fiducial region
       if (roc <= 2) {
 
-        // Check the pixel mask
-        if ( !IsPixelMasked( chan*100000 + roc*10000 + mycol*100 + abs(convPXL((word & pxlmsk) >> 8)) ) ) {
+        int const myrow = abs(convPXL((word & pxlmsk) >> 8));
 
-          //printf("IN OUT: %10i %10i\n", (word & pxlmsk) >> 8, convPXL((word & pxlmsk) >> 8));
-          PLTHit* Hit = new PLTHit((int) chan, (int) roc, (int) mycol, (int) abs(convPXL((word & pxlmsk) >> 8)), (int) (word & plsmsk));
+        // Check the filter and the pixel mask, and only keep hits on the diamond
+        if ( fFilter.PassHit(chan, roc) && !IsPixelMasked(chan, roc, mycol, myrow) && PLTPlane::IsFiducial(fPlaneFiducialRegion, mycol, myrow) ) {
 
-          // only keep hits on the diamond
-          if (PLTPlane::IsFiducial(fPlaneFiducialRegion, Hit)) {
-            Hits.push_back(Hit);
-          } else {
-            delete Hit;
-          }
+          //printf("IN OUT: %10i %10i\n", (word & pxlmsk) >> 8, convPXL((word & pxlmsk) >> 8));
+          Hits.push_back( NewHit((int) chan, (int) roc, (int) mycol, myrow, (int) (word & plsmsk)) );
         }
       } else {
         //std::cerr << "WARNING: PLTBinaryFileReader found ROC with number and chan: " << roc << "  " << chan << std::endl;
@@ -201,7 +453,168 @@ bool PLTBinaryFileReader::DecodeSpyDataFifo (uint32_t word, std::vector<PLTHit*>
 }
 
 
+// Batch version of DecodeSpyDataFifo for a whole span of words from one event.
+// First the words are classified (four at a time with SSE2 where available) into
+// hits, special words and words to ignore; the hit words are packed together and
+// the special words are passed on one by one to DecodeSpyDataFifo, which is the
+// only place that knows how to turn them into PLTErrors. Then the packed hit words
+// are decoded into the arrays in Hits in a single pass, and finally the pixel mask
+// and fiducial region are applied. The hits and errors come out in exactly the
+// same order as calling DecodeSpyDataFifo on each word. Returns the number of hits.
+
+int PLTBinaryFileReader::DecodeSpyDataFifoBatch (const uint32_t* words, size_t const nWords, PLTHitArrays& Hits, std::vector<PLTError>& Errors, std::vector<int>& DesyncChannels)
+{
+  Hits.Clear();
+  if (fBatchHitWords.size() < nWords + 4) {
+    fBatchHitWords.resize(nWords + 4);
+  }
+  uint32_t* hitWords = &fBatchHitWords[0];
+  size_t nHitWords = 0;
+
+  size_t i = 0;
+#if defined(__SSE2__)
+  // A word is a hit candidate if it is not empty, the roc field is 1-3 and the
+  // channel is 1-36; it is special if it is not empty and the roc field is > 25.
+  // The fields are at most 6 bits wide so signed compares are fine.
+  const __m128i zero      = _mm_setzero_si128();
+  const __m128i low28     = _mm_set1_epi32(0xfffffff);
+  const __m128i fivebits  = _mm_set1_epi32(0x1f);
+  const __m128i rocMin    = _mm_set1_epi32(0);
+  const __m128i rocMax    = _mm_set1_epi32(4);
+  const __m128i rocSpec   = _mm_set1_epi32(25);
+  const __m128i chanMin   = _mm_set1_epi32(0);
+  const __m128i chanMax   = _mm_set1_epi32(37);
+  for ( ; i + 4 <= nWords; i += 4) {
+    __m128i w    = _mm_loadu_si128((const __m128i*) (words + i));
+    __m128i nz   = _mm_andnot_si128(_mm_cmpeq_epi32(_mm_and_si128(w, low28), zero), _mm_set1_epi32(-1));
+    __m128i roc  = _mm_and_si128(_mm_srli_epi32(w, 21), fivebits);
+    __m128i chan = _mm_srli_epi32(w, 26);
+    __m128i isHit = _mm_and_si128(nz, _mm_and_si128(
+          _mm_and_si128(_mm_cmpgt_epi32(roc, rocMin), _mm_cmplt_epi32(roc, rocMax)),
+          _mm_and_si128(_mm_cmpgt_epi32(chan, chanMin), _mm_cmplt_epi32(chan, chanMax))));
+    __m128i isSpecial = _mm_and_si128(nz, _mm_cmpgt_epi32(roc, rocSpec));
+    int const hitBits     = _mm_movemask_ps(_mm_castsi128_ps(isHit));
+    int const specialBits = _mm_movemask_ps(_mm_castsi128_ps(isSpecial));
+
+    // Branch-free packing of the hit words
+    hitWords[nHitWords] = words[i];     nHitWords += hitBits & 1;
+    hitWords[nHitWords] = words[i + 1]; nHitWords += (hitBits >> 1) & 1;
+    hitWords[nHitWords] = words[i + 2]; nHitWords += (hitBits >> 2) & 1;
+    hitWords[nHitWords] = words[i + 3]; nHitWords += (hitBits >> 3) & 1;
+
+    if (specialBits) {
+      for (int j = 0; j != 4; ++j) {
+        if (specialBits & (1 << j)) {
+          DecodeSpyDataFifo(words[i + j], fBatchNoHits, Errors, DesyncChannels);
+        }
+      }
+    }
+  }
+#endif
+  for ( ; i < nWords; ++i) {
+    uint32_t const w = words[i];
+    if (!(w & 0xfffffff)) continue;
+    uint32_t const roc  = (w >> 21) & 0x1f;
+    uint32_t const chan = w >> 26;
+    if (roc > 25) {
+      DecodeSpyDataFifo(w, fBatchNoHits, Errors, DesyncChannels);
+    } else if (roc >= 1 && roc <= 3 && chan > 0 && chan < 37) {
+      hitWords[nHitWords++] = w;
+    }
+  }
+
+  // Decode all hit words in one go. The loop has no branches other than the
+  // convPXL special case so the compiler can vectorize it.
+  Hits.Resize(nHitWords);
+  int* const hChannel = nHitWords ? &Hits.fChannel[0] : 0;
+  int* const hROC     = nHitWords ? &Hits.fROC[0] : 0;
+  int* const hColumn  = nHitWords ? &Hits.fColumn[0] : 0;
+  int* const hRow     = nHitWords ? &Hits.fRow[0] : 0;
+  int* const hADC     = nHitWords ? &Hits.fADC[0] : 0;
+  for (size_t ih = 0; ih < nHitWords; ++ih) {
+    uint32_t const w = hitWords[ih];
+    int const pxl = (w >> 8) & 0xff;
+    int const row = (pxl == 160 || pxl == 161) ? 0 : ((pxl & 1) ? 80 - (pxl - 1) / 2 : pxl / 2 - 80);
+    hChannel[ih] = w >> 26;
+    hROC[ih]     = ((w >> 21) & 0x1f) - 1; // The fed gives 123, and we use the convention 012
+    hColumn[ih]  = ((w >> 16) & 0x1f) * 2 + (pxl & 1);
+    hRow[ih]     = row < 0 ? -row : row;
+    hADC[ih]     = w & 0xff;
+  }
+
+  // Drop filtered, masked and non-fiducial hits, packing the arrays in place
+  bool const filterHits = fFilter.SelectsHits();
+  size_t nKept = 0;
+  for (size_t ih = 0; ih < nHitWords; ++ih) {
+    if (filterHits && !fFilter.PassHit(hChannel[ih], hROC[ih])) continue;
+    if (IsPixelMasked(hChannel[ih], hROC[ih], hColumn[ih], hRow[ih])) continue;
+    if (!PLTPlane::IsFiducial(fPlaneFiducialRegion, hColumn[ih], hRow[ih])) continue;
+    hChannel[nKept] = hChannel[ih];
+    hROC[nKept]     = hROC[ih];
+    hColumn[nKept]  = hColumn[ih];
+    hRow[nKept]     = hRow[ih];
+    hADC[nKept]     = hADC[ih];
+    ++nKept;
+  }
+  Hits.Resize(nKept);
+
+  return nKept;
+}
+
+
+void PLTBinaryFileReader::FlushBatch (const uint32_t* words, size_t const nWords, std::vector<PLTHit*>& Hits, std::vector<PLTError>& Errors, std::vector<int>& DesyncChannels)
+{
+  // Decode a run of data words with the batch decoder and hand the result
+  // back as PLTHits
+  if (nWords == 0) return;
+
+  DecodeSpyDataFifoBatch(words, nWords, fBatchHits, Errors, DesyncChannels);
+  for (size_t ih = 0; ih != fBatchHits.NHits(); ++ih) {
+    Hits.push_back(NewHit(fBatchHits.fChannel[ih], fBatchHits.fROC[ih], fBatchHits.fColumn[ih], fBatchHits.fRow[ih], fBatchHits.fADC[ih]));
+  }
+  return;
+}
+
+
 int PLTBinaryFileReader::ReadEventHits(uint32_t* buf, uint32_t bufSize, std::vector<PLTHit*>& Hits, std::vector<PLTError>& Errors, unsigned long& Event, uint32_t& Time, uint32_t& BX, std::vector<int>& DesyncChannels)
+{
+  // The decoders already skip the words of events that fail the header part of
+  // the filter; what is left to do here is to drop those events (and the ones
+  // failing on time) and move on to the next one
+  size_t const NHits = Hits.size();
+  size_t const NErrors = Errors.size();
+  size_t const NDesync = DesyncChannels.size();
+  while (true) {
+    int const ret = ReadNextEventHits(buf, bufSize, Hits, Errors, Event, Time, BX, DesyncChannels);
+    if (ret < 0 || !fFilter.SelectsEvents() || fFilter.PassEvent(Event, BX, Time)) {
+      return ret;
+    }
+
+    DiscardHits(Hits, NHits);
+    Errors.erase(Errors.begin() + NErrors, Errors.end());
+    DesyncChannels.resize(NDesync);
+    if (fInputType == kBuffer) {
+      // The buffer held just this one event
+      return FILTEREDEVENT;
+    }
+  }
+}
+
+
+void PLTBinaryFileReader::DiscardHits (std::vector<PLTHit*>& Hits, size_t const N)
+{
+  // Drop the hits after the first N; arena hits just go back with the arena
+  if (!fArena) {
+    for (size_t ih = N; ih < Hits.size(); ++ih) {
+      delete Hits[ih];
+    }
+  }
+  Hits.resize(N);
+  return;
+}
+
+
+int PLTBinaryFileReader::ReadNextEventHits(uint32_t* buf, uint32_t bufSize, std::vector<PLTHit*>& Hits, std::vector<PLTError>& Errors, unsigned long& Event, uint32_t& Time, uint32_t& BX, std::vector<int>& DesyncChannels)
 {
   if (fInputType == kBinaryFile) {
     return ReadEventHitsBinary(Hits, Errors, Event, Time, BX, DesyncChannels);
@@ -210,6 +623,10 @@ int PLTBinaryFileReader::ReadEventHits(uint32_t* buf, uint32_t bufSize, std::vec
     return ReadEventHitsText(Hits, Event, Time, BX);
   } else if (fInputType == kBuffer) {
     return ReadEventHitsBuffer(buf, bufSize, Hits, Errors, Event, Time, BX, DesyncChannels);
+  } else if (fInputType == kMappedFile) {
+    return ReadEventHitsMapped(Hits, Errors, Event, Time, BX, DesyncChannels);
+  } else if (fInputType == kGzipFile) {
+    return ReadEventHitsGzip(Hits, Errors, Event, Time, BX, DesyncChannels);
   } else {
     // uh...this should have already been caught in Open()
     return -1;
@@ -219,12 +636,21 @@ int PLTBinaryFileReader::ReadEventHits(uint32_t* buf, uint32_t bufSize, std::vec
 
 int PLTBinaryFileReader::ReadEventHitsBinary(std::vector<PLTHit*>& Hits, std::vector<PLTError>& Errors, unsigned long& Event, uint32_t& Time, uint32_t& BX, std::vector<int>& DesyncChannels)
 {
+  if (fFormat == kFormatModern) {
+    return ReadEventHitsBinaryModern(Hits, Errors, Event, Time, BX, DesyncChannels);
+  }
+
   uint32_t n1, n2, oldn1, oldn2;
 
   int wordcount = 0;
   bool bheader = true;
   while (bheader) {
 
+    // Don't start a new event past the stop offset
+    if (fStopOffset != NOSTOPOFFSET && (uint64_t) fInfile.tellg() >= fStopOffset) {
+      return -1;
+    }
+
     // Read 64-bit word
     fInfile.read((char *) &n2, sizeof n2);
     fInfile.read((char *) &n1, sizeof n1);
@@ -264,6 +690,9 @@ int PLTBinaryFileReader::ReadEventHitsBinary(std::vector<PLTHit*>& Hits, std::ve
         fFEDID = ((n1 & 0xfff00) >> 8);
       }
 
+      // Events failing the filter are read through without decoding
+      bool const decode = fFilter.PassHeader(Event, BX);
+
       while (bheader) {
         // The older slink files contain a bug which can sometimes cause
         // a pair of hits to be duplicated. To fix this, keep track of
@@ -316,13 +745,13 @@ int PLTBinaryFileReader::ReadEventHitsBinary(std::vector<PLTHit*>& Hits, std::ve
             Time = Time + 86400000 * fTimeMult;
 
             // but don't forget to decode the first word
-            if (n2 != oldn2) DecodeSpyDataFifo(n2, Hits, Errors, DesyncChannels);
+            if (decode && n2 != oldn2) DecodeSpyDataFifo(n2, Hits, Errors, DesyncChannels);
           }
           else {
             // OK, it wasn't a trailer. Undo the peek and decode both words
             fInfile.seekg(-sizeof peekWord, std::ios_base::cur);
-            if (n2 != oldn2) DecodeSpyDataFifo(n2, Hits, Errors, DesyncChannels);
-            if (n1 != oldn1) DecodeSpyDataFifo(n1, Hits, Errors, DesyncChannels);
+            if (decode && n2 != oldn2) DecodeSpyDataFifo(n2, Hits, Errors, DesyncChannels);
+            if (decode && n1 != oldn1) DecodeSpyDataFifo(n1, Hits, Errors, DesyncChannels);
 	  }
 	} // not a trailer
       } // after header
@@ -333,80 +762,466 @@ int PLTBinaryFileReader::ReadEventHitsBinary(std::vector<PLTHit*>& Hits, std::ve
 }
 
 
-int PLTBinaryFileReader::ReadEventHitsText (std::vector<PLTHit*>& Hits, unsigned long& Event, uint32_t& Time, uint32_t& BX)
-{
-  int LastEventNumber = -1;
-  int EventNumber = -1;
+// Same as ReadEventHitsBinary, including the workarounds for the old FEDStreamReader bugs,
+// but reading straight out of the mapped file. A "peek" is just a look at the next word
+// without advancing fMappedPos, so there is nothing to undo.
 
-  if (fInfile.eof()) {
-    return -1;
+int PLTBinaryFileReader::ReadEventHitsMapped(std::vector<PLTHit*>& Hits, std::vector<PLTError>& Errors, unsigned long& Event, uint32_t& Time, uint32_t& BX, std::vector<int>& DesyncChannels)
+{
+  if (fFormat == kFormatModern) {
+    return ReadEventHitsMappedModern(Hits, Errors, Event, Time, BX, DesyncChannels);
   }
 
-  int Channel, ROC, Row, Col, ADC;
-  std::string Line;
-  std::istringstream LineStr;
-  while (true) {
-    std::getline(fInfile, Line);
-    LineStr.clear();
-    LineStr.str(Line);
+  uint32_t n1, n2, oldn1, oldn2;
 
-    LineStr >> Channel;
-    if (LineStr.eof()) {
-      break;
+  const uint32_t* const data = fMappedData;
+  size_t const size = fMappedSize;
+  size_t const stop = fStopOffset == NOSTOPOFFSET ? size : std::min((size_t) (fStopOffset / sizeof(uint32_t)), size);
+  size_t pos = fMappedPos;
+  bool decode = fDecodeHits;
+
+  bool bheader = true;
+  while (bheader) {
+
+    // Don't start a new event past the stop offset
+    if (pos >= stop) {
+      fMappedPos = pos;
+      return -1;
     }
-    LineStr >> ROC >> Col >> Row >> ADC >> EventNumber;
 
+    // Read 64-bit word
+    if (pos + 2 > size) {
+      fMappedPos = size;
+      return -1;
+    }
+    n2 = data[pos++];
+    n1 = data[pos++];
 
-    if (EventNumber != LastEventNumber && LastEventNumber != -1) {
-      fInfile.putback('\n');
-      for (std::string::reverse_iterator It = Line.rbegin(); It != Line.rend(); ++It) {
-        fInfile.putback(*It);
+    if ((n1 == 0x53333333) && (n2 == 0x53333333)) {
+      //tdc buffer, special handling
+
+      for (int ih = 0; ih < 100; ih++) {
+
+        if (pos >= size) {
+          fMappedPos = size;
+          return -1;
+        }
+        n1 = data[pos++];
+
+        if ((n1 & 0xf0000000) == 0xa0000000) {
+          if (pos < size) {
+            n2 = data[pos++];
+          }
+          break;
+        }
       }
-      break;
-    }
 
-    if ( !IsPixelMasked( Channel*100000 + ROC*10000 + Col*100 + Row ) ) {
-      PLTHit* Hit = new PLTHit(Channel, ROC, Col, Row, ADC);
-      // only keep hits on the diamond
-      if (PLTPlane::IsFiducial(fPlaneFiducialRegion, Hit)) {
-        Hits.push_back(Hit);
+    } else if ( ((n1 & 0xff000000) == 0x50000000 && (n2 & 0xff) == 0 ) || ((n2 & 0xff000000) == 0x50000000 && (n1 & 0xff) == 0) ){
+      // Found the header and it has correct FEDID
+      fEventOffset = (pos - 2) * sizeof(uint32_t);
+      Event = (n1 & 0xff000000) == 0x50000000 ? n1 & 0xffffff : n2 & 0xffffff;
+
+      if ((n1 & 0xff000000) == 0x50000000) {
+        BX = ((n2 & 0xfff00000) >> 20);
+        fFEDID = ((n2 & 0xfff00) >> 8);
       } else {
-        delete Hit;
+        BX = ((n1 & 0xfff00000) >> 20);
+        fFEDID = ((n1 & 0xfff00) >> 8);
       }
-      //printf("%2i %2i %2i %2i %5i %9i\n", Channel, ROC, Col, Row, ADC, EventNumber);
-    }
+      decode = fDecodeHits && fFilter.PassHeader(Event, BX);
 
-    LastEventNumber = EventNumber;
-    Event = EventNumber;
+      while (bheader) {
+        // Keep track of the previous words to drop duplicated hit pairs (see ReadEventHitsBinary)
+        oldn1=n1;
+        oldn2=n2;
+        if (pos + 2 > size) {
+          fMappedPos = size;
+          return -1;
+        }
+        n2 = data[pos++];
+        n1 = data[pos++];
+
+        if ((n1 & 0xf0000000) == 0xa0000000 || (n2 & 0xf0000000) == 0xa0000000) {
+          bheader = false;
+          if ((n1 & 0xf0000000) == 0xa0000000) {
+            Time = n2;
+          } else {
+            Time = n1;
+          }
+          if (Time < fLastTime) {
+            ++fTimeMult;
+          }
+
+          fLastTime = Time;
+          Time = Time + 86400000 * fTimeMult;
+        } else {
+          // Odd number of words between header and trailer: check whether the next
+          // word is the other half of the trailer
+          if (pos >= size) {
+            // shouldn't happen unless the event is truncated in some way
+            fMappedPos = size;
+            return -1;
+          }
+
+          if ((data[pos] & 0xff000000) == 0xa0000000) {
+            ++pos;
+            bheader = false;
+            Time = n1;
+            if (Time < fLastTime) {
+              ++fTimeMult;
+            }
+            fLastTime = Time;
+            Time = Time + 86400000 * fTimeMult;
 
+            // but don't forget to decode the first word
+            if (decode && n2 != oldn2) DecodeSpyDataFifo(n2, Hits, Errors, DesyncChannels);
+          }
+          else if (decode) {
+            if (n2 != oldn2) DecodeSpyDataFifo(n2, Hits, Errors, DesyncChannels);
+            if (n1 != oldn1) DecodeSpyDataFifo(n1, Hits, Errors, DesyncChannels);
+          }
+        } // not a trailer
+      } // after header
+    }
   }
-  
+
+  fMappedPos = pos;
 
   return Hits.size();
 }
 
-// This is basically the same as ReadEventHitsBinary but without the code to fix the breakage from
-// old versions of FEDStreamReader, since this shouldn't have to deal with that. It might be possible
-// to merge these two together but since the hard work is done in DecodeSpyDataFifo() anyway, that's
-// really what I'm (successfully) trying to avoid to duplicate.
 
-int PLTBinaryFileReader::ReadEventHitsBuffer(uint32_t* buf, uint32_t bufSize, std::vector<PLTHit*>& Hits, std::vector<PLTError>& Errors, unsigned long& Event, uint32_t& Time, uint32_t& BX, std::vector<int>& DesyncChannels)
+// Modern files (see DetectFormat) always have the header and trailer words in the
+// same order and an even number of words per event, so each 64-bit word is read
+// exactly once: no peek for an odd-word trailer and no duplicate check. The data
+// words of the event are collected and decoded in one go.
+
+int PLTBinaryFileReader::ReadEventHitsBinaryModern(std::vector<PLTHit*>& Hits, std::vector<PLTError>& Errors, unsigned long& Event, uint32_t& Time, uint32_t& BX, std::vector<int>& DesyncChannels)
 {
-  if (bufSize % 2 != 0) {
-    std::cerr << "Event buffer is not of even size (" << bufSize << " words)" << std::endl;
+  uint32_t w[2]; // n2, n1
+
+  // Find the next header
+  while (true) {
+    if (fStopOffset != NOSTOPOFFSET && (uint64_t) fInfile.tellg() >= fStopOffset) {
+      return -1;
+    }
+    if (!fInfile.read((char *) w, sizeof w)) {
+      return -1;
+    }
+
+    if ((w[1] == 0x53333333) && (w[0] == 0x53333333)) {
+      //tdc buffer, skip it up to and including its trailer
+      uint32_t n;
+      do {
+        if (!fInfile.read((char *) &n, sizeof n)) {
+          return -1;
+        }
+      } while ((n & 0xf0000000) != 0xa0000000);
+      fInfile.read((char *) &n, sizeof n);
+    } else if ((w[1] & 0xff000000) == 0x50000000 && (w[0] & 0xff) == 0) {
+      break;
+    }
   }
 
-  bool inEvent = false;
-  for (uint32_t i=0; i<bufSize; i+=2) {
-    if ((buf[i] == 0x53333333) && (buf[i+1] == 0x53333333)) {
-      //tdc buffer, special handling
+  Event = w[1] & 0xffffff;
+  BX = ((w[0] & 0xfff00000) >> 20);
+  fFEDID = ((w[0] & 0xfff00) >> 8);
+
+  // The words of an event failing the filter are not even kept
+  bool const keep = fFilter.PassHeader(Event, BX);
+
+  fEventWords.clear();
+  while (true) {
+    if (!fInfile.read((char *) w, sizeof w)) {
+      return -1;
+    }
+    if ((w[1] & 0xf0000000) == 0xa0000000) {
+      break;
+    }
+    if (keep) {
+      fEventWords.push_back(w[0]);
+      fEventWords.push_back(w[1]);
+    }
+  }
+  Time = UnrollTime(w[0]);
+
+  if (!fEventWords.empty() && fFilter.PassTime(Time)) {
+    FlushBatch(&fEventWords[0], fEventWords.size(), Hits, Errors, DesyncChannels);
+  }
+
+  return Hits.size();
+}
+
+
+int PLTBinaryFileReader::ReadEventHitsMappedModern(std::vector<PLTHit*>& Hits, std::vector<PLTError>& Errors, unsigned long& Event, uint32_t& Time, uint32_t& BX, std::vector<int>& DesyncChannels)
+{
+  // As ReadEventHitsBinaryModern; the data words are decoded straight out of the mapping
+  const uint32_t* const data = fMappedData;
+  size_t const size = fMappedSize;
+  size_t const stop = fStopOffset == NOSTOPOFFSET ? size : std::min((size_t) (fStopOffset / sizeof(uint32_t)), size);
+  size_t pos = fMappedPos;
+
+  // Find the next header
+  while (true) {
+    if (pos >= stop) {
+      fMappedPos = std::min(pos, size);
+      return -1;
+    }
+    if (pos + 2 > size) {
+      fMappedPos = size;
+      return -1;
+    }
+    uint32_t const n2 = data[pos];
+    uint32_t const n1 = data[pos + 1];
+    pos += 2;
+
+    if ((n1 == 0x53333333) && (n2 == 0x53333333)) {
+      //tdc buffer, skip it up to and including its trailer
+      while (pos < size && (data[pos] & 0xf0000000) != 0xa0000000) {
+        ++pos;
+      }
+      pos += 2;
+    } else if ((n1 & 0xff000000) == 0x50000000 && (n2 & 0xff) == 0) {
+      break;
+    }
+  }
+
+  size_t const header = pos - 2;
+  fEventOffset = header * sizeof(uint32_t);
+  Event = data[header + 1] & 0xffffff;
+  BX = ((data[header] & 0xfff00000) >> 20);
+  fFEDID = ((data[header] & 0xfff00) >> 8);
+
+  // The data words run up to the trailer
+  size_t const begin = pos;
+  while (pos + 2 <= size && (data[pos + 1] & 0xf0000000) != 0xa0000000) {
+    pos += 2;
+  }
+  if (pos + 2 > size) {
+    // truncated event
+    fMappedPos = size;
+    return -1;
+  }
+  Time = UnrollTime(data[pos]);
+
+  if (fDecodeHits && fFilter.PassEvent(Event, BX, Time)) {
+    FlushBatch(data + begin, pos - begin, Hits, Errors, DesyncChannels);
+  }
+
+  fMappedPos = pos + 2;
+
+  return Hits.size();
+}
+
+
+int PLTBinaryFileReader::ReadEventHitsGzip(std::vector<PLTHit*>& Hits, std::vector<PLTError>& Errors, unsigned long& Event, uint32_t& Time, uint32_t& BX, std::vector<int>& DesyncChannels)
+{
+  // Same as ReadEventHitsBinary, but the words come from the inflate thread.
+  // The peek for the odd-word trailer is a real peek, so nothing has to be undone.
+  uint32_t n1, n2, oldn1, oldn2;
+
+  bool bheader = true;
+  while (bheader) {
+
+    // Don't start a new event past the stop offset
+    if (fStopOffset != NOSTOPOFFSET && fGzip.Offset() >= fStopOffset) {
+      return -1;
+    }
+
+    // Read 64-bit word
+    uint64_t const Offset = fGzip.Offset();
+    if (!fGzip.NextWord(n2) || !fGzip.NextWord(n1)) {
+      return -1;
+    }
+
+    if ((n1 == 0x53333333) && (n2 == 0x53333333)) {
+      //tdc buffer, special handling
+
+      for (int ih = 0; ih < 100; ih++) {
+
+        if (!fGzip.NextWord(n1)) {
+          return -1;
+        }
+
+        if ((n1 & 0xf0000000) == 0xa0000000) {
+          fGzip.NextWord(n2);
+          break;
+        }
+      }
+
+    } else if ( ((n1 & 0xff000000) == 0x50000000 && (n2 & 0xff) == 0 ) || ((n2 & 0xff000000) == 0x50000000 && (n1 & 0xff) == 0) ){
+      // Found the header and it has correct FEDID
+      fEventOffset = Offset;
+      Event = (n1 & 0xff000000) == 0x50000000 ? n1 & 0xffffff : n2 & 0xffffff;
+
+      if ((n1 & 0xff000000) == 0x50000000) {
+        BX = ((n2 & 0xfff00000) >> 20);
+        fFEDID = ((n2 & 0xfff00) >> 8);
+      } else {
+        BX = ((n1 & 0xfff00000) >> 20);
+        fFEDID = ((n1 & 0xfff00) >> 8);
+      }
+
+      // Events failing the filter are read through without decoding
+      bool const decode = fDecodeHits && fFilter.PassHeader(Event, BX);
+
+      while (bheader) {
+        // Keep track of the previous words to drop duplicated hit pairs (see ReadEventHitsBinary)
+        oldn1=n1;
+        oldn2=n2;
+        if (!fGzip.NextWord(n2) || !fGzip.NextWord(n1)) {
+          return -1;
+        }
+
+        if ((n1 & 0xf0000000) == 0xa0000000 || (n2 & 0xf0000000) == 0xa0000000) {
+          bheader = false;
+          if ((n1 & 0xf0000000) == 0xa0000000) {
+            Time = n2;
+          } else {
+            Time = n1;
+          }
+          if (Time < fLastTime) {
+            ++fTimeMult;
+          }
+
+          fLastTime = Time;
+          Time = Time + 86400000 * fTimeMult;
+        } else {
+          // Odd number of words between header and trailer: check whether the next
+          // word is the other half of the trailer
+          uint32_t peekWord;
+          if (!fGzip.PeekWord(peekWord)) {
+            // shouldn't happen unless the event is truncated in some way
+            return -1;
+          }
+
+          if ((peekWord & 0xff000000) == 0xa0000000) {
+            fGzip.NextWord(peekWord);
+            bheader = false;
+            Time = n1;
+            if (Time < fLastTime) {
+              ++fTimeMult;
+            }
+            fLastTime = Time;
+            Time = Time + 86400000 * fTimeMult;
+
+            // but don't forget to decode the first word
+            if (decode && n2 != oldn2) DecodeSpyDataFifo(n2, Hits, Errors, DesyncChannels);
+          }
+          else {
+            if (decode && n2 != oldn2) DecodeSpyDataFifo(n2, Hits, Errors, DesyncChannels);
+            if (decode && n1 != oldn1) DecodeSpyDataFifo(n1, Hits, Errors, DesyncChannels);
+          }
+        } // not a trailer
+      } // after header
+    }
+  }
+
+  return Hits.size();
+}
+
+
+
+int PLTBinaryFileReader::ReadEventHitsText (std::vector<PLTHit*>& Hits, unsigned long& Event, uint32_t& Time, uint32_t& BX)
+{
+  // Lines are "ch roc col row adc event" and all lines of an event are together.
+  // We stop at the first line of the next event and leave fTextPos pointing at
+  // it, so it is the first line parsed next time.
+  int LastEventNumber = -1;
+  bool GotLine = false;
+
+  int Values[6];
+  while (true) {
+    char* const Begin = &fTextBuffer[0] + fTextPos;
+    char* const End = &fTextBuffer[0] + fTextEnd;
+    char* EndOfLine = (char*) memchr(Begin, '\n', End - Begin);
+    if (EndOfLine == 0) {
+      // Partial (or no) line left in the buffer: get more unless there is no more
+      if (!fTextEOF) {
+        FillTextBuffer();
+        continue;
+      }
+      if (Begin == End) {
+        break;
+      }
+      EndOfLine = End;
+    }
+
+    int const NValues = ParseTextLine(Begin, EndOfLine, Values, 6);
+    if (NValues == 0) {
+      // Blank line ends the event
+      fTextPos = std::min((size_t) (EndOfLine - &fTextBuffer[0]) + 1, fTextEnd);
+      if (GotLine) {
+        break;
+      }
+      continue;
+    }
+    if (NValues != 6) {
+      std::cerr << "WARNING: PLTBinaryFileReader::ReadEventHitsText skipping malformed line: " << std::string(Begin, EndOfLine) << std::endl;
+      fTextPos = std::min((size_t) (EndOfLine - &fTextBuffer[0]) + 1, fTextEnd);
+      continue;
+    }
+
+    int const EventNumber = Values[5];
+    if (EventNumber != LastEventNumber && LastEventNumber != -1) {
+      break;
+    }
+    fTextPos = std::min((size_t) (EndOfLine - &fTextBuffer[0]) + 1, fTextEnd);
+    GotLine = true;
+
+    int const Channel = Values[0];
+    int const ROC = Values[1];
+    int const Col = Values[2];
+    int const Row = Values[3];
+    int const ADC = Values[4];
+
+    // only keep selected, unmasked hits on the diamond
+    if ( fFilter.PassHit(Channel, ROC) && !IsPixelMasked(Channel, ROC, Col, Row) && PLTPlane::IsFiducial(fPlaneFiducialRegion, Col, Row) ) {
+      Hits.push_back( NewHit(Channel, ROC, Col, Row, ADC) );
+    }
+
+    LastEventNumber = EventNumber;
+    Event = EventNumber;
+  }
+
+  if (!GotLine) {
+    return -1;
+  }
+
+  return Hits.size();
+}
+
+// This is basically the same as ReadEventHitsBinary but without the code to fix the breakage from
+// old versions of FEDStreamReader, since this shouldn't have to deal with that. It might be possible
+// to merge these two together but since the hard work is done in DecodeSpyDataFifo() anyway, that's
+// really what I'm (successfully) trying to avoid to duplicate.
+
+int PLTBinaryFileReader::ReadEventHitsBuffer(uint32_t* buf, uint32_t bufSize, std::vector<PLTHit*>& Hits, std::vector<PLTError>& Errors, unsigned long& Event, uint32_t& Time, uint32_t& BX, std::vector<int>& DesyncChannels)
+{
+  if (bufSize % 2 != 0) {
+    std::cerr << "Event buffer is not of even size (" << bufSize << " words)" << std::endl;
+  }
+
+  // Runs of consecutive data words are collected and decoded together with
+  // DecodeSpyDataFifoBatch when the run ends
+  uint32_t dataBegin = 0, dataEnd = 0;
+
+  bool inEvent = false;
+  for (uint32_t i=0; i<bufSize; i+=2) {
+    if ((buf[i] == 0x53333333) && (buf[i+1] == 0x53333333)) {
+      FlushBatch(buf + dataBegin, dataEnd - dataBegin, Hits, Errors, DesyncChannels);
+      dataBegin = dataEnd = 0;
+      //tdc buffer, special handling
       i+=2;
       while ((buf[i] & 0xf0000000) != 0xa0000000 && i<bufSize) {
 	i++;
       }
       if (i>=bufSize) return -1;
-      i++;
+      // i is at the first word of the tdc trailer pair; the loop increment skips the pair,
+      // as in ReadEventHitsBinary
     } else if (inEvent == false && (buf[i] & 0xff) == 0 && (buf[i+1] & 0xff000000) == 0x50000000) {
+      FlushBatch(buf + dataBegin, dataEnd - dataBegin, Hits, Errors, DesyncChannels);
+      dataBegin = dataEnd = 0;
       // header
       if (i!=0)
 	std::cerr << "Found header at unexpected location in buffer (" << i << "/" << bufSize << ")" << std::endl;
@@ -416,6 +1231,8 @@ int PLTBinaryFileReader::ReadEventHitsBuffer(uint32_t* buf, uint32_t bufSize, st
       BX = ((buf[i] & 0xfff00000) >> 20);
       fFEDID = ((buf[i] & 0xfff00) >> 8);
     } else if ((buf[i+1] & 0xf0000000) == 0xa0000000) {
+      FlushBatch(buf + dataBegin, dataEnd - dataBegin, Hits, Errors, DesyncChannels);
+      dataBegin = dataEnd = 0;
       if (i!=bufSize-2)
 	std::cerr << "Found trailer at unexpected location in buffer (" << i << "/" << bufSize << ")" << std::endl;
       if (inEvent == false)
@@ -425,19 +1242,304 @@ int PLTBinaryFileReader::ReadEventHitsBuffer(uint32_t* buf, uint32_t bufSize, st
     } else {
       if (inEvent == false)
 	std::cerr << "Found hit data before header" << std::endl;
-      // neither header nor trailer; decode appropriately
-      DecodeSpyDataFifo(buf[i], Hits, Errors, DesyncChannels);
-      DecodeSpyDataFifo(buf[i+1], Hits, Errors, DesyncChannels);
+      // neither header nor trailer; add both words to the current run of data words
+      if (dataEnd != i) {
+        FlushBatch(buf + dataBegin, dataEnd - dataBegin, Hits, Errors, DesyncChannels);
+        dataBegin = i;
+      }
+      dataEnd = std::min(i + 2, bufSize);
     }
     if (i == 0 && inEvent == false) {
       std::cerr << "Start of buffer wasn't the header (got " << std::hex << buf[i] << " " << buf[i+1]
 		<< " instead)" << std::dec << std::endl;
     }
   } // loop over buffer
+  FlushBatch(buf + dataBegin, dataEnd - dataBegin, Hits, Errors, DesyncChannels);
 
   return Hits.size();
 }
 
+static void OpenBatchEvent (PLTEventBatch& Batch, uint32_t const Flags)
+{
+  PLTEventBatch::Entry e;
+  e.Event = 0;
+  e.Time = 0;
+  e.BX = 0;
+  e.FEDID = -1;
+  e.HitBegin = e.HitEnd = Batch.fHits.NHits();
+  e.ErrorBegin = e.ErrorEnd = Batch.fErrors.size();
+  e.DesyncBegin = e.DesyncEnd = Batch.fDesyncChannels.size();
+  e.Flags = Flags;
+  Batch.fEvents.push_back(e);
+  return;
+}
+
+
+static void CloseBatchEvent (PLTEventBatch& Batch, PLTEventFilter const& Filter)
+{
+  PLTEventBatch::Entry& e = Batch.fEvents.back();
+  if (Filter.SelectsEvents() && !Filter.PassEvent(e.Event, e.BX, e.Time)) {
+    // Not selected: take the event back out of the batch
+    Batch.fHits.Resize(e.HitBegin);
+    Batch.fErrors.erase(Batch.fErrors.begin() + e.ErrorBegin, Batch.fErrors.end());
+    Batch.fDesyncChannels.resize(e.DesyncBegin);
+    Batch.fEvents.pop_back();
+    return;
+  }
+  e.HitEnd = Batch.fHits.NHits();
+  e.ErrorEnd = Batch.fErrors.size();
+  e.DesyncEnd = Batch.fDesyncChannels.size();
+  return;
+}
+
+
+void PLTBinaryFileReader::FlushEventBatch (const uint32_t* words, size_t const nWords, PLTEventBatch& Batch)
+{
+  // Decode a run of data words and append the hits to the batch
+  if (nWords == 0) return;
+
+  size_t const nHits = DecodeSpyDataFifoBatch(words, nWords, fBatchHits, Batch.fErrors, Batch.fDesyncChannels);
+  PLTHitArrays& Hits = Batch.fHits;
+  Hits.fChannel.insert(Hits.fChannel.end(), fBatchHits.fChannel.begin(), fBatchHits.fChannel.begin() + nHits);
+  Hits.fROC.insert(Hits.fROC.end(), fBatchHits.fROC.begin(), fBatchHits.fROC.begin() + nHits);
+  Hits.fColumn.insert(Hits.fColumn.end(), fBatchHits.fColumn.begin(), fBatchHits.fColumn.begin() + nHits);
+  Hits.fRow.insert(Hits.fRow.end(), fBatchHits.fRow.begin(), fBatchHits.fRow.begin() + nHits);
+  Hits.fADC.insert(Hits.fADC.end(), fBatchHits.fADC.begin(), fBatchHits.fADC.begin() + nHits);
+  return;
+}
+
+
+int PLTBinaryFileReader::ReadEventBatch (const uint32_t* buf, size_t const bufSize, PLTEventBatch& Batch)
+{
+  // Like ReadEventHitsBuffer, but the buffer can hold any number of events back
+  // to back: a header opens a new event and a trailer closes it. Instead of
+  // printing layout problems they are flagged on the event and counted in the
+  // batch. Returns the number of events in the batch.
+  Batch.Clear();
+  ++Batch.fNBuffers;
+
+  uint32_t BufferFlags = 0;
+  if (bufSize % 2 != 0) {
+    ++Batch.fNOddSize;
+    BufferFlags |= PLTEventBatch::kOddSize;
+  }
+
+  // Runs of consecutive data words are decoded together when the run ends
+  size_t dataBegin = 0, dataEnd = 0;
+
+  // The buffer flags go on the last event opened in the buffer, if it is still
+  // there after the filter
+  size_t lastOpened = (size_t) -1;
+
+  bool inEvent = false;
+  bool decode = true; // false for an event that already failed the filter at the header
+  for (size_t i = 0; i + 1 < bufSize; i += 2) {
+    if ((buf[i] == 0x53333333) && (buf[i+1] == 0x53333333)) {
+      FlushEventBatch(buf + dataBegin, dataEnd - dataBegin, Batch);
+      dataBegin = dataEnd = 0;
+      //tdc buffer, skip up to and including its trailer
+      i += 2;
+      while (i < bufSize && (buf[i] & 0xf0000000) != 0xa0000000) {
+        ++i;
+      }
+      if (i >= bufSize) {
+        ++Batch.fNTruncatedTDC;
+        BufferFlags |= PLTEventBatch::kTruncatedTDC;
+        break;
+      }
+      // the loop increment skips the tdc trailer pair
+    } else if (inEvent == false && (buf[i] & 0xff) == 0 && (buf[i+1] & 0xff000000) == 0x50000000) {
+      // header
+      FlushEventBatch(buf + dataBegin, dataEnd - dataBegin, Batch);
+      dataBegin = dataEnd = 0;
+      OpenBatchEvent(Batch, 0);
+      lastOpened = Batch.fEvents.size() - 1;
+      inEvent = true;
+      PLTEventBatch::Entry& e = Batch.fEvents.back();
+      e.Event = buf[i+1] & 0xffffff;
+      e.BX = ((buf[i] & 0xfff00000) >> 20);
+      e.FEDID = ((buf[i] & 0xfff00) >> 8);
+      fFEDID = e.FEDID;
+      decode = fFilter.PassHeader(e.Event, e.BX);
+    } else if ((buf[i+1] & 0xf0000000) == 0xa0000000) {
+      // trailer
+      FlushEventBatch(buf + dataBegin, dataEnd - dataBegin, Batch);
+      dataBegin = dataEnd = 0;
+      if (inEvent == false) {
+        ++Batch.fNNoHeader;
+        OpenBatchEvent(Batch, PLTEventBatch::kNoHeader);
+        lastOpened = Batch.fEvents.size() - 1;
+      }
+      Batch.fEvents.back().Time = buf[i];
+      CloseBatchEvent(Batch, fFilter);
+      inEvent = false;
+    } else {
+      // neither header nor trailer; add both words to the current run of data words
+      if (inEvent == false) {
+        ++Batch.fNNoHeader;
+        OpenBatchEvent(Batch, PLTEventBatch::kNoHeader);
+        lastOpened = Batch.fEvents.size() - 1;
+        inEvent = true;
+        decode = true;
+      }
+      if (!decode) {
+        continue;
+      }
+      if (dataEnd != i) {
+        FlushEventBatch(buf + dataBegin, dataEnd - dataBegin, Batch);
+        dataBegin = i;
+      }
+      dataEnd = i + 2;
+    }
+  } // loop over buffer
+  FlushEventBatch(buf + dataBegin, dataEnd - dataBegin, Batch);
+
+  if (inEvent) {
+    ++Batch.fNNoTrailer;
+    Batch.fEvents.back().Flags |= PLTEventBatch::kNoTrailer;
+    CloseBatchEvent(Batch, fFilter);
+  }
+  if (BufferFlags != 0 && lastOpened < Batch.fEvents.size()) {
+    Batch.fEvents[lastOpened].Flags |= BufferFlags;
+  }
+
+  Batch.fNEvents += Batch.fEvents.size();
+  Batch.fNHits += Batch.fHits.NHits();
+
+  return Batch.fEvents.size();
+}
+
+
+
+bool PLTBinaryFileReader::BuildEventIndex ()
+{
+  // Scan the whole file once through a separate mapped (or, for compressed
+  // files, gzip) reader, without decoding any hits, and record where each event
+  // header is. For gzip the offsets are in the uncompressed stream.
+  fEventIndex.Clear();
+  if (fInputType != kBinaryFile && fInputType != kMappedFile && fInputType != kGzipFile) {
+    std::cerr << "ERROR: PLTBinaryFileReader::BuildEventIndex only works for binary files" << std::endl;
+    return false;
+  }
+
+  PLTBinaryFileReader Scanner;
+  Scanner.SetInputType(fInputType == kGzipFile ? kGzipFile : kMappedFile);
+  if (!Scanner.Open(fFileName)) {
+    return false;
+  }
+  Scanner.fDecodeHits = false;
+
+  std::vector<PLTHit*> Hits;
+  std::vector<PLTError> Errors;
+  std::vector<int> DesyncChannels;
+  unsigned long Event;
+  uint32_t Time, BX;
+  while ((fInputType == kGzipFile ? Scanner.ReadEventHitsGzip(Hits, Errors, Event, Time, BX, DesyncChannels) : Scanner.ReadEventHitsMapped(Hits, Errors, Event, Time, BX, DesyncChannels)) >= 0) {
+    fEventIndex.AddEntry(Scanner.EventOffset(), Event, Time, BX);
+  }
+
+  std::cout << "PLTBinaryFileReader::BuildEventIndex found " << fEventIndex.NEvents() << " events in " << fFileName << std::endl;
+
+  return true;
+}
+
+
+
+bool PLTBinaryFileReader::LoadEventIndex (bool const WriteSidecar)
+{
+  struct stat st;
+  if (stat(fFileName.c_str(), &st) != 0) {
+    std::cerr << "ERROR: cannot stat input file: " << fFileName << std::endl;
+    return false;
+  }
+
+  std::string const SidecarName = PLTEventIndex::SidecarName(fFileName);
+  if (fEventIndex.Read(SidecarName, st.st_size)) {
+    return true;
+  }
+
+  if (!BuildEventIndex()) {
+    return false;
+  }
+
+  if (WriteSidecar) {
+    // Not being able to write the sidecar (e.g. read-only archive) is not fatal
+    fEventIndex.Write(SidecarName, st.st_size);
+  }
+
+  return true;
+}
+
+
+
+bool PLTBinaryFileReader::SeekEvent (size_t const i)
+{
+  if (i >= fEventIndex.NEvents()) {
+    std::cerr << "ERROR: PLTBinaryFileReader::SeekEvent event " << i << " is not in the index (" << fEventIndex.NEvents() << " events)" << std::endl;
+    return false;
+  }
+
+  PLTEventIndex::Entry const& Entry = fEventIndex.GetEntry(i);
+  if (fInputType == kBinaryFile) {
+    fInfile.clear();
+    fInfile.seekg(Entry.Offset, std::ios_base::beg);
+    if (!fInfile) {
+      return false;
+    }
+  } else if (fInputType == kMappedFile) {
+    fMappedPos = Entry.Offset / sizeof(uint32_t);
+  } else if (fInputType == kGzipFile) {
+    if (!fGzip.Seek(Entry.Offset)) {
+      return false;
+    }
+  } else {
+    std::cerr << "ERROR: PLTBinaryFileReader::SeekEvent only works for binary files" << std::endl;
+    return false;
+  }
+
+  // Restore the day-rollover bookkeeping: the indexed time is already corrected, so
+  // the raw time and the number of rollovers can be recovered from it
+  fLastTime = Entry.Time % 86400000;
+  fTimeMult = Entry.Time / 86400000;
+  fStopOffset = NOSTOPOFFSET;
+
+  return true;
+}
+
+
+
+bool PLTBinaryFileReader::SeekEventRange (size_t const First, size_t const End)
+{
+  // Read the events with ordinals First, ..., End-1
+  if (!SeekEvent(First)) {
+    return false;
+  }
+
+  if (End < fEventIndex.NEvents()) {
+    fStopOffset = fEventIndex.GetEntry(End).Offset;
+  }
+
+  return true;
+}
+
+
+
+bool PLTBinaryFileReader::SeekEventNumber (unsigned long const Event)
+{
+  return SeekEvent(fEventIndex.FindEvent(Event));
+}
+
+
+
+bool PLTBinaryFileReader::SeekEventTime (uint32_t const BeginTime, uint32_t const EndTime)
+{
+  // Position at the first event at or after BeginTime; events after EndTime
+  // will not be read.
+  return SeekEventRange(fEventIndex.FindTime(BeginTime), fEventIndex.FindTimeAfter(EndTime));
+}
+
+
+
 void PLTBinaryFileReader::ReadPixelMask (std::string const InFileName)
 {
   std::cout << "PLTBinaryFileReader::ReadPixelMask reading file: " << InFileName << std::endl;
@@ -455,13 +1557,15 @@ void PLTBinaryFileReader::ReadPixelMask (std::string const InFileName)
     }
   }
 
-  std::istringstream linestream;
   int ch, roc, col, row;
   for (std::string line; std::getline(InFile, line); ) {
-    linestream.str(line);
-    linestream >> ch >> roc >> col >> row;
+    // A fresh stream for each line: reusing one leaves it in the eof state after the first line
+    std::istringstream linestream(line);
+    if (!(linestream >> ch >> roc >> col >> row)) {
+      continue;
+    }
 
-    fPixelMask.insert( ch*100000 + roc*10000 + col*100 + row );
+    fPixelMask.Mask(ch, roc, col, row);
   }
 
   return;
@@ -532,17 +1636,9 @@ void PLTBinaryFileReader::ReadOnlinePixelMask(const std::string maskFileName, co
       continue;
     }
 
-    for (int col = firstCol; col <= lastCol; ++col) {
-      for (int row = firstRow; row <= lastRow; ++row) {
-        // fPixelMask contains the masked pixels. So if maskVal == 0 (means "turn this pixel off").
-        // put this pixel into fPixelMask, and if it's 1, take this pixel out of fPixelMask.
-        if (maskVal == 0) {
-          fPixelMask.insert(ch*100000 + roc*10000 + col*100 + row);
-        } else {
-          fPixelMask.erase(ch*100000 + roc*10000 + col*100 + row);
-        }	  
-      }
-    } // column & row loops
+    // fPixelMask contains the masked pixels. So if maskVal == 0 (means "turn this pixel off").
+    // mask the whole range, and if it's 1, unmask it.
+    fPixelMask.MaskRange(ch, roc, firstCol, lastCol, firstRow, lastRow, maskVal == 0);
   } // line loop
 
   return;
@@ -550,10 +1646,7 @@ void PLTBinaryFileReader::ReadOnlinePixelMask(const std::string maskFileName, co
 
 bool PLTBinaryFileReader::IsPixelMasked (int const ChannelPixel)
 {
-  if (fPixelMask.count(ChannelPixel)) {
-    return true;
-  }
-  return false;
+  return fPixelMask.IsMasked(ChannelPixel);
 }
 
 
@@ -22,6 +22,14 @@ void PLTCluster::AddHit (PLTHit* Hit)
 }
 
 
+void PLTCluster::Clear ()
+{
+  // Forget the hits, but keep the memory so the cluster can be reused
+  fHits.clear();
+  return;
+}
+
+
 float PLTCluster::Charge ()
 {
   // Compute charge of this cluster
@@ -1,5 +1,6 @@
 #include "bril/pltslinkprocessor/PLTEvent.h"
 #include <iomanip>
+#include <algorithm>
 
 PLTEvent::PLTEvent ()
 {
@@ -44,7 +45,7 @@ PLTEvent::PLTEvent (std::string const DataFileName, std::string const GainCalFil
 PLTEvent::~PLTEvent ()
 {
     // Destructor!!
-    Clear();
+    SetReconstructionThreads(1);
 };
 
 std::string PLTEvent::ReadableTime() {
@@ -73,7 +74,56 @@ void PLTEvent::SetDefaults ()
     SetTrackingAlgorithm(PLTTracking::kTrackingAlgorithm_NoTracking);
 
     fRun = 0;
+    fPool = 0;
+
+    // Everything made for an event is taken from the arena
+    fBinFile.SetArena(&fArena);
+    SetTrackingArena(&fArena);
+    for (int ich = 0; ich != NCHANNELS; ++ich) {
+        fChannelActive[ich] = false;
+        fTelescopeArray[ich].SetArena(&fArena);
+        for (int iroc = 0; iroc != NROCS; ++iroc) {
+            fPlaneArray[ich][iroc].SetArena(&fArena);
+        }
+    }
+
+    return;
+}
+
+void PLTEvent::SetReconstructionThreads (int const NThreads)
+{
+    // The current event may have clusters and tracks in the worker arenas
+    Clear();
+
+    delete fPool;
+    fPool = 0;
+    for (size_t i = 0; i != fWorkerArenas.size(); ++i) {
+        delete fWorkerArenas[i];
+        delete fWorkerTracking[i];
+        delete fWorkerStageTimes[i];
+    }
+    fWorkerArenas.clear();
+    fWorkerTracking.clear();
+    fWorkerStageTimes.clear();
+
+    if (NThreads > 1) {
+        fPool = new PLTWorkerPool(NThreads);
+        for (int i = 0; i != NThreads; ++i) {
+            fWorkerArenas.push_back(new PLTEventArena());
+            fWorkerTracking.push_back(new PLTTracking());
+            fWorkerTracking.back()->SetTrackingArena(fWorkerArenas.back());
+            fWorkerStageTimes.push_back(new PLTStageTimes());
+        }
+    }
+
+    return;
+}
 
+void PLTEvent::TakeStageTimes (PLTStageTimes& Out)
+{
+    fStageTimes.EndEvent();
+    Out.Add(fStageTimes);
+    fStageTimes.Clear();
     return;
 }
 
@@ -118,17 +168,30 @@ PLTTelescope* PLTEvent::Telescope (size_t i)
 
 void PLTEvent::Clear ()
 {
-    // clear up.  All memory is owned by the maps and fHits, so
-    // hopefully it is self managed and you don't have to delete anything.
-    fTelescopeMap.clear();
-    fPlaneMap.clear();
-
-    // Clear vectors
-    // You own the hits and need to delete them!!
-    for (std::vector<PLTHit*>::iterator i = fHits.begin(); i != fHits.end(); ++i) {
+    // The event is over as far as the stage times go
+    fStageTimes.EndEvent();
+
+    // clear up.  Only the planes and telescopes used in this event need clearing,
+    // and hits, clusters and tracks all go back to the arena in one go.
+    for (std::vector<int>::iterator it = fActiveChannels.begin(); it != fActiveChannels.end(); ++it) {
+        fTelescopeArray[*it].Clear();
+        for (int iroc = 0; iroc != NROCS; ++iroc) {
+            fPlaneArray[*it][iroc].Clear();
+        }
+        fChannelActive[*it] = false;
+    }
+    fActiveChannels.clear();
+
+    // Hits given to us with AddHit(PLTHit*) are ours to delete
+    for (std::vector<PLTHit*>::iterator i = fOwnedHits.begin(); i != fOwnedHits.end(); ++i) {
         delete *i;
     }
+    fOwnedHits.clear();
 
+    fArena.Reset();
+    for (std::vector<PLTEventArena*>::iterator it = fWorkerArenas.begin(); it != fWorkerArenas.end(); ++it) {
+        (*it)->Reset();
+    }
 
     fHits.clear();
     fPlanes.clear();
@@ -141,10 +204,9 @@ void PLTEvent::Clear ()
 
 void PLTEvent::AddHit (PLTHit& Hit)
 {
-    // This method DOES do a copy, so if you want speed for very large number of
-    // hits this isn't your best choice.
+    // This method DOES do a copy, but into the event arena so it is cheap
 
-    PLTHit* NewHit = new PLTHit(Hit);
+    PLTHit* NewHit = fArena.NewHit(Hit);
 
     // If we have the GC object let's fill the charge
     if (fGainCal.IsGood()) {
@@ -170,6 +232,7 @@ void PLTEvent::AddHit (PLTHit* Hit)
 
     // add the hit
     fHits.push_back(Hit);
+    fOwnedHits.push_back(Hit);
     return;
 }
 
@@ -181,40 +244,79 @@ void PLTEvent::MakeEvent ()
 
     // Add hits to planes according to their channel-roc
     for (std::vector<PLTHit*>::iterator it = fHits.begin(); it != fHits.end(); ++it) {
-        std::pair<int, int> ChannelRoc = std::make_pair((*it)->Channel(), (*it)->ROC());
-        fPlaneMap[ChannelRoc].AddHit( *it );
+        int const Channel = (*it)->Channel();
+        int const ROC = (*it)->ROC();
+        if (Channel < 0 || Channel >= NCHANNELS || ROC < 0 || ROC >= NROCS) {
+            std::cerr << "WARNING: PLTEvent::MakeEvent skipping hit with channel " << Channel << " roc " << ROC << std::endl;
+            continue;
+        }
+        if (!fChannelActive[Channel]) {
+            fChannelActive[Channel] = true;
+            fActiveChannels.push_back(Channel);
+        }
+        fPlaneArray[Channel][ROC].AddHit( *it );
     }
 
-    for (std::map< std::pair<int, int>, PLTPlane>::iterator it = fPlaneMap.begin(); it != fPlaneMap.end(); ++it) {
-        int const Channel = it->first.first;
-        for (int i = 0; i != 3; ++i) {
-            std::pair<int, int> ChROC = std::make_pair(Channel, i);
-            if (!fPlaneMap.count(ChROC)) {
-                fPlaneMap[ ChROC ].SetChannel(Channel);
-                fPlaneMap[ ChROC ].SetROC(i);
+    // Same (channel ordered) telescope order as before
+    std::sort(fActiveChannels.begin(), fActiveChannels.end());
+
+    // Clusterize and track each telescope with a hit: one after the other, or
+    // spread over the workers, each with its own arena and tracking scratch
+    if (fPool) {
+        for (size_t i = 0; i != fWorkerTracking.size(); ++i) {
+            if (GetTrackingAlgorithm()) {
+                fWorkerTracking[i]->SetTrackingAlignment(GetTrackingAlignment());
             }
+            fWorkerTracking[i]->SetTrackingAlgorithm((PLTTracking::TrackingAlgorithm) GetTrackingAlgorithm());
+        }
+        fPool->Run(fActiveChannels.size(), [this] (size_t i, int Worker) {
+            ReconstructTelescope(fActiveChannels[i], *fWorkerArenas[Worker], *fWorkerTracking[Worker], *fWorkerStageTimes[Worker]);
+        });
+        for (size_t i = 0; i != fWorkerStageTimes.size(); ++i) {
+            fStageTimes.TakePending(*fWorkerStageTimes[i]);
+        }
+    } else {
+        for (std::vector<int>::iterator it = fActiveChannels.begin(); it != fActiveChannels.end(); ++it) {
+            ReconstructTelescope(*it, fArena, *this, fStageTimes);
         }
-    }
-    // Loop over all planes and clusterize each one, then add each plane to the correct telescope (by channel number
-    for (std::map< std::pair<int, int>, PLTPlane>::iterator it = fPlaneMap.begin(); it != fPlaneMap.end(); ++it) {
-        it->second.Clusterize(fClustering, fFiducial);
-        fTelescopeMap[it->second.Channel()].AddPlane( &(it->second) );
     }
 
     // Just to make it easier.. put them in a vector..
-    for (std::map<int, PLTTelescope>::iterator it = fTelescopeMap.begin(); it != fTelescopeMap.end(); ++it) {
-        it->second.FillAndOrderTelescope();
-
-        for (size_t i = 0; i != it->second.NPlanes(); ++i) {
-            fPlanes.push_back( it->second.Plane(i));
+    for (std::vector<int>::iterator it = fActiveChannels.begin(); it != fActiveChannels.end(); ++it) {
+        PLTTelescope& Telescope = fTelescopeArray[*it];
+        for (size_t i = 0; i != Telescope.NPlanes(); ++i) {
+            fPlanes.push_back( Telescope.Plane(i));
         }
-        fTelescopes.push_back( &(it->second) );
+        fTelescopes.push_back( &Telescope );
     }
 
-    if (GetTrackingAlgorithm()) {
-        for (std::vector<PLTTelescope*>::iterator iTelescope = fTelescopes.begin(); iTelescope != fTelescopes.end(); ++iTelescope) {
-            RunTracking(**iTelescope);
+    return;
+}
+
+
+
+void PLTEvent::ReconstructTelescope (int const Channel, PLTEventArena& Arena, PLTTracking& Tracking, PLTStageTimes& StageTimes)
+{
+    // Clusterize every plane of the channel (all three, so that a telescope
+    // always has its planes), add them to the telescope and look for tracks.
+    // Only this channel's planes and telescope are touched.
+    PLTTelescope& Telescope = fTelescopeArray[Channel];
+    {
+        PLT_STAGE_TIMER(StageTimes, kStage_Clusterize);
+        for (int iroc = 0; iroc != NROCS; ++iroc) {
+            PLTPlane& Plane = fPlaneArray[Channel][iroc];
+            Plane.SetChannel(Channel);
+            Plane.SetROC(iroc);
+            Plane.SetArena(&Arena);
+            Plane.Clusterize(fClustering, fFiducial);
+            Telescope.AddPlane( &Plane );
         }
+        Telescope.FillAndOrderTelescope();
+    }
+
+    if (Tracking.GetTrackingAlgorithm()) {
+        PLT_STAGE_TIMER(StageTimes, kStage_Tracking);
+        Tracking.RunTracking(Telescope);
     }
 
     return;
@@ -268,27 +370,26 @@ int PLTEvent::GetNextEvent(uint32_t* buf, uint32_t bufSize)
     // First clear the event
     Clear();
 
-    // The number we'll return.. number of hits, or -1 for end
-    int ret = fBinFile.ReadEventHits(buf, bufSize, fHits, fErrors, fEvent, fTime, fBX, fDesyncChannels);
+    // The number we'll return.. number of hits, -1 for end, or
+    // PLTBinaryFileReader::FILTEREDEVENT for a buffer whose event failed the filter
+    int ret;
+    {
+        PLT_STAGE_TIMER(fStageTimes, kStage_Decode);
+        ret = fBinFile.ReadEventHits(buf, bufSize, fHits, fErrors, fEvent, fTime, fBX, fDesyncChannels);
+    }
+    if (ret == PLTBinaryFileReader::FILTEREDEVENT) {
+        // Nothing to build, and nothing of the rejected event is kept
+        fEvent = 0;
+        fTime = 0;
+        fBX = 0;
+        return ret;
+    }
     if (ret < 0) {
         return ret;
     }
 
-    static bool const DoLoop = fGainCal.IsGood() || fAlignment.IsGood();
-    static bool const DoAlignment = fAlignment.IsGood();
-    static bool const DoGainCal = fGainCal.IsGood();
-
-    // If the GC is good let's compute the charge
-    if (DoLoop) {
-        for (std::vector<PLTHit*>::iterator it = fHits.begin(); it != fHits.end(); ++it) {
-            if (DoGainCal) {
-                fGainCal.SetCharge(**it);
-            }
-            if (DoAlignment) {
-                fAlignment.AlignHit(**it);
-            }
-        }
-    }
+    // If the GC is good let's compute the charge, and then align
+    CalibrateHits();
 
     // Now make the event into some useful form
     MakeEvent();
@@ -297,3 +398,81 @@ int PLTEvent::GetNextEvent(uint32_t* buf, uint32_t bufSize)
 }
 
 
+
+int PLTEvent::GetNextEventBatch (const uint32_t* buf, uint32_t bufSize)
+{
+    // Decode all the events in the buffer in one go. They are then looked at one
+    // at a time with SelectBatchEvent(). Returns the number of events.
+    Clear();
+    PLT_STAGE_TIMER(fStageTimes, kStage_Decode);
+    return fBinFile.ReadEventBatch(buf, bufSize, fBatch);
+}
+
+
+
+int PLTEvent::SelectBatchEvent (size_t const i)
+{
+    // Make event i of the current batch the current event, as GetNextEvent would
+    Clear();
+    if (i >= fBatch.NEvents()) {
+        return -1;
+    }
+
+    PLTEventBatch::Entry const& e = fBatch.Event(i);
+    fEvent = e.Event;
+    fTime  = e.Time;
+    fBX    = e.BX;
+    fErrors.assign(fBatch.fErrors.begin() + e.ErrorBegin, fBatch.fErrors.begin() + e.ErrorEnd);
+    fDesyncChannels.assign(fBatch.fDesyncChannels.begin() + e.DesyncBegin, fBatch.fDesyncChannels.begin() + e.DesyncEnd);
+
+    PLTHitArrays const& Hits = fBatch.fHits;
+    for (size_t ih = e.HitBegin; ih != e.HitEnd; ++ih) {
+        fHits.push_back(fArena.NewHit(Hits.fChannel[ih], Hits.fROC[ih], Hits.fColumn[ih], Hits.fRow[ih], Hits.fADC[ih]));
+    }
+    CalibrateHits(&Hits, e.HitBegin);
+
+    MakeEvent();
+
+    return fHits.size();
+}
+
+
+
+void PLTEvent::CalibrateHits (PLTHitArrays const* Arrays, size_t const Begin)
+{
+    // Charge from the gaincal and position from the alignment, for all the
+    // hits of the event: one pass each, so that they can be timed apart. The
+    // charges are computed all at once from the hits as arrays.
+    size_t const NHits = fHits.size();
+    if (fGainCal.IsGood() && NHits) {
+        PLT_STAGE_TIMER(fStageTimes, kStage_GainCal);
+        size_t First = Begin;
+        if (!Arrays) {
+            fCalibrationHits.Resize(NHits);
+            for (size_t ih = 0; ih != NHits; ++ih) {
+                PLTHit& Hit = *fHits[ih];
+                fCalibrationHits.fChannel[ih] = Hit.Channel();
+                fCalibrationHits.fROC[ih]     = Hit.ROC();
+                fCalibrationHits.fColumn[ih]  = Hit.Column();
+                fCalibrationHits.fRow[ih]     = Hit.Row();
+                fCalibrationHits.fADC[ih]     = Hit.ADC();
+            }
+            Arrays = &fCalibrationHits;
+            First = 0;
+        }
+        fCharges.resize(NHits);
+        fGainCal.GetCharges(NHits, &Arrays->fChannel[First], &Arrays->fROC[First], &Arrays->fColumn[First], &Arrays->fRow[First],
+                            &Arrays->fADC[First], &fCharges[0]);
+        for (size_t ih = 0; ih != NHits; ++ih) {
+            fHits[ih]->SetCharge(fCharges[ih]);
+        }
+    }
+    if (fAlignment.IsGood()) {
+        PLT_STAGE_TIMER(fStageTimes, kStage_Align);
+        for (std::vector<PLTHit*>::iterator it = fHits.begin(); it != fHits.end(); ++it) {
+            fAlignment.AlignHit(**it);
+        }
+    }
+
+    return;
+}
@@ -0,0 +1,187 @@
+#include "bril/pltslinkprocessor/PLTEventIndex.h"
+
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+
+static char const PLTEventIndexMagic[8] = {'P', 'L', 'T', 'I', 'D', 'X', '0', '1'};
+static size_t const PLTEventIndexEntrySize = 8 + 4 + 4 + 2;
+
+
+PLTEventIndex::PLTEventIndex ()
+{
+  fDataFileSize = 0;
+}
+
+
+PLTEventIndex::~PLTEventIndex ()
+{
+}
+
+
+void PLTEventIndex::Clear ()
+{
+  fEntries.clear();
+  fEventRuns.clear();
+  fDataFileSize = 0;
+  return;
+}
+
+
+void PLTEventIndex::AddEntry (uint64_t const Offset, uint32_t const Event, uint32_t const Time, uint16_t const BX)
+{
+  Entry e;
+  e.Offset = Offset;
+  e.Event = Event;
+  e.Time = Time;
+  e.BX = BX;
+  if (fEntries.empty() || Event < fEntries.back().Event) {
+    fEventRuns.push_back(fEntries.size());
+  }
+  fEntries.push_back(e);
+  return;
+}
+
+
+static bool CompareEntryEvent (PLTEventIndex::Entry const& e, unsigned long const Event)
+{
+  return e.Event < Event;
+}
+
+
+size_t PLTEventIndex::FindEvent (unsigned long const Event) const
+{
+  // Event numbers are only 24 bits in the header and can restart within a file,
+  // so search each run of increasing numbers in turn and take the first match
+  for (size_t i = 0; i != fEventRuns.size(); ++i) {
+    std::vector<Entry>::const_iterator const End = i + 1 != fEventRuns.size() ? fEntries.begin() + fEventRuns[i + 1] : fEntries.end();
+    std::vector<Entry>::const_iterator const it = std::lower_bound(fEntries.begin() + fEventRuns[i], End, Event, CompareEntryEvent);
+    if (it != End && it->Event == Event) {
+      return it - fEntries.begin();
+    }
+  }
+  return fEntries.size();
+}
+
+
+static bool CompareEntryTime (PLTEventIndex::Entry const& e, uint32_t const Time)
+{
+  return e.Time < Time;
+}
+
+
+size_t PLTEventIndex::FindTime (uint32_t const Time) const
+{
+  // Times are corrected for the day rollover by the reader so they are non-decreasing
+  // through the file; find the first event at or after Time.
+  return std::lower_bound(fEntries.begin(), fEntries.end(), Time, CompareEntryTime) - fEntries.begin();
+}
+
+
+static bool CompareTimeEntry (uint32_t const Time, PLTEventIndex::Entry const& e)
+{
+  return Time < e.Time;
+}
+
+
+size_t PLTEventIndex::FindTimeAfter (uint32_t const Time) const
+{
+  // The first event after Time
+  return std::upper_bound(fEntries.begin(), fEntries.end(), Time, CompareTimeEntry) - fEntries.begin();
+}
+
+
+bool PLTEventIndex::Write (std::string const FileName, uint64_t const DataFileSize)
+{
+  std::ofstream f(FileName.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!f) {
+    std::cerr << "ERROR: cannot open event index file for writing: " << FileName << std::endl;
+    return false;
+  }
+
+  fDataFileSize = DataFileSize;
+  uint64_t const N = fEntries.size();
+  f.write(PLTEventIndexMagic, sizeof PLTEventIndexMagic);
+  f.write((char const*) &fDataFileSize, sizeof fDataFileSize);
+  f.write((char const*) &N, sizeof N);
+
+  // Pack the entries into one block so we do a single write
+  std::vector<char> Buffer(N * PLTEventIndexEntrySize);
+  char* p = Buffer.empty() ? 0 : &Buffer[0];
+  for (std::vector<Entry>::const_iterator it = fEntries.begin(); it != fEntries.end(); ++it) {
+    memcpy(p, &it->Offset, 8);
+    memcpy(p + 8, &it->Event, 4);
+    memcpy(p + 12, &it->Time, 4);
+    memcpy(p + 16, &it->BX, 2);
+    p += PLTEventIndexEntrySize;
+  }
+  if (!Buffer.empty()) {
+    f.write(&Buffer[0], Buffer.size());
+  }
+
+  if (!f) {
+    std::cerr << "ERROR: failed writing event index file: " << FileName << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+
+bool PLTEventIndex::Read (std::string const FileName, uint64_t const DataFileSize)
+{
+  // Returns false if the file does not exist, is not an index, or was made for a
+  // data file of a different size (i.e. the index is stale and should be rebuilt)
+  Clear();
+
+  std::ifstream f(FileName.c_str(), std::ios::in | std::ios::binary);
+  if (!f) {
+    return false;
+  }
+
+  char Magic[sizeof PLTEventIndexMagic];
+  uint64_t FileSize = 0, N = 0;
+  f.read(Magic, sizeof Magic);
+  f.read((char*) &FileSize, sizeof FileSize);
+  f.read((char*) &N, sizeof N);
+  if (!f || memcmp(Magic, PLTEventIndexMagic, sizeof Magic) != 0) {
+    std::cerr << "WARNING: not a valid event index file: " << FileName << std::endl;
+    return false;
+  }
+  if (FileSize != DataFileSize) {
+    std::cerr << "WARNING: event index " << FileName << " does not match the data file size; ignoring it" << std::endl;
+    return false;
+  }
+
+  std::vector<char> Buffer(N * PLTEventIndexEntrySize);
+  if (!Buffer.empty()) {
+    f.read(&Buffer[0], Buffer.size());
+  }
+  if (!f) {
+    std::cerr << "WARNING: truncated event index file: " << FileName << std::endl;
+    return false;
+  }
+
+  fEntries.resize(N);
+  char const* p = Buffer.empty() ? 0 : &Buffer[0];
+  for (std::vector<Entry>::iterator it = fEntries.begin(); it != fEntries.end(); ++it) {
+    memcpy(&it->Offset, p, 8);
+    memcpy(&it->Event, p + 8, 4);
+    memcpy(&it->Time, p + 12, 4);
+    memcpy(&it->BX, p + 16, 2);
+    p += PLTEventIndexEntrySize;
+    if (it == fEntries.begin() || it->Event < (it - 1)->Event) {
+      fEventRuns.push_back(it - fEntries.begin());
+    }
+  }
+  fDataFileSize = FileSize;
+
+  return true;
+}
+
+
+std::string PLTEventIndex::SidecarName (std::string const DataFileName)
+{
+  return DataFileName + ".idx";
+}
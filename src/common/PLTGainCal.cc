@@ -1,5 +1,17 @@
 #include "bril/pltslinkprocessor/PLTGainCal.h"
 
+#include <cstring>
+#include <cmath>
+#include <sys/mman.h>
+
+#if defined(__x86_64__)
+// The AVX-512 intrinsics of GCC 12.1/12.2 make -Wmaybe-uninitialized warnings of their own
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#include <immintrin.h>
+#pragma GCC diagnostic pop
+#endif
+
 
 
 PLTGainCal::PLTGainCal ()
@@ -9,6 +21,8 @@ PLTGainCal::PLTGainCal ()
 
   // Need to create the GC data storage on the heap
   GC = new GCOnTheHeap[MAXCHNS];
+  fChargeTable = 0;
+  ClearChargeTable();
 }
 
 PLTGainCal::PLTGainCal (std::string const GainCalFileName, int const NParams)
@@ -18,6 +32,8 @@ PLTGainCal::PLTGainCal (std::string const GainCalFileName, int const NParams)
 
   // Need to create the GC data storage on the heap
   GC = new GCOnTheHeap[MAXCHNS];
+  fChargeTable = 0;
+  ClearChargeTable();
   
 
   if (NParams == 5) {
@@ -37,6 +53,7 @@ PLTGainCal::~PLTGainCal ()
 {
   // Do NOT forget to delete the memory you acquired from the heap
   delete [] GC;
+  ClearChargeTable();
 }
 
 
@@ -79,9 +96,30 @@ float PLTGainCal::GetCoef(int const i, int const ch, int const roc, int const co
 }
 
 
+long PLTGainCal::ChargeTableIndex (int const ch, int const roc, int const col, int const row, int const adc) const
+{
+  // Where the charge is in the charge table, or -1 if it is not there
+  unsigned const ich  = ChIndex(ch);
+  unsigned const iroc = RocIndex(roc);
+  unsigned const icol = ColIndex(col);
+  unsigned const irow = RowIndex(row);
+  if (ich >= (unsigned) MAXCHNS || fChargeTableSlot[ich] < 0 || iroc >= (unsigned) NROCS || icol >= (unsigned) NCOLS
+      || irow >= (unsigned) NROWS || (unsigned) adc >= (unsigned) NADCS) {
+    return -1;
+  }
+
+  return ((((long) fChargeTableSlot[ich] * NROCS + iroc) * NCOLS + icol) * NROWS + irow) * NADCS + adc;
+}
+
+
 void PLTGainCal::SetCharge (PLTHit& Hit)
 {
-  Hit.SetCharge( GetCharge(Hit.Channel(), Hit.ROC(), Hit.Column(), Hit.Row(), Hit.ADC()) );
+  long const Index = ChargeTableIndex(Hit.Channel(), Hit.ROC(), Hit.Column(), Hit.Row(), Hit.ADC());
+  if (Index >= 0) {
+    Hit.SetCharge( fChargeTableIsHalf ? HalfToFloat(((uint16_t const*) fChargeTable)[Index]) : ((float const*) fChargeTable)[Index] );
+  } else {
+    Hit.SetCharge( GetCharge(Hit.Channel(), Hit.ROC(), Hit.Column(), Hit.Row(), Hit.ADC()) );
+  }
   return;
 }
 
@@ -133,6 +171,263 @@ float PLTGainCal::GetCharge(int const ch, int const roc, int const col, int cons
   return charge;
 }
 
+void PLTGainCal::GetCharges (size_t const NHits, int const* ch, int const* roc, int const* col, int const* row, int const* adc, float* Charge)
+{
+  // Channels in the charge table first; only the hits that are not in it are computed
+  if (fChargeTable) {
+    fMissIndex.clear();
+    for (size_t i = 0; i != NHits; ++i) {
+      long const Index = ChargeTableIndex(ch[i], roc[i], col[i], row[i], adc[i]);
+      if (Index >= 0) {
+        Charge[i] = fChargeTableIsHalf ? HalfToFloat(((uint16_t const*) fChargeTable)[Index]) : ((float const*) fChargeTable)[Index];
+      } else {
+        fMissIndex.push_back(i);
+      }
+    }
+
+    size_t const NMiss = fMissIndex.size();
+    if (NMiss == 0) {
+      return;
+    }
+    if (NMiss != NHits) {
+      // The misses as arrays of their own, so that they still fill whole vectors
+      fMissHits.resize(5 * NMiss);
+      fMissCharge.resize(NMiss);
+      int* const Miss = &fMissHits[0];
+      for (size_t k = 0; k != NMiss; ++k) {
+        size_t const i = fMissIndex[k];
+        Miss[k]             = ch[i];
+        Miss[NMiss + k]     = roc[i];
+        Miss[2 * NMiss + k] = col[i];
+        Miss[3 * NMiss + k] = row[i];
+        Miss[4 * NMiss + k] = adc[i];
+      }
+      ComputeCharges(NMiss, Miss, Miss + NMiss, Miss + 2 * NMiss, Miss + 3 * NMiss, Miss + 4 * NMiss, &fMissCharge[0]);
+      for (size_t k = 0; k != NMiss; ++k) {
+        Charge[fMissIndex[k]] = fMissCharge[k];
+      }
+      return;
+    }
+  }
+
+  ComputeCharges(NHits, ch, roc, col, row, adc, Charge);
+  return;
+}
+
+
+void PLTGainCal::ComputeCharges (size_t const NHits, int const* ch, int const* roc, int const* col, int const* row, int const* adc, float* Charge)
+{
+  // What kind of fit is decided once for the whole batch
+  size_t i = 0;
+  if (!fIsExternalFunction && fNParams == 5) {
+#if defined(__x86_64__)
+    i = GetCharges5(NHits, ch, roc, col, row, adc, Charge);
+#endif
+
+    // The rest, and everything where there are no vectors, one by one exactly as GetCharge
+    float const* const Coefs = &GC[0][0][0][0][0];
+    for ( ; i < NHits; ++i) {
+      unsigned const ich  = ChIndex(ch[i]);
+      unsigned const iroc = RocIndex(roc[i]);
+      unsigned const icol = ColIndex(col[i]);
+      unsigned const irow = RowIndex(row[i]);
+      if (ich >= (unsigned) MAXCHNS || iroc >= (unsigned) NROCS || icol >= (unsigned) NCOLS || irow >= (unsigned) NROWS) {
+        Charge[i] = GetCharge(ch[i], roc[i], col[i], row[i], adc[i]);
+        continue;
+      }
+      float const* const p = Coefs + (((ich * NROCS + iroc) * NCOLS + icol) * NROWS + irow) * 6;
+      float const a = adc[i];
+      Charge[i] = 65. * ((double) a * a * p[0] + a * p[1] + p[2] + (p[4] != 0 ? std::exp((double) ((a - p[3]) / p[4])) : 0));
+    }
+  } else {
+    for ( ; i < NHits; ++i) {
+      Charge[i] = GetCharge(ch[i], roc[i], col[i], row[i], adc[i]);
+    }
+  }
+
+  return;
+}
+
+
+#if defined(__x86_64__)
+int PLTGainCal::GetCharges5 (size_t const NHits, int const* ch, int const* roc, int const* col, int const* row, int const* adc, float* Charge)
+{
+  // 5 parameter charges of as many hits as fill whole vectors, with the widest
+  // vectors the CPU has (decided once), or none. Returns how many hits were done.
+  static int const Width = __builtin_cpu_supports("avx512f") ? 16
+                         : __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") ? 8 : 1;
+
+  float const* const Coefs = &GC[0][0][0][0][0];
+  size_t n = 0;
+  fOutOfRange.clear();
+  if (Width == 16) {
+    n = GetCharges5AVX512(NHits, ch, roc, col, row, adc, Coefs, Charge, fOutOfRange);
+  } else if (Width == 8) {
+    n = GetCharges5AVX2(NHits, ch, roc, col, row, adc, Coefs, Charge, fOutOfRange);
+  }
+
+  // Lanes with a pixel out of range read pixel 0; GetCharge says what is wrong with them
+  for (size_t k = 0; k != fOutOfRange.size(); ++k) {
+    size_t const j = fOutOfRange[k];
+    Charge[j] = GetCharge(ch[j], roc[j], col[j], row[j], adc[j]);
+  }
+
+  return (int) n;
+}
+
+
+// The vectors: the index of each pixel's coefficients, a gather for each
+// coefficient, and exp as in Cephes (range reduction by ln 2 and a polynomial),
+// all in float. Lanes with a pixel out of range read pixel 0 and are added to
+// OutOfRange. They return how many hits were done.
+__attribute__((target("avx512f")))
+size_t PLTGainCal::GetCharges5AVX512 (size_t const NHits, int const* ch, int const* roc, int const* col, int const* row, int const* adc, float const* Coefs, float* Charge, std::vector<size_t>& OutOfRange)
+{
+  size_t i = 0;
+  __m512i const One     = _mm512_set1_epi32(1);
+  __m512i const NChns   = _mm512_set1_epi32(MAXCHNS);
+  __m512i const NRocs   = _mm512_set1_epi32(NROCS);
+  __m512i const NCols   = _mm512_set1_epi32(NCOLS);
+  __m512i const NRows   = _mm512_set1_epi32(NROWS);
+  __m512i const FirstCol = _mm512_set1_epi32(PLTU::FIRSTCOL);
+  __m512i const FirstRow = _mm512_set1_epi32(PLTU::FIRSTROW);
+  __m512i const Six     = _mm512_set1_epi32(6);
+  for ( ; i + 16 <= NHits; i += 16) {
+    __m512i const ich  = _mm512_sub_epi32(_mm512_loadu_si512(ch + i), One);
+    __m512i const iroc = _mm512_loadu_si512(roc + i);
+    __m512i const icol = _mm512_sub_epi32(_mm512_loadu_si512(col + i), FirstCol);
+    __m512i const irow = _mm512_sub_epi32(_mm512_loadu_si512(row + i), FirstRow);
+    __mmask16 const Good = _mm512_cmplt_epu32_mask(ich, NChns) & _mm512_cmplt_epu32_mask(iroc, NRocs)
+                         & _mm512_cmplt_epu32_mask(icol, NCols) & _mm512_cmplt_epu32_mask(irow, NRows);
+    __m512i Pixel = _mm512_mullo_epi32(ich, NRocs);
+    Pixel = _mm512_mullo_epi32(_mm512_add_epi32(Pixel, iroc), NCols);
+    Pixel = _mm512_mullo_epi32(_mm512_add_epi32(Pixel, icol), NRows);
+    Pixel = _mm512_maskz_mov_epi32(Good, _mm512_mullo_epi32(_mm512_add_epi32(Pixel, irow), Six));
+
+    __m512 const p0 = _mm512_i32gather_ps(Pixel, Coefs, 4);
+    __m512 const p1 = _mm512_i32gather_ps(_mm512_add_epi32(Pixel, One), Coefs, 4);
+    __m512 const p2 = _mm512_i32gather_ps(_mm512_add_epi32(Pixel, _mm512_set1_epi32(2)), Coefs, 4);
+    __m512 const p3 = _mm512_i32gather_ps(_mm512_add_epi32(Pixel, _mm512_set1_epi32(3)), Coefs, 4);
+    __m512 const p4 = _mm512_i32gather_ps(_mm512_add_epi32(Pixel, _mm512_set1_epi32(4)), Coefs, 4);
+    __m512 const a  = _mm512_cvtepi32_ps(_mm512_loadu_si512(adc + i));
+
+    // exp((a - p3) / p4), 0 where p4 is 0 and infinity where it overflows
+    __mmask16 const HasExp = _mm512_cmp_ps_mask(p4, _mm512_setzero_ps(), _CMP_NEQ_OQ);
+    __m512 x = _mm512_maskz_div_ps(HasExp, _mm512_sub_ps(a, p3), p4);
+    __mmask16 const Overflow = _mm512_cmp_ps_mask(x, _mm512_set1_ps(88.72283905206835f), _CMP_GT_OQ);
+    x = _mm512_max_ps(_mm512_min_ps(x, _mm512_set1_ps(88.3762626647949f)), _mm512_set1_ps(-88.3762626647949f));
+    __m512 const n = _mm512_roundscale_ps(_mm512_fmadd_ps(x, _mm512_set1_ps(1.44269504088896341f), _mm512_set1_ps(0.5f)), _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+    x = _mm512_fnmadd_ps(n, _mm512_set1_ps(0.693359375f), x);
+    x = _mm512_fnmadd_ps(n, _mm512_set1_ps(-2.12194440e-4f), x);
+    __m512 y = _mm512_set1_ps(1.9875691500E-4f);
+    y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(1.3981999507E-3f));
+    y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(8.3334519073E-3f));
+    y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(4.1665795894E-2f));
+    y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(1.6666665459E-1f));
+    y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(5.0000001201E-1f));
+    y = _mm512_add_ps(_mm512_fmadd_ps(y, _mm512_mul_ps(x, x), x), _mm512_set1_ps(1.f));
+    __m512i const Pow2n = _mm512_slli_epi32(_mm512_add_epi32(_mm512_cvtps_epi32(n), _mm512_set1_epi32(127)), 23);
+    __m512 e = _mm512_mul_ps(y, _mm512_castsi512_ps(Pow2n));
+    e = _mm512_mask_mov_ps(e, Overflow, _mm512_set1_ps(INFINITY));
+    e = _mm512_maskz_mov_ps(HasExp, e);
+
+    // 65 * (a^2 p0 + a p1 + p2 + exp)
+    __m512 q = _mm512_fmadd_ps(_mm512_fmadd_ps(a, p0, p1), a, p2);
+    _mm512_storeu_ps(Charge + i, _mm512_mul_ps(_mm512_set1_ps(65.f), _mm512_add_ps(q, e)));
+
+    if (Good != 0xffff) {
+      for (int j = 0; j != 16; ++j) {
+        if (!(Good & (1 << j))) {
+          OutOfRange.push_back(i + j);
+        }
+      }
+    }
+  }
+
+  // Or every SSE instruction after, in libm for one, pays for the switch
+  _mm256_zeroupper();
+
+  return i;
+}
+
+
+__attribute__((target("avx2,fma")))
+size_t PLTGainCal::GetCharges5AVX2 (size_t const NHits, int const* ch, int const* roc, int const* col, int const* row, int const* adc, float const* Coefs, float* Charge, std::vector<size_t>& OutOfRange)
+{
+  size_t i = 0;
+  __m256i const One     = _mm256_set1_epi32(1);
+  __m256i const NChns   = _mm256_set1_epi32(MAXCHNS);
+  __m256i const NRocs   = _mm256_set1_epi32(NROCS);
+  __m256i const NCols   = _mm256_set1_epi32(NCOLS);
+  __m256i const NRows   = _mm256_set1_epi32(NROWS);
+  __m256i const FirstCol = _mm256_set1_epi32(PLTU::FIRSTCOL);
+  __m256i const FirstRow = _mm256_set1_epi32(PLTU::FIRSTROW);
+  __m256i const Six     = _mm256_set1_epi32(6);
+  __m256i const MinusOne = _mm256_set1_epi32(-1);
+  for ( ; i + 8 <= NHits; i += 8) {
+    // In range is >= 0 and < N; the fields are small, so signed compares do
+    __m256i const ich  = _mm256_sub_epi32(_mm256_loadu_si256((__m256i const*) (ch + i)), One);
+    __m256i const iroc = _mm256_loadu_si256((__m256i const*) (roc + i));
+    __m256i const icol = _mm256_sub_epi32(_mm256_loadu_si256((__m256i const*) (col + i)), FirstCol);
+    __m256i const irow = _mm256_sub_epi32(_mm256_loadu_si256((__m256i const*) (row + i)), FirstRow);
+    __m256i Good = _mm256_and_si256(_mm256_cmpgt_epi32(ich, MinusOne), _mm256_cmpgt_epi32(NChns, ich));
+    Good = _mm256_and_si256(Good, _mm256_and_si256(_mm256_cmpgt_epi32(iroc, MinusOne), _mm256_cmpgt_epi32(NRocs, iroc)));
+    Good = _mm256_and_si256(Good, _mm256_and_si256(_mm256_cmpgt_epi32(icol, MinusOne), _mm256_cmpgt_epi32(NCols, icol)));
+    Good = _mm256_and_si256(Good, _mm256_and_si256(_mm256_cmpgt_epi32(irow, MinusOne), _mm256_cmpgt_epi32(NRows, irow)));
+    __m256i Pixel = _mm256_mullo_epi32(ich, NRocs);
+    Pixel = _mm256_mullo_epi32(_mm256_add_epi32(Pixel, iroc), NCols);
+    Pixel = _mm256_mullo_epi32(_mm256_add_epi32(Pixel, icol), NRows);
+    Pixel = _mm256_and_si256(Good, _mm256_mullo_epi32(_mm256_add_epi32(Pixel, irow), Six));
+
+    __m256 const p0 = _mm256_i32gather_ps(Coefs, Pixel, 4);
+    __m256 const p1 = _mm256_i32gather_ps(Coefs + 1, Pixel, 4);
+    __m256 const p2 = _mm256_i32gather_ps(Coefs + 2, Pixel, 4);
+    __m256 const p3 = _mm256_i32gather_ps(Coefs + 3, Pixel, 4);
+    __m256 const p4 = _mm256_i32gather_ps(Coefs + 4, Pixel, 4);
+    __m256 const a  = _mm256_cvtepi32_ps(_mm256_loadu_si256((__m256i const*) (adc + i)));
+
+    // exp((a - p3) / p4), 0 where p4 is 0 and infinity where it overflows
+    __m256 const HasExp = _mm256_cmp_ps(p4, _mm256_setzero_ps(), _CMP_NEQ_OQ);
+    __m256 x = _mm256_and_ps(HasExp, _mm256_div_ps(_mm256_sub_ps(a, p3), p4));
+    __m256 const Overflow = _mm256_cmp_ps(x, _mm256_set1_ps(88.72283905206835f), _CMP_GT_OQ);
+    x = _mm256_max_ps(_mm256_min_ps(x, _mm256_set1_ps(88.3762626647949f)), _mm256_set1_ps(-88.3762626647949f));
+    __m256 const n = _mm256_floor_ps(_mm256_fmadd_ps(x, _mm256_set1_ps(1.44269504088896341f), _mm256_set1_ps(0.5f)));
+    x = _mm256_fnmadd_ps(n, _mm256_set1_ps(0.693359375f), x);
+    x = _mm256_fnmadd_ps(n, _mm256_set1_ps(-2.12194440e-4f), x);
+    __m256 y = _mm256_set1_ps(1.9875691500E-4f);
+    y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(1.3981999507E-3f));
+    y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(8.3334519073E-3f));
+    y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(4.1665795894E-2f));
+    y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(1.6666665459E-1f));
+    y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(5.0000001201E-1f));
+    y = _mm256_add_ps(_mm256_fmadd_ps(y, _mm256_mul_ps(x, x), x), _mm256_set1_ps(1.f));
+    __m256i const Pow2n = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23);
+    __m256 e = _mm256_mul_ps(y, _mm256_castsi256_ps(Pow2n));
+    e = _mm256_blendv_ps(e, _mm256_set1_ps(INFINITY), Overflow);
+    e = _mm256_and_ps(HasExp, e);
+
+    // 65 * (a^2 p0 + a p1 + p2 + exp)
+    __m256 const q = _mm256_fmadd_ps(_mm256_fmadd_ps(a, p0, p1), a, p2);
+    _mm256_storeu_ps(Charge + i, _mm256_mul_ps(_mm256_set1_ps(65.f), _mm256_add_ps(q, e)));
+
+    int const GoodBits = _mm256_movemask_ps(_mm256_castsi256_ps(Good));
+    if (GoodBits != 0xff) {
+      for (int j = 0; j != 8; ++j) {
+        if (!(GoodBits & (1 << j))) {
+          OutOfRange.push_back(i + j);
+        }
+      }
+    }
+  }
+
+  // Or every SSE instruction after, in libm for one, pays for the switch
+  _mm256_zeroupper();
+
+  return i;
+}
+#endif
+
+
 void PLTGainCal::ReadGainCalFile (std::string const GainCalFileName)
 {
   if (GainCalFileName == "") {
@@ -224,6 +519,9 @@ void PLTGainCal::ReadGainCalFile5 (std::string const GainCalFileName)
     throw;
   }
 
+  // The charges of the old coefficients
+  ClearChargeTable();
+
   // Loop over header lines in the input data file
   for (std::string line; std::getline(f, line); ) {
     int mf, mfc, hub;
@@ -339,6 +637,9 @@ void PLTGainCal::ReadGainCalFileExt (std::string const GainCalFileName)
   TF1 MyFunction("GainCalFitFunction", FunctionLine, -10000, 10000);
   fFitFunction = MyFunction;
 
+  // The charges of the old coefficients
+  ClearChargeTable();
+
   // Get blank line out of the way
   FunctionLine.ReadLine(f);
 
@@ -454,6 +755,152 @@ void PLTGainCal::CheckGainCalFile(std::string const GainCalFileName, int const C
 }
 
 
+int PLTGainCal::BuildChargeTable (std::vector<int> const& Channels, size_t const MaxBytes, ChargeTablePrecision const Precision)
+{
+  ClearChargeTable();
+  if (!fIsGood) {
+    return 0;
+  }
+
+  std::vector<int> Wanted = Channels;
+  if (Wanted.empty()) {
+    for (std::map<int, int>::const_iterator it = fHardwareMap.begin(); it != fHardwareMap.end(); ++it) {
+      Wanted.push_back(it->first);
+    }
+  }
+
+  size_t const NPerChannel = (size_t) NROCS * NCOLS * NROWS * NADCS;
+  size_t const BytesPerChannel = NPerChannel * (Precision == kChargeTable_Half ? sizeof(uint16_t) : sizeof(float));
+
+  // Slots in the order given, while they fit
+  std::vector<int> Tabulated;
+  for (size_t i = 0; i != Wanted.size(); ++i) {
+    int const ich = ChIndex(Wanted[i]);
+    if (ich < 0 || ich >= MAXCHNS || fChargeTableSlot[ich] >= 0) {
+      continue;
+    }
+    if ((Tabulated.size() + 1) * BytesPerChannel > MaxBytes) {
+      printf("PLTGainCal charge table has no room for ch %i in %.1f MB\n", Wanted[i], MaxBytes / 1e6);
+      continue;
+    }
+    fChargeTableSlot[ich] = Tabulated.size();
+    Tabulated.push_back(Wanted[i]);
+  }
+
+  if (Tabulated.empty()) {
+    return 0;
+  }
+  fChargeTableIsHalf = Precision == kChargeTable_Half;
+  fChargeTableBytes = Tabulated.size() * BytesPerChannel;
+  fChargeTable = mmap(0, fChargeTableBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (fChargeTable == MAP_FAILED) {
+    std::cerr << "ERROR: cannot map " << fChargeTableBytes << " bytes for the charge table" << std::endl;
+    fChargeTable = 0;
+    ClearChargeTable();
+    return 0;
+  }
+#ifdef MADV_HUGEPAGE
+  madvise(fChargeTable, fChargeTableBytes, MADV_HUGEPAGE);
+#endif
+
+  // In the order of the table, see ChargeTableIndex
+  size_t Index = 0;
+  for (size_t i = 0; i != Tabulated.size(); ++i) {
+    for (int roc = 0; roc != NROCS; ++roc) {
+      for (int col = PLTU::FIRSTCOL; col <= PLTU::LASTCOL; ++col) {
+        for (int row = PLTU::FIRSTROW; row <= PLTU::LASTROW; ++row) {
+          for (int adc = 0; adc != NADCS; ++adc, ++Index) {
+            float const Charge = GetCharge(Tabulated[i], roc, col, row, adc);
+            if (fChargeTableIsHalf) {
+              ((uint16_t*) fChargeTable)[Index] = FloatToHalf(Charge);
+            } else {
+              ((float*) fChargeTable)[Index] = Charge;
+            }
+          }
+        }
+      }
+    }
+  }
+
+  printf("PLTGainCal charge table for %i channels, %.1f MB in %s\n", (int) Tabulated.size(), ChargeTableBytes() / 1e6,
+      Precision == kChargeTable_Half ? "half precision" : "float");
+
+  return (int) Tabulated.size();
+}
+
+
+void PLTGainCal::ClearChargeTable ()
+{
+  for (int i = 0; i != MAXCHNS; ++i) {
+    fChargeTableSlot[i] = -1;
+  }
+  if (fChargeTable) {
+    munmap(fChargeTable, fChargeTableBytes);
+  }
+  fChargeTable = 0;
+  fChargeTableBytes = 0;
+  fChargeTableIsHalf = false;
+
+  return;
+}
+
+
+size_t PLTGainCal::ChargeTableBytes () const
+{
+  return fChargeTableBytes;
+}
+
+
+uint16_t PLTGainCal::FloatToHalf (float const in)
+{
+  // IEEE half precision, rounded to nearest even; too big is infinity
+  uint32_t f;
+  std::memcpy(&f, &in, sizeof(f));
+  uint32_t const Sign = f & 0x80000000u;
+  f ^= Sign;
+
+  uint32_t h;
+  if (f >= (127u + 16) << 23) {
+    // Infinity or NaN, or too big for a half
+    h = f > 255u << 23 ? 0x7e00 : 0x7c00;
+  } else if (f < 113u << 23) {
+    // Subnormal or zero: let the float addition do the rounding
+    uint32_t const Magic = ((127u - 15) + (23 - 10) + 1) << 23;
+    float Shifted, MagicFloat;
+    std::memcpy(&Shifted, &f, sizeof(f));
+    std::memcpy(&MagicFloat, &Magic, sizeof(Magic));
+    Shifted += MagicFloat;
+    std::memcpy(&h, &Shifted, sizeof(h));
+    h -= Magic;
+  } else {
+    uint32_t const MantissaOdd = (f >> 13) & 1;
+    f += ((uint32_t) (15 - 127) << 23) + 0xfff + MantissaOdd;
+    h = f >> 13;
+  }
+
+  return (uint16_t) (h | Sign >> 16);
+}
+
+
+float PLTGainCal::HalfToFloat (uint16_t const in)
+{
+  // Exponent and mantissa moved into place and rescaled by 2^112, which also
+  // normalizes subnormals; infinity and NaN keep their all-ones exponent
+  uint32_t f = ((uint32_t) in & 0x7fff) << 13;
+  float Out;
+  std::memcpy(&Out, &f, sizeof(f));
+  Out *= 5.192296858534828e33f;
+  std::memcpy(&f, &Out, sizeof(f));
+  if ((in & 0x7c00) == 0x7c00) {
+    f |= 255u << 23;
+  }
+  f |= ((uint32_t) in & 0x8000) << 16;
+  std::memcpy(&Out, &f, sizeof(f));
+
+  return Out;
+}
+
+
 void PLTGainCal::PrintGainCal5 ()
 {
   // dude, you really don't want to do this..
@@ -580,6 +1027,9 @@ void PLTGainCal::ReadTesterGainCalFile (std::string const GainCalFileName)
   int ich;
   int iroc;
 
+  // The charges of the old coefficients
+  ClearChargeTable();
+
   for (int i = 0; i != NCHNS; ++i) {
     for (int j = 0; j != NROCS; ++j) {
       for (int k = 0; k != PLTU::NCOL; ++k) {
@@ -0,0 +1,209 @@
+#include "bril/pltslinkprocessor/PLTGzipInput.h"
+
+#include <iostream>
+
+
+PLTGzipInput::PLTGzipInput ()
+{
+  fFile = 0;
+  fFillIndex = 0;
+  fReadIndex = 0;
+  fNFull = 0;
+  fDone = true;
+  fStop = false;
+  fHaveBuffer = false;
+  fWords = 0;
+  fPos = 0;
+  fEnd = 0;
+  fBufferOffset = 0;
+}
+
+
+PLTGzipInput::~PLTGzipInput ()
+{
+  Close();
+}
+
+
+bool PLTGzipInput::Open (std::string const FileName)
+{
+  Close();
+
+  fFile = gzopen(FileName.c_str(), "rb");
+  if (fFile == 0) {
+    std::cerr << "ERROR: cannot open input file: " << FileName << std::endl;
+    return false;
+  }
+  // Bigger internal buffer than the 8 kB default so zlib reads the file in large chunks
+  gzbuffer(fFile, 1 << 18);
+
+  fBuffers.resize(NBUFFERS);
+  for (size_t i = 0; i != NBUFFERS; ++i) {
+    fBuffers[i].resize(BUFFERSIZE / sizeof(uint32_t));
+  }
+  Start(0);
+
+  return true;
+}
+
+
+void PLTGzipInput::Close ()
+{
+  Stop();
+
+  if (fFile) {
+    gzclose(fFile);
+    fFile = 0;
+  }
+
+  fDone = true;
+  return;
+}
+
+
+bool PLTGzipInput::Seek (uint64_t const Offset)
+{
+  if (fFile == 0 || Offset % sizeof(uint32_t) != 0) {
+    std::cerr << "ERROR: PLTGzipInput::Seek cannot seek to offset " << Offset << std::endl;
+    return false;
+  }
+
+  // Within the buffer the reader already has: nothing to inflate
+  if (fHaveBuffer && Offset >= fBufferOffset && Offset < fBufferOffset + fEnd * sizeof(uint32_t)) {
+    fPos = (Offset - fBufferOffset) / sizeof(uint32_t);
+    return true;
+  }
+
+  // Otherwise zlib has to inflate its way there: from where the inflate thread
+  // got to if that is before the offset, else from the start of the file
+  Stop();
+  if (gzseek(fFile, (z_off_t) Offset, SEEK_SET) != (z_off_t) Offset) {
+    int ErrorNumber = Z_OK;
+    std::cerr << "ERROR: PLTGzipInput::Seek cannot seek to offset " << Offset << ": " << gzerror(fFile, &ErrorNumber) << std::endl;
+    fDone = true;
+    return false;
+  }
+  Start(Offset);
+
+  return true;
+}
+
+
+void PLTGzipInput::Start (uint64_t const Offset)
+{
+  // Empty ring, reader at Offset in the uncompressed stream, which is where
+  // the file is
+  fBufferWords.assign(NBUFFERS, 0);
+  fFillIndex = 0;
+  fReadIndex = 0;
+  fNFull = 0;
+  fDone = false;
+  fStop = false;
+  fHaveBuffer = false;
+  fWords = 0;
+  fPos = 0;
+  fEnd = 0;
+  fBufferOffset = Offset;
+
+  fThread = std::thread(&PLTGzipInput::Inflate, this);
+
+  return;
+}
+
+
+void PLTGzipInput::Stop ()
+{
+  if (fThread.joinable()) {
+    {
+      std::lock_guard<std::mutex> Lock(fMutex);
+      fStop = true;
+    }
+    fFreeCondition.notify_all();
+    fThread.join();
+  }
+
+  fHaveBuffer = false;
+  fWords = 0;
+  fPos = 0;
+  fEnd = 0;
+  return;
+}
+
+
+void PLTGzipInput::Inflate ()
+{
+  // Runs on its own thread: fill the next free buffer, hand it over, repeat
+  while (true) {
+    size_t Index;
+    {
+      std::unique_lock<std::mutex> Lock(fMutex);
+      while (fNFull == NBUFFERS && !fStop) {
+        fFreeCondition.wait(Lock);
+      }
+      if (fStop) {
+        break;
+      }
+      Index = fFillIndex;
+    }
+
+    // gzread only comes back short at the end of the file (or on an error), so a
+    // buffer is always full except for the last one. A trailing partial word is dropped.
+    int const NBytes = gzread(fFile, &fBuffers[Index][0], BUFFERSIZE);
+    bool const End = NBytes < (int) BUFFERSIZE;
+    if (End) {
+      // A truncated or corrupt file also ends up here, possibly after a short read
+      int ErrorNumber = Z_OK;
+      char const* Message = gzerror(fFile, &ErrorNumber);
+      if (NBytes < 0 || ErrorNumber != Z_OK) {
+        std::cerr << "ERROR: PLTGzipInput cannot inflate input: " << Message << std::endl;
+      }
+    }
+
+    {
+      std::lock_guard<std::mutex> Lock(fMutex);
+      size_t const NWords = NBytes > 0 ? NBytes / sizeof(uint32_t) : 0;
+      if (NWords != 0) {
+        fBufferWords[Index] = NWords;
+        fFillIndex = (fFillIndex + 1) % NBUFFERS;
+        ++fNFull;
+      }
+      fDone = End;
+    }
+    fFilledCondition.notify_one();
+
+    if (End) {
+      break;
+    }
+  }
+
+  return;
+}
+
+
+bool PLTGzipInput::NextBuffer ()
+{
+  // The reader has used up its buffer: give it back and wait for the next one
+  std::unique_lock<std::mutex> Lock(fMutex);
+
+  if (fHaveBuffer) {
+    fBufferOffset += fEnd * sizeof(uint32_t);
+    fReadIndex = (fReadIndex + 1) % NBUFFERS;
+    --fNFull;
+    fHaveBuffer = false;
+    fFreeCondition.notify_one();
+  }
+
+  while (fNFull == 0 && !fDone) {
+    fFilledCondition.wait(Lock);
+  }
+  if (fNFull == 0) {
+    return false;
+  }
+
+  fWords = &fBuffers[fReadIndex][0];
+  fPos = 0;
+  fEnd = fBufferWords[fReadIndex];
+  fHaveBuffer = true;
+
+  return true;
+}
@@ -0,0 +1,89 @@
+#include "bril/pltslinkprocessor/PLTPixelMask.h"
+
+#include <iostream>
+
+
+PLTPixelMask::PLTPixelMask ()
+{
+  fBits.assign(NCHANNELS * NROCS * NWORDSPERROC, 0);
+}
+
+
+PLTPixelMask::~PLTPixelMask ()
+{
+}
+
+
+void PLTPixelMask::Clear ()
+{
+  fBits.assign(fBits.size(), 0);
+  return;
+}
+
+
+void PLTPixelMask::Mask (int const Channel, int const ROC, int const Col, int const Row)
+{
+  MaskRange(Channel, ROC, Col, Col, Row, Row, true);
+  return;
+}
+
+
+void PLTPixelMask::Unmask (int const Channel, int const ROC, int const Col, int const Row)
+{
+  MaskRange(Channel, ROC, Col, Col, Row, Row, false);
+  return;
+}
+
+
+void PLTPixelMask::MaskRange (int const Channel, int const ROC, int const FirstCol, int const LastCol, int const FirstRow, int const LastRow, bool const Masked)
+{
+  if (Channel < 0 || Channel >= NCHANNELS || ROC < 0 || ROC >= NROCS ||
+      FirstCol < PLTU::FIRSTCOL || LastCol > PLTU::LASTCOL || FirstRow < PLTU::FIRSTROW || LastRow > PLTU::LASTROW) {
+    std::cerr << "WARNING: PLTPixelMask ignoring pixels outside the bitmap: channel " << Channel << " roc " << ROC
+              << " col " << FirstCol << "-" << LastCol << " row " << FirstRow << "-" << LastRow << std::endl;
+    return;
+  }
+
+  // The rows of one column are contiguous; if the range covers whole columns then
+  // the whole rectangle is one run of bits
+  if (FirstRow == PLTU::FIRSTROW && LastRow == PLTU::LASTROW) {
+    SetBits(BitIndex(Channel, ROC, FirstCol, FirstRow), BitIndex(Channel, ROC, LastCol, LastRow) + 1, Masked);
+    return;
+  }
+
+  for (int col = FirstCol; col <= LastCol; ++col) {
+    SetBits(BitIndex(Channel, ROC, col, FirstRow), BitIndex(Channel, ROC, col, LastRow) + 1, Masked);
+  }
+
+  return;
+}
+
+
+void PLTPixelMask::SetBits (size_t const Begin, size_t const End, bool const Masked)
+{
+  // Set or clear bits [Begin, End) a word at a time
+  for (size_t Bit = Begin; Bit < End; ) {
+    size_t const Word = Bit >> 6;
+    size_t const First = Bit & 63;
+    size_t const Last = (End - (Word << 6)) < 64 ? (End - (Word << 6)) : 64;
+    uint64_t const WordMask = (Last - First == 64 ? ~(uint64_t) 0 : (((uint64_t) 1 << (Last - First)) - 1)) << First;
+    if (Masked) {
+      fBits[Word] |= WordMask;
+    } else {
+      fBits[Word] &= ~WordMask;
+    }
+    Bit = (Word << 6) + Last;
+  }
+
+  return;
+}
+
+
+size_t PLTPixelMask::NMasked () const
+{
+  size_t N = 0;
+  for (std::vector<uint64_t>::const_iterator it = fBits.begin(); it != fBits.end(); ++it) {
+    N += __builtin_popcountll(*it);
+  }
+  return N;
+}
@@ -1,9 +1,11 @@
 #include "bril/pltslinkprocessor/PLTPlane.h"
+#include "bril/pltslinkprocessor/PLTEventArena.h"
 
 
 PLTPlane::PLTPlane ()
 {
   // Make me, I dare you
+  fArena = 0;
 }
 
 
@@ -11,15 +13,50 @@ PLTPlane::PLTPlane (int const Channel, int const ROC)
 {
   // Con me
   fChannel = Channel;
+  fArena = 0;
 }
 
 
 PLTPlane::~PLTPlane ()
 {
-  // The Clusters belong to the Plane so we need to delete them
-  for (size_t i = 0; i != fClusters.size(); ++i) {
-    delete fClusters[i];
+  // The Clusters belong to the Plane so we need to delete them (unless they
+  // belong to the arena)
+  Clear();
+}
+
+
+
+void PLTPlane::SetArena (PLTEventArena* Arena)
+{
+  fArena = Arena;
+  return;
+}
+
+
+
+void PLTPlane::Clear ()
+{
+  // Empty the plane so it can be reused for the next event
+  if (!fArena) {
+    for (size_t i = 0; i != fClusters.size(); ++i) {
+      delete fClusters[i];
+    }
+  }
+  fClusters.clear();
+  fHits.clear();
+  fClusterizedHits.clear();
+  fUnclusteredHits.clear();
+  return;
+}
+
+
+
+PLTCluster* PLTPlane::NewCluster ()
+{
+  if (fArena) {
+    return fArena->NewCluster();
   }
+  return new PLTCluster();
 }
 
 
@@ -69,7 +106,7 @@ bool PLTPlane::AddClusterFromSeedNxN (PLTHit* Hit, int const mCol, int const mRo
   }
 
   // New cluster
-  PLTCluster* Cluster = new PLTCluster();
+  PLTCluster* Cluster = NewCluster();
 
   if ( std::count(fClusterizedHits.begin(), fClusterizedHits.end(), Hit) != 0 ) {
     std::cout << "HIHIHI" << std::endl;
@@ -227,7 +264,7 @@ void PLTPlane::ClusterizeAllTouching (FiducialRegion const FidR)
     if (std::find(fClusterizedHits.begin(), fClusterizedHits.end(), fHits[i]) != fClusterizedHits.end()) {
       continue;
     }
-    PLTCluster* Cluster = new PLTCluster();
+    PLTCluster* Cluster = NewCluster();
     Cluster->AddHit(fHits[i]);
     fClusterizedHits.push_back(fHits[i]);
     AddAllHitsTouching(Cluster, fHits[i], FidR);
@@ -246,7 +283,7 @@ void PLTPlane::ClusterizeOnePixOneCluster (FiducialRegion const FidR)
     if (std::find(fClusterizedHits.begin(), fClusterizedHits.end(), fHits[i]) != fClusterizedHits.end()) {
       continue;
     }
-    PLTCluster* Cluster = new PLTCluster();
+    PLTCluster* Cluster = NewCluster();
     Cluster->AddHit(fHits[i]);
     fClusterizedHits.push_back(fHits[i]);
     fClusters.push_back(Cluster);
@@ -0,0 +1,325 @@
+#include "bril/pltslinkprocessor/PLTSlinkGenerator.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+// A track this close to the edge of a pixel (in pixels) also hits the neighbour
+static double const CHARGESHARING = 0.1;
+
+
+PLTSlinkGenerator::PLTSlinkGenerator (PLTAlignment& Alignment, std::vector<int> const& Channels, unsigned long const Seed)
+  : fAlignment(Alignment), fChannels(Channels), fRandom(Seed), fUniform(0., 1.), fGauss(0., 1.)
+{
+  // Averages over the channels of the 2016 distributions
+  fDefaultDistribution.SlopeX[0] = 0.;
+  fDefaultDistribution.SlopeX[1] = 0.0085;
+  fDefaultDistribution.SlopeY[0] = 0.0267;
+  fDefaultDistribution.SlopeY[1] = 0.0066;
+  for (int iroc = 0; iroc != 3; ++iroc) {
+    fDefaultDistribution.ResidualX[iroc][0] = 0.;
+    fDefaultDistribution.ResidualX[iroc][1] = 0.0052;
+    fDefaultDistribution.ResidualY[iroc][0] = 0.;
+    fDefaultDistribution.ResidualY[iroc][1] = 0.0065;
+  }
+
+  fFilled.assign(NBX, true);
+  fMu = 0.1;
+  fNoise = 0.;
+  fAccidentals = 0.;
+  fEfficiency = 1.;
+  fErrorRate = 0.;
+  fTDCInterval = 0;
+  fTriggerRate = 10000.;
+  fFEDID = 1000;
+
+  fTime = 0.;
+  fNEvents = 0;
+  fNTracks = 0;
+  fNHits = 0;
+  fNErrors = 0;
+}
+
+
+PLTSlinkGenerator::~PLTSlinkGenerator ()
+{
+}
+
+
+bool PLTSlinkGenerator::ReadTrackDistributions (std::string const FileName)
+{
+  std::ifstream f(FileName.c_str());
+  if (!f.is_open()) {
+    std::cerr << "ERROR: cannot open track distributions file: " << FileName << std::endl;
+    return false;
+  }
+
+  std::string Line;
+  std::getline(f, Line);
+  bool const IsCSV = Line.compare(0, 7, "channel") == 0;
+
+  for ( ; std::getline(f, Line); ) {
+    std::istringstream ss(Line);
+    if (IsCSV) {
+      // channel, then mean and sigma of: slope y, slope x, residual y per ROC, residual x per ROC
+      int Channel;
+      TrackDistribution D;
+      ss >> Channel >> D.SlopeY[0] >> D.SlopeY[1] >> D.SlopeX[0] >> D.SlopeX[1];
+      for (int iroc = 0; iroc != 3; ++iroc) {
+        ss >> D.ResidualY[iroc][0] >> D.ResidualY[iroc][1];
+      }
+      for (int iroc = 0; iroc != 3; ++iroc) {
+        ss >> D.ResidualX[iroc][0] >> D.ResidualX[iroc][1];
+      }
+      if (ss.fail()) {
+        continue;
+      }
+      fDistributions[Channel] = D;
+    } else {
+      // e.g. "SlopeY_Ch2 0.026 0.007" or "ResidualX2_ROC0 0.000 0.005"
+      std::string Name;
+      float Mean, Sigma;
+      ss >> Name >> Mean >> Sigma;
+      if (ss.fail()) {
+        continue;
+      }
+      int Channel, ROC;
+      float* Value = 0;
+      if (sscanf(Name.c_str(), "SlopeX_Ch%i", &Channel) == 1) {
+        Value = Distribution(Channel).SlopeX;
+      } else if (sscanf(Name.c_str(), "SlopeY_Ch%i", &Channel) == 1) {
+        Value = Distribution(Channel).SlopeY;
+      } else if (sscanf(Name.c_str(), "ResidualX%i_ROC%i", &Channel, &ROC) == 2 && ROC >= 0 && ROC < 3) {
+        Value = Distribution(Channel).ResidualX[ROC];
+      } else if (sscanf(Name.c_str(), "ResidualY%i_ROC%i", &Channel, &ROC) == 2 && ROC >= 0 && ROC < 3) {
+        Value = Distribution(Channel).ResidualY[ROC];
+      }
+      if (Value) {
+        Value[0] = Mean;
+        Value[1] = Sigma;
+      }
+    }
+  }
+
+  return true;
+}
+
+
+PLTSlinkGenerator::TrackDistribution& PLTSlinkGenerator::Distribution (int const Channel)
+{
+  // A channel seen for the first time starts from the defaults
+  std::map<int, TrackDistribution>::iterator it = fDistributions.find(Channel);
+  if (it == fDistributions.end()) {
+    it = fDistributions.insert(std::make_pair(Channel, fDefaultDistribution)).first;
+  }
+  return it->second;
+}
+
+
+bool PLTSlinkGenerator::SetBXPattern (std::string const Pattern)
+{
+  if (Pattern.empty()) {
+    fFilled.assign(NBX, true);
+    return true;
+  }
+
+  std::vector<bool> Filled(NBX, false);
+  std::istringstream ss(Pattern);
+  for (std::string Range; std::getline(ss, Range, ','); ) {
+    int First, Last;
+    if (sscanf(Range.c_str(), "%i-%i", &First, &Last) != 2) {
+      if (sscanf(Range.c_str(), "%i", &First) != 1) {
+        return false;
+      }
+      Last = First;
+    }
+    if (First < 0 || Last >= NBX || First > Last) {
+      return false;
+    }
+    std::fill(Filled.begin() + First, Filled.begin() + Last + 1, true);
+  }
+  fFilled.swap(Filled);
+
+  return true;
+}
+
+
+void PLTSlinkGenerator::NextEvent (std::vector<uint32_t>& Words)
+{
+  ++fNEvents;
+  if (fTDCInterval && fNEvents % fTDCInterval == 0) {
+    uint32_t TDC[4];
+    for (int i = 0; i != 4; ++i) {
+      TDC[i] = fRandom() & 0x0fffffff;
+    }
+    PLTSlinkEncoder::AddTDC(Words, TDC, 4);
+  }
+
+  int const BX = std::min((int) (fUniform(fRandom) * NBX), NBX - 1);
+  double const Mu = fFilled[BX] ? fMu : 0.;
+
+  size_t const Begin = Words.size();
+  PLTSlinkEncoder::BeginEvent(Words, fNEvents, BX, fFEDID);
+
+  for (std::vector<int>::const_iterator ich = fChannels.begin(); ich != fChannels.end(); ++ich) {
+    int const Channel = *ich;
+    std::map<int, TrackDistribution>::const_iterator it = fDistributions.find(Channel);
+    TrackDistribution const& D = it != fDistributions.end() ? it->second : fDefaultDistribution;
+
+    fHits.clear();
+    for (int i = Poisson(Mu); i > 0; --i) {
+      AddTrack(Channel, D);
+      ++fNTracks;
+    }
+    for (int i = Poisson(fAccidentals); i > 0; --i) {
+      AddAccidental(Channel);
+    }
+    for (int iroc = 0; iroc != 3; ++iroc) {
+      for (int i = Poisson(fNoise); i > 0; --i) {
+        AddHit(Channel, iroc, fRandom() % PLTU::NCOL, fRandom() % PLTU::NROW, ADC());
+      }
+    }
+
+    // The FED sends a channel's hits ROC by ROC
+    std::stable_sort(fHits.begin(), fHits.end(), CompareROC);
+    for (std::vector<Hit>::const_iterator ih = fHits.begin(); ih != fHits.end(); ++ih) {
+      Words.push_back(PLTSlinkEncoder::HitWord(Channel, ih->ROC, ih->Column, ih->Row, ih->ADC));
+    }
+    fNHits += fHits.size();
+
+    if (fErrorRate > 0. && fUniform(fRandom) < fErrorRate) {
+      AddErrorWord(Words, Channel);
+    }
+  }
+
+  // Trailer time is ms in the day
+  fTime += 1000. / fTriggerRate;
+  PLTSlinkEncoder::EndEvent(Words, Begin, (uint32_t) ((uint64_t) fTime % 86400000));
+
+  return;
+}
+
+
+void PLTSlinkGenerator::AddTrack (int const Channel, TrackDistribution const& D)
+{
+  // Where the track crosses the middle plane, anywhere on its sensor, in
+  // telescope coordinates (pixel c covers LX from 25 - c to 26 - c pixel widths)
+  float const LX1 = PLTU::PIXELWIDTH  * (26. - PLTU::NCOL * fUniform(fRandom));
+  float const LY1 = PLTU::PIXELHEIGHT * (40. - PLTU::NROW * fUniform(fRandom));
+  std::vector<float> T;
+  fAlignment.LtoTXYZ(T, LX1, LY1, Channel, 1);
+
+  float const SX = D.SlopeX[0] + D.SlopeX[1] * fGauss(fRandom);
+  float const SY = D.SlopeY[0] + D.SlopeY[1] * fGauss(fRandom);
+
+  for (int iroc = 0; iroc != 3; ++iroc) {
+    if (fUniform(fRandom) >= fEfficiency) {
+      continue;
+    }
+
+    // Back to this plane's local coordinates, moved by the residual
+    float const DZ = fAlignment.GetTZ(Channel, iroc) - T[2];
+    std::pair<float, float> const LXY = fAlignment.TtoLXY(T[0] + SX * DZ, T[1] + SY * DZ, Channel, iroc);
+    float const LX = LXY.first  + D.ResidualX[iroc][0] + D.ResidualX[iroc][1] * fGauss(fRandom);
+    float const LY = LXY.second + D.ResidualY[iroc][0] + D.ResidualY[iroc][1] * fGauss(fRandom);
+
+    // In pixels; the integer part is the pixel hit
+    double const PX = 26. - LX / PLTU::PIXELWIDTH;
+    double const PY = 40. - LY / PLTU::PIXELHEIGHT;
+    if (PX < 0. || PY < 0. || PX >= PLTU::NCOL || PY >= PLTU::NROW) {
+      continue;
+    }
+    int const Column = (int) PX;
+    int const Row = (int) PY;
+    AddHit(Channel, iroc, Column, Row, ADC());
+
+    // Near an edge the charge is shared with the neighbour
+    double const FX = PX - Column;
+    double const FY = PY - Row;
+    if (FX < CHARGESHARING && Column > PLTU::FIRSTCOL) {
+      AddHit(Channel, iroc, Column - 1, Row, ADC() / 2);
+    } else if (FX > 1. - CHARGESHARING && Column < PLTU::LASTCOL) {
+      AddHit(Channel, iroc, Column + 1, Row, ADC() / 2);
+    }
+    if (FY < CHARGESHARING && Row > PLTU::FIRSTROW) {
+      AddHit(Channel, iroc, Column, Row - 1, ADC() / 2);
+    } else if (FY > 1. - CHARGESHARING && Row < PLTU::LASTROW) {
+      AddHit(Channel, iroc, Column, Row + 1, ADC() / 2);
+    }
+  }
+
+  return;
+}
+
+
+void PLTSlinkGenerator::AddAccidental (int const Channel)
+{
+  // All three planes, nothing to do with each other
+  for (int iroc = 0; iroc != 3; ++iroc) {
+    AddHit(Channel, iroc, fRandom() % PLTU::NCOL, fRandom() % PLTU::NROW, ADC());
+  }
+  return;
+}
+
+
+void PLTSlinkGenerator::AddHit (int const Channel, int const ROC, int const Column, int const Row, int const ADC)
+{
+  // A masked pixel is not read out, and a pixel is read out once
+  if (fPixelMask.IsMasked(Channel, ROC, Column, Row)) {
+    return;
+  }
+  for (std::vector<Hit>::const_iterator it = fHits.begin(); it != fHits.end(); ++it) {
+    if (it->ROC == ROC && it->Column == Column && it->Row == Row) {
+      return;
+    }
+  }
+
+  Hit const H = {ROC, Column, Row, ADC};
+  fHits.push_back(H);
+  return;
+}
+
+
+void PLTSlinkGenerator::AddErrorWord (std::vector<uint32_t>& Words, int const Channel)
+{
+  switch (fRandom() % 4) {
+    case 0:
+      PLTSlinkEncoder::AddTimeOut(Words, Channel, fRandom() & 0xff);
+      break;
+    case 1:
+      Words.push_back(PLTSlinkEncoder::EventNumberErrorWord(Channel, (fNEvents + 1) & 0xff));
+      break;
+    case 2:
+      Words.push_back(PLTSlinkEncoder::TrailerErrorWord(Channel, 1 << (fRandom() % 4), 1 << (fRandom() % 8)));
+      break;
+    default:
+      Words.push_back(PLTSlinkEncoder::NearFullWord(1 << (fRandom() % 8)));
+      break;
+  }
+  ++fNErrors;
+
+  return;
+}
+
+
+int PLTSlinkGenerator::ADC ()
+{
+  int const Value = (int) (150. + 30. * fGauss(fRandom));
+  return Value < 1 ? 1 : (Value > 255 ? 255 : Value);
+}
+
+
+int PLTSlinkGenerator::Poisson (double const Mean)
+{
+  if (Mean <= 0.) {
+    return 0;
+  }
+  std::poisson_distribution<int> P(Mean);
+  return P(fRandom);
+}
+
+
+bool PLTSlinkGenerator::CompareROC (Hit const& lhs, Hit const& rhs)
+{
+  return lhs.ROC < rhs.ROC;
+}
@@ -4,20 +4,40 @@
 PLTTelescope::PLTTelescope ()
 {
   // Con me
+  fArena = 0;
 }
 
 
 PLTTelescope::~PLTTelescope ()
 {
   // Telescopes own Tracks in them.
-  for (size_t itrack = 0; itrack != fTracks.size(); ++itrack) {
-    delete fTracks[itrack];
-  }
+  Clear();
 
   // Byebye
 }
 
 
+void PLTTelescope::SetArena (PLTEventArena* Arena)
+{
+  fArena = Arena;
+  return;
+}
+
+
+void PLTTelescope::Clear ()
+{
+  // Empty the telescope so it can be reused for the next event
+  if (!fArena) {
+    for (size_t itrack = 0; itrack != fTracks.size(); ++itrack) {
+      delete fTracks[itrack];
+    }
+  }
+  fTracks.clear();
+  fPlanes.clear();
+  return;
+}
+
+
 void PLTTelescope::AddPlane (PLTPlane* Plane)
 {
   // Add a plane
@@ -353,13 +373,13 @@ void PLTTelescope::FillAndOrderTelescope ()
   // This functino takes forces the size of a telescope to be 3 ROCs
   // It then orders the ROCs which exist and makes a new plane for missing ones =)
 
-  std::vector<PLTPlane*> Ordered(3, (PLTPlane*) 0x0);
+  PLTPlane* Ordered[3] = {0x0, 0x0, 0x0};
 
   for (size_t i = 0; i != fPlanes.size(); ++i) {
     Ordered[ fPlanes[i]->ROC() ] = fPlanes[i];
   }
 
-  fPlanes = Ordered;
+  fPlanes.assign(Ordered, Ordered + 3);
   return;
 }
 
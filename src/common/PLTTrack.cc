@@ -22,6 +22,15 @@ void PLTTrack::AddCluster (PLTCluster* in)
 
 
 
+void PLTTrack::Clear ()
+{
+  // Forget the clusters (keeping the memory) so the track can be reused
+  fClusters.clear();
+  return;
+}
+
+
+
 int PLTTrack::MakeTrack (PLTAlignment& Alignment)
 {
   // Check we have enough clusters
@@ -275,7 +284,7 @@ bool PLTTrack::IsFiducial (int const Channel, int const ROC, PLTAlignment& Align
   return true;
 }
 
-bool PLTTrack::IsFiducial (int const Channel, int const ROC, PLTAlignment& Alignment, std::set<int> const &mask)
+bool PLTTrack::IsFiducial (int const Channel, int const ROC, PLTAlignment& Alignment, PLTPixelMask const &mask)
 {
   // Check if a track passes through the diamond on a en plane
 
@@ -298,7 +307,7 @@ bool PLTTrack::IsFiducial (int const Channel, int const ROC, PLTAlignment& Align
 
   if (PX < PLTU::FIRSTROW || PY < PLTU::FIRSTCOL || PX > PLTU::LASTROW || PY > PLTU::LASTCOL) return false;
   //if (mask.count(ChannelPixel) != 0) printf("Masked Channel %i, Channel %i, ROC %i, PX %i, PY %i\n", ChannelPixel, Channel, ROC, PX, PY);
-  return mask.count(ChannelPixel) == 0;
+  return !mask.IsMasked(ChannelPixel);
   //return false;
 }
 
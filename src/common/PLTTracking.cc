@@ -1,13 +1,16 @@
 #include "bril/pltslinkprocessor/PLTTracking.h"
+#include "bril/pltslinkprocessor/PLTEventArena.h"
 
 PLTTracking::PLTTracking ()
 {
   // Default constructor
+  fArena = 0;
 }
 
 
 PLTTracking::PLTTracking (PLTAlignment* Alignment, TrackingAlgorithm const Algorithm)
 {
+  fArena = 0;
   SetTrackingAlignment(Alignment);
   SetTrackingAlgorithm(Algorithm);
 }
@@ -31,6 +34,12 @@ void PLTTracking::SetTrackingAlignment (PLTAlignment* Alignment)
 }
 
 
+PLTAlignment* PLTTracking::GetTrackingAlignment ()
+{
+  return fAlignment;
+}
+
+
 void PLTTracking::SetTrackingAlgorithm (TrackingAlgorithm const Algorithm)
 {
   fTrackingAlgorithm = Algorithm;
@@ -44,6 +53,22 @@ int PLTTracking::GetTrackingAlgorithm ()
 }
 
 
+void PLTTracking::SetTrackingArena (PLTEventArena* Arena)
+{
+  fArena = Arena;
+  return;
+}
+
+
+PLTTrack* PLTTracking::NewTrack ()
+{
+  if (fArena) {
+    return fArena->NewTrack();
+  }
+  return new PLTTrack();
+}
+
+
 
 void PLTTracking::RunTracking (PLTTelescope& Telescope)
 {
@@ -86,8 +111,6 @@ void PLTTracking::TrackFinder_01to2_All (PLTTelescope& Telescope)
     return;
   }
 
-  std::vector<int> UsedHits;
-
   // Shorthand for each plane
   PLTPlane* P0 = Telescope.Plane(0);
   PLTPlane* P1 = Telescope.Plane(1);
@@ -98,7 +121,8 @@ void PLTTracking::TrackFinder_01to2_All (PLTTelescope& Telescope)
   }
 
   // Vector to keep track of tracks that we're interested in
-  std::vector<PLTTrack*> MyTracks;
+  std::vector<PLTTrack*>& MyTracks = fCandidateTracks;
+  MyTracks.clear();
 
   // Start seeding with clusters in the 0th plane
   for (size_t iCL0 = 0; iCL0 != P0->NClusters(); ++iCL0) {
@@ -108,7 +132,8 @@ void PLTTracking::TrackFinder_01to2_All (PLTTelescope& Telescope)
     // and see if any patch behind in the 2nd plane.  One can rank these by Chi2 and pick best
     for (size_t iCL1 = 0; iCL1 != P1->NClusters(); ++iCL1) {
 
-      PLTTrack Track01;
+      PLTTrack& Track01 = fTrack01;
+      Track01.Clear();
       Track01.AddCluster(P0->Cluster(iCL0));
       Track01.AddCluster(P1->Cluster(iCL1));
       Track01.MakeTrack(*fAlignment);
@@ -133,7 +158,7 @@ void PLTTracking::TrackFinder_01to2_All (PLTTelescope& Telescope)
         // If it's not too far off, keep it!
         if (Distance < 0.2000 || fTrackingAlgorithm == kTrackingAlgorithm_01to2_AllCombs) {
           // Keep as possible track..
-          PLTTrack* Track012 = new PLTTrack();
+          PLTTrack* Track012 = NewTrack();
           Track012->AddCluster(P0->Cluster(iCL0));
           Track012->AddCluster(P1->Cluster(iCL1));
           Track012->AddCluster(P2->Cluster(iCL2));
@@ -205,9 +230,11 @@ void PLTTracking::SortOutTracksNoOverlapBestD2 (std::vector<PLTTrack*>& MyTracks
   // Replace input vector of tracks with accepted tracks
   MyTracks = UsedTracks;
 
-  // Delete the unused tracks
-  for (size_t i = 0; i != SkippedTracks.size(); ++i) {
-    delete SkippedTracks[i];
+  // Delete the unused tracks (unless the arena owns them)
+  if (!fArena) {
+    for (size_t i = 0; i != SkippedTracks.size(); ++i) {
+      delete SkippedTracks[i];
+    }
   }
 
   return;
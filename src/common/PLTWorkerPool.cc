@@ -0,0 +1,114 @@
+#include "bril/pltslinkprocessor/PLTWorkerPool.h"
+
+
+PLTWorkerPool::PLTWorkerPool (int const NWorkers)
+{
+  fState = 0;
+  fNDone = 0;
+  fTask = 0;
+  fStop = false;
+
+  for (int i = 1; i < NWorkers; ++i) {
+    fThreads.push_back(std::thread(&PLTWorkerPool::Work, this, i));
+  }
+}
+
+
+PLTWorkerPool::~PLTWorkerPool ()
+{
+  {
+    std::lock_guard<std::mutex> Lock(fMutex);
+    fStop = true;
+  }
+  fCondition.notify_all();
+  for (size_t i = 0; i != fThreads.size(); ++i) {
+    fThreads[i].join();
+  }
+}
+
+
+void PLTWorkerPool::Run (size_t const NTasks, Task const& TaskToRun)
+{
+  if (fThreads.empty() || NTasks < 2) {
+    for (size_t i = 0; i != NTasks; ++i) {
+      TaskToRun(i, 0);
+    }
+    return;
+  }
+
+  // More tasks than fit in the state word: do them in pieces
+  if (NTasks > TASKMASK) {
+    for (size_t First = 0; First < NTasks; First += TASKMASK) {
+      size_t const N = NTasks - First < TASKMASK ? NTasks - First : TASKMASK;
+      Run(N, [&TaskToRun, First] (size_t i, int Worker) { TaskToRun(First + i, Worker); });
+    }
+    return;
+  }
+
+  // Publish the run. The previous run is completely done, so nobody is
+  // reading fTask or fNDone at this point.
+  fTask = &TaskToRun;
+  fNDone.store(0, std::memory_order_relaxed);
+  uint64_t const Generation = (fState.load(std::memory_order_relaxed) >> (2 * TASKBITS)) + 1;
+  fState.store((Generation << (2 * TASKBITS)) | ((uint64_t) NTasks << TASKBITS), std::memory_order_release);
+  {
+    // Workers that went to sleep check fState under the lock, so none can miss this
+    std::lock_guard<std::mutex> Lock(fMutex);
+  }
+  fCondition.notify_all();
+
+  DoTasks(0);
+
+  while (fNDone.load(std::memory_order_acquire) != NTasks) {
+    std::this_thread::yield();
+  }
+
+  return;
+}
+
+
+void PLTWorkerPool::DoTasks (int const Worker)
+{
+  uint64_t State = fState.load(std::memory_order_acquire);
+  while ((State & TASKMASK) < ((State >> TASKBITS) & TASKMASK)) {
+    // Claiming a task only succeeds while the run it belongs to is still the
+    // current one, and the run can't end before the task is done
+    if (fState.compare_exchange_weak(State, State + 1, std::memory_order_acq_rel, std::memory_order_acquire)) {
+      (*fTask)(State & TASKMASK, Worker);
+      fNDone.fetch_add(1, std::memory_order_release);
+      State = fState.load(std::memory_order_acquire);
+    }
+  }
+
+  return;
+}
+
+
+void PLTWorkerPool::Work (int const Worker)
+{
+  // Runs on a pool thread: wait for a new run, help with it, repeat
+  uint64_t Generation = 0;
+  while (true) {
+    uint64_t State = fState.load(std::memory_order_acquire);
+    for (int i = 0; i != NSPIN && (State >> (2 * TASKBITS)) == Generation; ++i) {
+      std::this_thread::yield();
+      State = fState.load(std::memory_order_acquire);
+    }
+
+    if ((State >> (2 * TASKBITS)) == Generation) {
+      std::unique_lock<std::mutex> Lock(fMutex);
+      while (!fStop && (fState.load(std::memory_order_acquire) >> (2 * TASKBITS)) == Generation) {
+        fCondition.wait(Lock);
+      }
+      if (fStop) {
+        break;
+      }
+      State = fState.load(std::memory_order_acquire);
+    }
+
+    Generation = State >> (2 * TASKBITS);
+    DoTasks(Worker);
+  }
+
+  return;
+}
@@ -0,0 +1,124 @@
+#include "bril/pltslinkprocessor/ReplayDriver.h"
+
+#include <thread>
+#include <chrono>
+
+ReplayDriver::ReplayDriver(string gainCalFile, string alignmentFile, vector<unsigned> channels)
+{
+    _gainCalFile   = gainCalFile;
+    _alignmentFile = alignmentFile;
+    _channels      = channels;
+
+    // What the online processor ends up with: the EventAnalyzer sets this
+    // clustering and fiducial region on the event it is given
+    _clustering      = PLTPlane::kClustering_AllTouching;
+    _clusterFiducial = PLTPlane::kFiducialRegion_All;
+    _hitFiducial     = PLTPlane::kFiducialRegion_FullSensor;
+    _tracking        = PLTTracking::kTrackingAlgorithm_01to2_AllCombs;
+}
+
+ReplayDriver::~ReplayDriver()
+{
+    Reset();
+}
+
+void ReplayDriver::Reset()
+{
+    for (unsigned i = 0; i < _analyzers.size(); ++i) {
+        delete _analyzers[i];
+    }
+    for (unsigned i = 0; i < _events.size(); ++i) {
+        delete _events[i];
+    }
+    _analyzers.clear();
+    _events.clear();
+    _nEvents.clear();
+}
+
+long ReplayDriver::Run(string dataFile, unsigned nThreads)
+{
+    Reset();
+    if (nThreads == 0) {
+        nThreads = 1;
+    }
+
+    // Build (or read) the event index once, then hand it to every worker
+    PLTBinaryFileReader indexReader(dataFile, kMappedFile);
+    if (!indexReader.LoadEventIndex()) {
+        cerr << "ReplayDriver: cannot index " << dataFile << endl;
+        return -1;
+    }
+    const PLTEventIndex& index = indexReader.EventIndex();
+    size_t nTotal = index.NEvents();
+    if (nTotal < nThreads) {
+        nThreads = nTotal > 0 ? nTotal : 1;
+    }
+
+    // Set up the workers serially: the constructors read the calibration files
+    // and print a fair amount, which we don't want interleaved
+    for (unsigned i = 0; i < nThreads; ++i) {
+        PLTEvent *event = new PLTEvent(dataFile, _gainCalFile, _alignmentFile, kMappedFile);
+        if (_maskFile != "") {
+            event->ReadOnlinePixelMask(_maskFile);
+        }
+        event->SetTrackingAlgorithm(_tracking);
+        event->SetEventIndex(index);
+
+        // After the analyzer, which sets its own clustering and fiducial region
+        _events.push_back(event);
+        _analyzers.push_back(new EventAnalyzer(event, _analyzerAlignmentFile, _channels));
+        event->SetPlaneClustering(_clustering, _clusterFiducial);
+        event->SetPlaneFiducialRegion(_hitFiducial);
+        _nEvents.push_back(0);
+    }
+
+    // Contiguous chunks of (almost) equal numbers of events
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    vector<thread> workers;
+    for (unsigned i = 0; i < nThreads; ++i) {
+        size_t first = nTotal * i / nThreads;
+        size_t end   = nTotal * (i + 1) / nThreads;
+        workers.push_back(thread(&ReplayDriver::ProcessChunk, this, i, first, end));
+    }
+    for (unsigned i = 0; i < workers.size(); ++i) {
+        workers[i].join();
+    }
+
+    // Merge in file order so the result does not depend on thread timing
+    unsigned long nProcessed = _nEvents[0];
+    for (unsigned i = 1; i < nThreads; ++i) {
+        _analyzers[0]->Merge(*_analyzers[i]);
+        nProcessed += _nEvents[i];
+    }
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "ReplayDriver: processed " << nProcessed << " events with " << nThreads << " threads in "
+         << seconds << " s (" << (seconds > 0 ? nProcessed / seconds : 0) << " events/s)" << endl;
+
+    return nProcessed;
+}
+
+void ReplayDriver::ProcessChunk(unsigned iWorker, size_t first, size_t end)
+{
+    if (first >= end) {
+        return;
+    }
+
+    PLTEvent      *event    = _events[iWorker];
+    EventAnalyzer *analyzer = _analyzers[iWorker];
+
+    if (!event->SeekEventRange(first, end)) {
+        return;
+    }
+
+    // Start the crossing counter at the global event ordinal so that the
+    // delayed counters switch on at the same event as in a single pass
+    analyzer->SetBXCounter(first);
+
+    unsigned long n = 0;
+    while (event->GetNextEvent() >= 0) {
+        analyzer->AnalyzeEvent();
+        ++n;
+    }
+    _nEvents[iWorker] = n;
+}
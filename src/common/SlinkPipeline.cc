@@ -0,0 +1,230 @@
+#include "bril/pltslinkprocessor/SlinkPipeline.h"
+
+#include <sstream>
+#include <algorithm>
+
+// Pixel FED channel to readout channel, for the occupancy plots
+static const int channelNumber[PipelineMetrics::NCHANNELS] = {-1, 0, 1, -1, 2, 3, -1, 4, 5, -1, 6, 7,  // 0-11
+    -1, 8, 9, -1, 10, 11, -1, 12, 13, -1, 14, 15, // 12-23
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+};
+
+SlinkPipeline::SlinkPipeline(string gainCalFile, string alignmentFile, string maskFile, vector<unsigned> channels, PipelineMetrics& metrics)
+    : _metrics(metrics)
+{
+    _channels           = channels;
+    _fullReconstruction = false;
+    _occupancyPlots     = 0;
+    _nEvents            = 0;
+    _nBatch             = 0;
+
+    _event = new PLTEvent("", gainCalFile, alignmentFile, kBuffer);
+    if (!maskFile.empty()) {
+        _event->ReadOnlinePixelMask(maskFile);
+    }
+    _event->SetPlaneClustering(PLTPlane::kClustering_NoClustering, PLTPlane::kFiducialRegion_All);
+    _event->SetPlaneFiducialRegion(PLTPlane::kFiducialRegion_All);
+    _event->SetTrackingAlgorithm(PLTTracking::kTrackingAlgorithm_01to2_AllCombs);
+
+    // Note that the analyzer sets its own clustering and fiducial region
+    _analyzer = new EventAnalyzer(_event, alignmentFile, _channels);
+}
+
+SlinkPipeline::~SlinkPipeline()
+{
+    delete _analyzer;
+    delete _event;
+}
+
+void SlinkPipeline::SetFullReconstruction(bool full, unsigned nThreads)
+{
+    _fullReconstruction = full;
+    if (_fullReconstruction) {
+        _event->SetReconstructionThreads(nThreads);
+    }
+}
+
+void SlinkPipeline::SetChargeTable(size_t maxBytes, bool halfPrecision)
+{
+    PLTGainCal* gainCal = _event->GetGainCal();
+    if (maxBytes == 0) {
+        gainCal->ClearChargeTable();
+        return;
+    }
+    vector<int> channels(_channels.begin(), _channels.end());
+    gainCal->BuildChargeTable(channels, maxBytes, halfPrecision ? PLTGainCal::kChargeTable_Half : PLTGainCal::kChargeTable_Float);
+}
+
+int SlinkPipeline::DecodeMessage(const void* data, size_t size)
+{
+    // All the events of the message at once, straight from its data. The
+    // batch keeps its own copy of everything.
+    _nBatch = _event->GetNextEventBatch((const uint32_t*) data, size/sizeof(uint32_t));
+    _metrics.CountBatch(_event->GetBatch(), size);
+    return _nBatch;
+}
+
+void SlinkPipeline::ProcessEvents()
+{
+    const PLTEventBatch& batch = _event->GetBatch();
+    std::fill(_channelHits, _channelHits + PipelineMetrics::NCHANNELS, 0ul);
+    for (int ib = 0; ib < _nBatch; ++ib) {
+        // The lumi only needs to know which planes were hit, so it is
+        // counted straight from the decoded hits, in total and per BX
+        const PLTEventBatch::Entry& entry = batch.Event(ib);
+        batch.PlaneMasks(ib, _planeMasks);
+        _analyzer->AnalyzeLumi(_planeMasks, entry.BX);
+
+        // fill occupancy plots
+        for (size_t ih = entry.HitBegin; ih != entry.HitEnd; ++ih) {
+            ++_channelHits[batch.fHits.fChannel[ih]];
+
+            // Convert pixel FED channel number to readout channel number
+            int const readoutChan = channelNumber[batch.fHits.fChannel[ih]];
+            if (_occupancyPlots && readoutChan >= 0) {
+                _occupancyPlots[(readoutChan*3) + batch.fHits.fROC[ih]]->Fill(batch.fHits.fColumn[ih], batch.fHits.fRow[ih]);
+            }
+        }
+
+        // Now the full event: clusters and tracks, for the efficiency
+        // and accidental rates per telescope
+        if (_fullReconstruction) {
+            _event->SelectBatchEvent(ib);
+            _analyzer->AnalyzeEvent();
+
+            for (size_t it = 0; it != _event->NTelescopes(); ++it) {
+                PLTTelescope* telescope = _event->Telescope(it);
+                PipelineMetrics::Add(_metrics.clusters[telescope->Channel()], telescope->NClusters());
+                PipelineMetrics::Add(_metrics.tracks[telescope->Channel()], telescope->NTracks());
+            }
+        }
+        _nEvents++;
+    }
+
+    for (unsigned ch = 0; ch < PipelineMetrics::NCHANNELS; ++ch) {
+        if (_channelHits[ch] != 0) {
+            PipelineMetrics::Add(_metrics.hits[ch], _channelHits[ch]);
+        }
+    }
+    _nBatch = 0;
+}
+
+LumiSectionSummary* SlinkPipeline::EndLumiSection(int fill, int run, int ls, int nibble)
+{
+    LumiSectionSummary* summary = new LumiSectionSummary;
+    summary->fill     = fill;
+    summary->run      = run;
+    summary->ls       = ls;
+    summary->nibble   = nibble;
+    summary->nevents  = _nEvents;
+    summary->bufferProblems = _event->GetBatch().NProblems();
+    summary->ringHighWater  = 0;
+    summary->ringSlots      = 0;
+    summary->ringDropped    = 0;
+    summary->channels = _channels;
+    for (unsigned i = 0; i < _channels.size(); ++i) {
+        vector<float> eff = _analyzer->GetTelescopeEfficiency(_channels[i]);
+        summary->eff.insert(summary->eff.end(), eff.begin(), eff.end());
+        summary->acc.push_back(_analyzer->GetTelescopeAccidentals(_channels[i]));
+        if (_fullReconstruction) {
+            summary->pzero.push_back(_analyzer->GetZeroCounting(_channels[i]));
+        }
+        summary->mu.push_back(_analyzer->GetFastZeroCounting(_channels[i]));
+    }
+    _analyzer->TakeBXHistograms(summary->bxHistograms);
+    _event->TakeStageTimes(summary->stageTimes);
+    summary->boundaryTime = std::chrono::steady_clock::now();
+    return summary;
+}
+
+void LumiSectionFiles::Write(const LumiSectionSummary& summary)
+{
+    if (summary.run != _run) {
+        Open(summary.run, summary.channels);
+    }
+
+    _effFile  << summary.ls;
+    _accFile  << summary.ls;
+    _lumiFile << summary.ls;
+    for (unsigned i = 0; i < summary.channels.size(); ++i) {
+        const float* eff = &summary.eff[3*i];
+        _effFile  << "," << eff[0] << "," << eff[1] << "," << eff[2];
+        _accFile  << "," << summary.acc[i];
+        _lumiFile << ",";
+        if (i < summary.pzero.size()) {
+            _lumiFile << summary.pzero[i];
+        }
+    }
+    for (unsigned i = 0; i < summary.channels.size(); ++i) {
+        _lumiFile << "," << summary.mu[i];
+    }
+    _effFile  << "\n" << std::flush;
+    _accFile  << "\n" << std::flush;
+    _lumiFile << "\n" << std::flush;
+
+    // Per BX: the triggered crossings, then the zeros of each channel
+    const BXHistograms& bxHistograms = summary.bxHistograms;
+    _bxFile << summary.ls << ",triggers";
+    for (unsigned bx = 0; bx < BXHistograms::NBX; ++bx) {
+        _bxFile << "," << bxHistograms.Triggers(bx);
+    }
+    _bxFile << "\n";
+    for (unsigned i = 0; i < bxHistograms.Channels().size(); ++i) {
+        _bxFile << summary.ls << ",ch" << bxHistograms.Channels()[i];
+        for (unsigned bx = 0; bx < BXHistograms::NBX; ++bx) {
+            _bxFile << "," << bxHistograms.Zeros(i, bx);
+        }
+        _bxFile << "\n";
+    }
+    _bxFile << std::flush;
+}
+
+void LumiSectionFiles::Open(int run, const vector<unsigned>& channels)
+{
+    if (_run != 0) {
+        _effFile.close();
+        _accFile.close();
+        _lumiFile.close();
+        _bxFile.close();
+    }
+    _run = run;
+
+    std::stringstream fname;
+    fname << _baseDir << "/efficiencies_" << run << ".csv";
+    _effFile.open(fname.str().c_str(), ios::out);
+    fname.str("");
+
+    fname << _baseDir << "/accidentals_" << run << ".csv";
+    _accFile.open(fname.str().c_str(), ios::out);
+    fname.str("");
+
+    fname << _baseDir << "/lumi_rates_" << run << ".csv";
+    _lumiFile.open(fname.str().c_str(), ios::out);
+    fname.str("");
+
+    fname << _baseDir << "/bx_zeros_" << run << ".csv";
+    _bxFile.open(fname.str().c_str(), ios::out);
+    fname.str("");
+
+    _effFile  << "lumi_section";
+    _accFile  << "lumi_section";
+    _lumiFile << "lumi_section";
+    for (unsigned i = 0; i < channels.size(); ++i) {
+        unsigned ch = channels[i];
+        _effFile  << ",ch" << ch << "_0,ch" << ch << "_1,ch" << ch << "_2";
+        _accFile  << ",ch" << ch;
+        _lumiFile << ",ch" << ch;
+    }
+    for (unsigned i = 0; i < channels.size(); ++i) {
+        _lumiFile << ",ch" << channels[i] << "_mu";
+    }
+    _effFile  << "\n";
+    _accFile  << "\n";
+    _lumiFile << "\n";
+
+    _bxFile << "lumi_section,counts";
+    for (unsigned bx = 0; bx < BXHistograms::NBX; ++bx) {
+        _bxFile << ",bx" << bx;
+    }
+    _bxFile << "\n";
+}
@@ -0,0 +1,754 @@
+// pltbench: microbenchmarks of the reconstruction hot paths, so that a change
+// to one of them can be measured on its own, on any machine and without slink
+// data. The input is synthetic events made from a seed: the same options give
+// exactly the same events.
+//
+// A benchmark is one kind of operation, run over all the events again and
+// again (passes) until it has taken --min-time. It reports the time per
+// operation of the median pass, with the fastest and slowest, and operations
+// per second; with --perf also the CPU cycles, instructions, branch misses and
+// last level cache misses per operation.
+//
+//   decode_word             PLTBinaryFileReader::DecodeSpyDataFifo, per data word
+//   read_event_buffer       PLTBinaryFileReader::ReadEventHitsBuffer, per event
+//   decode_batch            PLTBinaryFileReader::DecodeSpyDataFifoBatch, per data word
+//   gaincal_charge          PLTGainCal::GetCharge, per hit
+//   gaincal_charges         PLTGainCal::GetCharges on the hits of an event as arrays, per hit
+//   gaincal_table           PLTGainCal::SetCharge from the charge table
+//   gaincal_table_half      (BuildChargeTable), in float or half precision, per hit
+//   align_hit               PLTAlignment::AlignHit, per hit
+//   clusterize_<mode>       PLTPlane::Clusterize, filling the plane included, per plane
+//   tracking_all            PLTTracking::RunTracking (TrackFinder_01to2_All) with
+//   tracking_allcombs       kTrackingAlgorithm_01to2_All or _AllCombs, per telescope
+//   make_track              PLTTrack::MakeTrack on three clusters, per track
+//   analyze_event           EventAnalyzer::AnalyzeEvent on a reconstructed event, per event
+//
+// usage: pltbench [options] [name ...]
+//   name                    only the benchmarks whose name contains one of these
+//   --events N              synthetic events (default 1000)
+//   --occupancy X           mean number of particles through each telescope per
+//                           event (default 1); each leaves a 1-3 pixel cluster
+//                           near the same place in all three planes
+//   --noise X               mean number of noise hits per plane per event (default 0.1)
+//   --seed N                (default 1)
+//   --min-time MS           run each benchmark for at least MS ms (default 500)
+//   --gaincal FILE          gaincal fits (default: made up, 5 parameters)
+//   --alignment FILE        alignment (default data/Trans_Alignment_4895.dat)
+//   --perf                  hardware counters, from Linux perf events
+
+#include "bril/pltslinkprocessor/PLTEvent.h"
+#include "bril/pltslinkprocessor/PLTEventArena.h"
+#include "bril/pltslinkprocessor/PLTSlinkEncoder.h"
+#include "bril/pltslinkprocessor/PLTStageTimer.h"
+#include "bril/pltslinkprocessor/EventAnalyzer.h"
+
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <functional>
+#include <algorithm>
+#include <unistd.h>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+
+namespace {
+
+    struct BenchOptions {
+        vector<string> names;
+        unsigned long  nEvents;
+        double         occupancy;
+        double         noise;
+        unsigned long  seed;
+        double         minMilliseconds;
+        string         gainCalFile;
+        string         alignmentFile;
+        bool           perf;
+
+        BenchOptions()
+        {
+            nEvents         = 1000;
+            occupancy       = 1.;
+            noise           = 0.1;
+            seed            = 1;
+            minMilliseconds = 500.;
+            alignmentFile   = "data/Trans_Alignment_4895.dat";
+            perf            = false;
+        }
+    };
+
+    // The same channels as online
+    const int benchChannels[] = {2, 4, 5, 8, 10, 11, 13, 14, 16, 17, 19, 20};
+    const size_t NTELESCOPES = sizeof(benchChannels)/sizeof(int);
+    const size_t NROCS = 3;
+    const size_t NPLANES = NTELESCOPES * NROCS;
+
+    // One event: its slink words and the hits they decode to, plane by plane
+    // (telescope by telescope in benchChannels order, ROC 0-2 in each)
+    struct SyntheticEvent {
+        vector<uint32_t> words;
+        uint32_t         bx;
+        size_t           dataBegin, dataEnd;
+        vector<PLTHit>   hits;
+        size_t           planeBegin[NPLANES + 1];
+    };
+
+    // Poisson numbers, also for a mean of 0 which std::poisson_distribution does not take
+    class Poisson
+    {
+        public:
+            Poisson(double mean) : _distribution(mean > 0. ? mean : 1.), _zero(mean <= 0.) {}
+
+            int operator()(std::mt19937& random) { return _zero ? 0 : _distribution(random); }
+
+        private:
+            std::poisson_distribution<int> _distribution;
+            bool                           _zero;
+    };
+
+    void MakeEvents(const BenchOptions& options, vector<SyntheticEvent>& events)
+    {
+        std::mt19937 random(options.seed);
+        Poisson nParticles(options.occupancy);
+        Poisson nNoise(options.noise);
+        std::uniform_int_distribution<int> col(PLTU::FIRSTCOL, PLTU::LASTCOL);
+        std::uniform_int_distribution<int> row(PLTU::FIRSTROW, PLTU::LASTROW);
+        std::uniform_int_distribution<int> trackCol(PLTU::FIRSTCOL + 2, PLTU::LASTCOL - 2);
+        std::uniform_int_distribution<int> trackRow(PLTU::FIRSTROW + 2, PLTU::LASTROW - 2);
+        std::uniform_int_distribution<int> jitter(-1, 1);
+        std::uniform_int_distribution<int> clusterSize(1, 3);
+        std::uniform_int_distribution<int> adc(60, 200);
+        std::uniform_int_distribution<int> bx(0, BXHistograms::NBX - 1);
+
+        events.resize(options.nEvents);
+        for (size_t ie = 0; ie != events.size(); ++ie) {
+            SyntheticEvent& event = events[ie];
+            event.words.clear();
+            event.hits.clear();
+            event.bx = bx(random);
+            PLTSlinkEncoder::BeginEvent(event.words, ie + 1, event.bx, 1000);
+            event.dataBegin = event.words.size();
+
+            for (size_t it = 0; it != NTELESCOPES; ++it) {
+                vector<std::pair<int, int> > particles(nParticles(random));
+                for (size_t ip = 0; ip != particles.size(); ++ip) {
+                    particles[ip] = std::make_pair(trackCol(random), trackRow(random));
+                }
+                for (size_t iroc = 0; iroc != NROCS; ++iroc) {
+                    event.planeBegin[it * NROCS + iroc] = event.hits.size();
+                    for (size_t ip = 0; ip != particles.size(); ++ip) {
+                        int const c = particles[ip].first + jitter(random);
+                        int const r = particles[ip].second + jitter(random);
+                        int const size = clusterSize(random);
+                        event.hits.push_back(PLTHit(benchChannels[it], iroc, c, r, adc(random)));
+                        if (size > 1) {
+                            event.hits.push_back(PLTHit(benchChannels[it], iroc, c + 1, r, adc(random)));
+                        }
+                        if (size > 2) {
+                            event.hits.push_back(PLTHit(benchChannels[it], iroc, c, r + 1, adc(random)));
+                        }
+                    }
+                    for (int in = nNoise(random); in > 0; --in) {
+                        event.hits.push_back(PLTHit(benchChannels[it], iroc, col(random), row(random), adc(random)));
+                    }
+                }
+            }
+            event.planeBegin[NPLANES] = event.hits.size();
+
+            for (size_t ih = 0; ih != event.hits.size(); ++ih) {
+                PLTHit& hit = event.hits[ih];
+                event.words.push_back(PLTSlinkEncoder::HitWord(hit.Channel(), hit.ROC(), hit.Column(), hit.Row(), hit.ADC()));
+            }
+            event.dataEnd = event.words.size();
+            PLTSlinkEncoder::EndEvent(event.words, 0, 1000 + ie);
+        }
+    }
+
+    // Made up but plausible 5 parameter fits, the same for every pixel up to
+    // a few percent, in the format of PLTGainCal::ReadGainCalFile. Returns
+    // the name of the file, which the caller removes.
+    string WriteGainCalFile(unsigned long seed)
+    {
+        char name[] = "/tmp/pltbench_gaincal_XXXXXX";
+        int const fd = mkstemp(name);
+        if (fd < 0) {
+            return "";
+        }
+        close(fd);
+
+        std::mt19937 random(seed);
+        std::uniform_real_distribution<float> spread(0.97, 1.03);
+        ofstream file(name);
+        for (size_t it = 0; it != NTELESCOPES; ++it) {
+            file << "8 1 " << it << " " << benchChannels[it] << "\n";
+        }
+        // The line after the header is only read to count the parameters
+        file << "\n" << benchChannels[0] << " 0 0 0 0 0 0 0 0\n";
+        for (size_t it = 0; it != NTELESCOPES; ++it) {
+            for (size_t iroc = 0; iroc != NROCS; ++iroc) {
+                for (int c = PLTU::FIRSTCOL; c <= PLTU::LASTCOL; ++c) {
+                    for (int r = PLTU::FIRSTROW; r <= PLTU::LASTROW; ++r) {
+                        file << benchChannels[it] << " " << iroc << " " << c << " " << r << " "
+                             << 1.e-3 * spread(random) << " " << 0.8 * spread(random) << " " << -30. * spread(random) << " "
+                             << 240. * spread(random) << " " << 15. * spread(random) << "\n";
+                    }
+                }
+            }
+        }
+        return name;
+    }
+
+    // Cycles, instructions, branch misses and last level cache misses of this
+    // thread in user space, counted only while enabled. Open() fails when the
+    // kernel does not let us (see /proc/sys/kernel/perf_event_paranoid) or
+    // there is no such hardware, e.g. in most virtual machines.
+    class PerfCounters
+    {
+        public:
+            static const int NCOUNTERS = 4;
+
+            PerfCounters() { std::fill(_fds, _fds + NCOUNTERS, -1); }
+            ~PerfCounters() { Close(); }
+
+            static const char* Name(int i)
+            {
+                static const char* const names[NCOUNTERS] = {"cycles", "instructions", "branch-misses", "cache-misses"};
+                return names[i];
+            }
+
+            bool Open()
+            {
+                const uint64_t configs[NCOUNTERS] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                    PERF_COUNT_HW_BRANCH_MISSES, PERF_COUNT_HW_CACHE_MISSES};
+                for (int i = 0; i != NCOUNTERS; ++i) {
+                    struct perf_event_attr attr;
+                    memset(&attr, 0, sizeof(attr));
+                    attr.size           = sizeof(attr);
+                    attr.type           = PERF_TYPE_HARDWARE;
+                    attr.config         = configs[i];
+                    attr.disabled       = i == 0;
+                    attr.exclude_kernel = 1;
+                    attr.exclude_hv     = 1;
+                    attr.read_format    = PERF_FORMAT_GROUP;
+                    _fds[i] = syscall(__NR_perf_event_open, &attr, 0, -1, i == 0 ? -1 : _fds[0], 0);
+                    if (_fds[i] < 0) {
+                        Close();
+                        return false;
+                    }
+                }
+                return true;
+            }
+
+            void Reset()   { Control(PERF_EVENT_IOC_RESET); }
+            void Enable()  { Control(PERF_EVENT_IOC_ENABLE); }
+            void Disable() { Control(PERF_EVENT_IOC_DISABLE); }
+
+            // Since the last Reset
+            void Read(uint64_t counts[NCOUNTERS])
+            {
+                uint64_t data[1 + NCOUNTERS];
+                if (read(_fds[0], data, sizeof(data)) != (ssize_t) sizeof(data) || data[0] != NCOUNTERS) {
+                    std::fill(counts, counts + NCOUNTERS, 0);
+                    return;
+                }
+                std::copy(data + 1, data + 1 + NCOUNTERS, counts);
+            }
+
+        private:
+            void Control(unsigned long request)
+            {
+                if (_fds[0] >= 0) {
+                    ioctl(_fds[0], request, PERF_IOC_FLAG_GROUP);
+                }
+            }
+
+            void Close()
+            {
+                for (int i = NCOUNTERS - 1; i >= 0; --i) {
+                    if (_fds[i] >= 0) {
+                        close(_fds[i]);
+                    }
+                    _fds[i] = -1;
+                }
+            }
+
+            int _fds[NCOUNTERS];
+    };
+
+    // What a pass measures: the time between Start and Stop, which can be
+    // around the whole pass or around each operation when there is setup
+    // that must not count
+    class Meter
+    {
+        public:
+            Meter(PerfCounters* perf) : _perf(perf), _ticks(0), _start(0) {}
+
+            void Start()
+            {
+                if (_perf) {
+                    _perf->Enable();
+                }
+                _start = PLTStageTimes::Now();
+            }
+
+            void Stop()
+            {
+                _ticks += PLTStageTimes::Now() - _start;
+                if (_perf) {
+                    _perf->Disable();
+                }
+            }
+
+            uint64_t Ticks() const { return _ticks; }
+
+        private:
+            PerfCounters* _perf;
+            uint64_t      _ticks;
+            uint64_t      _start;
+    };
+
+    // One pass over the events; returns the number of operations
+    typedef std::function<unsigned long (Meter&)> Pass;
+
+    // Results go here so that the compiler cannot drop the work
+    volatile float sink;
+
+    class Bench
+    {
+        public:
+            Bench(const BenchOptions& options, PerfCounters* perf) : _options(options), _perf(perf) {}
+
+            bool Selected(const string& name) const
+            {
+                if (_options.names.empty()) {
+                    return true;
+                }
+                for (size_t i = 0; i != _options.names.size(); ++i) {
+                    if (_options.names[i] == "all" || name.find(_options.names[i]) != string::npos) {
+                        return true;
+                    }
+                }
+                return false;
+            }
+
+            static void PrintHeader(bool perf)
+            {
+                printf("%-24s %10s %10s %10s %10s %12s", "benchmark", "ops/pass", "ns/op", "min", "max", "ops/s");
+                if (perf) {
+                    printf(" %10s %6s %10s %10s", "cycles/op", "IPC", "brmiss/op", "llcmiss/op");
+                }
+                printf("\n");
+            }
+
+            void Run(const string& name, Pass pass)
+            {
+                if (!Selected(name)) {
+                    return;
+                }
+
+                // A first pass to warm up the caches and grow the arenas
+                Meter warmUp(0);
+                unsigned long const nOps = pass(warmUp);
+                if (nOps == 0) {
+                    printf("%-24s %10s\n", name.c_str(), "no ops");
+                    return;
+                }
+
+                double const nsPerTick = PLTStageTimes::NanosecondsPerTick();
+                vector<double> nsPerOp;
+                uint64_t counts[PerfCounters::NCOUNTERS] = {0};
+                double totalNs = 0.;
+                while (nsPerOp.size() < 3 || totalNs < 1.e6 * _options.minMilliseconds) {
+                    if (_perf) {
+                        _perf->Reset();
+                    }
+                    Meter meter(_perf);
+                    pass(meter);
+                    double const ns = meter.Ticks() * nsPerTick;
+                    nsPerOp.push_back(ns / nOps);
+                    totalNs += ns;
+                    if (_perf) {
+                        uint64_t passCounts[PerfCounters::NCOUNTERS];
+                        _perf->Read(passCounts);
+                        for (int i = 0; i != PerfCounters::NCOUNTERS; ++i) {
+                            counts[i] += passCounts[i];
+                        }
+                    }
+                }
+
+                std::sort(nsPerOp.begin(), nsPerOp.end());
+                double const median = nsPerOp[nsPerOp.size() / 2];
+                printf("%-24s %10lu %10.1f %10.1f %10.1f %12.4g", name.c_str(), nOps, median, nsPerOp.front(), nsPerOp.back(),
+                       median > 0. ? 1.e9 / median : 0.);
+                if (_perf) {
+                    double const ops = (double) nOps * nsPerOp.size();
+                    printf(" %10.1f %6.2f %10.3f %10.3f", counts[0] / ops, counts[0] ? (double) counts[1] / counts[0] : 0.,
+                           counts[2] / ops, counts[3] / ops);
+                }
+                printf("\n");
+                fflush(stdout);
+            }
+
+        private:
+            const BenchOptions& _options;
+            PerfCounters*       _perf;
+    };
+
+    bool ParseOptions(int argc, char* argv[], BenchOptions& options)
+    {
+        for (int i = 1; i < argc; ++i) {
+            string const arg = argv[i];
+            bool const hasValue = i + 1 < argc;
+            if (arg == "--perf") {
+                options.perf = true;
+            } else if (arg == "--events" && hasValue) {
+                options.nEvents = strtoul(argv[++i], 0, 10);
+            } else if (arg == "--occupancy" && hasValue) {
+                options.occupancy = atof(argv[++i]);
+            } else if (arg == "--noise" && hasValue) {
+                options.noise = atof(argv[++i]);
+            } else if (arg == "--seed" && hasValue) {
+                options.seed = strtoul(argv[++i], 0, 10);
+            } else if (arg == "--min-time" && hasValue) {
+                options.minMilliseconds = atof(argv[++i]);
+            } else if (arg == "--gaincal" && hasValue) {
+                options.gainCalFile = argv[++i];
+            } else if (arg == "--alignment" && hasValue) {
+                options.alignmentFile = argv[++i];
+            } else if (arg.compare(0, 2, "--") == 0) {
+                std::cerr << "unknown or incomplete option " << arg << std::endl;
+                return false;
+            } else {
+                options.names.push_back(arg);
+            }
+        }
+        return options.nEvents > 0 && options.occupancy >= 0. && options.noise >= 0.;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    BenchOptions options;
+    if (!ParseOptions(argc, argv, options)) {
+        std::cerr << "usage: " << argv[0] << " [--events N] [--occupancy X] [--noise X] [--seed N] [--min-time MS]"
+            << " [--gaincal FILE] [--alignment FILE] [--perf] [name ...]" << std::endl;
+        return 1;
+    }
+
+    // Inputs, none of which is timed
+    vector<SyntheticEvent> events;
+    MakeEvents(options, events);
+
+    string const madeUpGainCal = options.gainCalFile.empty() ? WriteGainCalFile(options.seed) : "";
+    string const gainCalFile = options.gainCalFile.empty() ? madeUpGainCal : options.gainCalFile;
+    PLTGainCal gainCal;
+    gainCal.ReadGainCalFile(gainCalFile);
+    PLTAlignment alignment;
+    alignment.ReadAlignmentFile(options.alignmentFile);
+    if (!gainCal.IsGood() || !alignment.IsGood()) {
+        std::cerr << "ERROR: cannot read the gaincal or the alignment" << std::endl;
+        return 1;
+    }
+
+    // Charges and coordinates of the hits, for clustering and tracking
+    unsigned long nHits = 0, nWords = 0;
+    for (size_t ie = 0; ie != events.size(); ++ie) {
+        for (size_t ih = 0; ih != events[ie].hits.size(); ++ih) {
+            gainCal.SetCharge(events[ie].hits[ih]);
+            alignment.AlignHit(events[ie].hits[ih]);
+        }
+        nHits  += events[ie].hits.size();
+        nWords += events[ie].words.size();
+    }
+
+    // Everything that talks, before the results
+    PLTBinaryFileReader reader;
+    PLTEventArena readerArena;
+    reader.SetArena(&readerArena);
+    reader.SetPlaneFiducialRegion(PLTPlane::kFiducialRegion_All);
+
+    // The same gaincal with charge tables for all the channels
+    vector<int> const tableChannels(benchChannels, benchChannels + NTELESCOPES);
+    PLTGainCal tableGainCal, halfGainCal;
+    tableGainCal.ReadGainCalFile(gainCalFile);
+    tableGainCal.BuildChargeTable(tableChannels, (size_t) -1, PLTGainCal::kChargeTable_Float);
+    halfGainCal.ReadGainCalFile(gainCalFile);
+    halfGainCal.BuildChargeTable(tableChannels, (size_t) -1, PLTGainCal::kChargeTable_Half);
+
+    // As SlinkPipeline with full reconstruction
+    PLTEvent event("", gainCalFile, options.alignmentFile, kBuffer);
+    event.SetPlaneClustering(PLTPlane::kClustering_NoClustering, PLTPlane::kFiducialRegion_All);
+    event.SetPlaneFiducialRegion(PLTPlane::kFiducialRegion_All);
+    event.SetTrackingAlgorithm(PLTTracking::kTrackingAlgorithm_01to2_AllCombs);
+    EventAnalyzer analyzer(&event, options.alignmentFile, vector<unsigned>(benchChannels, benchChannels + NTELESCOPES));
+
+    PerfCounters perfCounters;
+    PerfCounters* perf = 0;
+    if (options.perf) {
+        if (perfCounters.Open()) {
+            perf = &perfCounters;
+        } else {
+            std::cerr << "WARNING: no hardware counters here, timing only" << std::endl;
+        }
+    }
+
+    printf("%lu events, %.2f hits and %.1f slink words per event, seed %lu\n",
+           options.nEvents, (double) nHits / events.size(), (double) nWords / events.size(), options.seed);
+    Bench bench(options, perf);
+    Bench::PrintHeader(perf != 0);
+
+    // Decoding, with the hits from an arena as in PLTEvent
+    {
+        vector<PLTHit*> hits;
+        vector<PLTError> errors;
+        vector<int> desyncChannels;
+
+        bench.Run("decode_word", [&] (Meter& meter) {
+            unsigned long ops = 0;
+            meter.Start();
+            for (size_t ie = 0; ie != events.size(); ++ie) {
+                readerArena.Reset();
+                hits.clear();
+                errors.clear();
+                desyncChannels.clear();
+                for (size_t iw = events[ie].dataBegin; iw != events[ie].dataEnd; ++iw) {
+                    reader.DecodeSpyDataFifo(events[ie].words[iw], hits, errors, desyncChannels);
+                }
+                ops += events[ie].dataEnd - events[ie].dataBegin;
+            }
+            meter.Stop();
+            return ops;
+        });
+
+        bench.Run("read_event_buffer", [&] (Meter& meter) {
+            unsigned long eventNumber;
+            uint32_t time, bx;
+            meter.Start();
+            for (size_t ie = 0; ie != events.size(); ++ie) {
+                readerArena.Reset();
+                hits.clear();
+                errors.clear();
+                desyncChannels.clear();
+                reader.ReadEventHitsBuffer(&events[ie].words[0], events[ie].words.size(), hits, errors, eventNumber, time, bx, desyncChannels);
+            }
+            meter.Stop();
+            return (unsigned long) events.size();
+        });
+
+        PLTHitArrays batchHits;
+        bench.Run("decode_batch", [&] (Meter& meter) {
+            unsigned long ops = 0;
+            meter.Start();
+            for (size_t ie = 0; ie != events.size(); ++ie) {
+                errors.clear();
+                desyncChannels.clear();
+                reader.DecodeSpyDataFifoBatch(&events[ie].words[events[ie].dataBegin], events[ie].dataEnd - events[ie].dataBegin, batchHits, errors, desyncChannels);
+                ops += events[ie].dataEnd - events[ie].dataBegin;
+            }
+            meter.Stop();
+            return ops;
+        });
+    }
+
+    bench.Run("gaincal_charge", [&] (Meter& meter) {
+        float sum = 0.;
+        meter.Start();
+        for (size_t ie = 0; ie != events.size(); ++ie) {
+            vector<PLTHit>& hits = events[ie].hits;
+            for (size_t ih = 0; ih != hits.size(); ++ih) {
+                sum += gainCal.GetCharge(hits[ih].Channel(), hits[ih].ROC(), hits[ih].Column(), hits[ih].Row(), hits[ih].ADC());
+            }
+        }
+        meter.Stop();
+        sink = sum;
+        return nHits;
+    });
+
+    {
+        vector<PLTHitArrays> arrays(events.size());
+        for (size_t ie = 0; ie != events.size(); ++ie) {
+            vector<PLTHit>& hits = events[ie].hits;
+            arrays[ie].Resize(hits.size());
+            for (size_t ih = 0; ih != hits.size(); ++ih) {
+                arrays[ie].fChannel[ih] = hits[ih].Channel();
+                arrays[ie].fROC[ih]     = hits[ih].ROC();
+                arrays[ie].fColumn[ih]  = hits[ih].Column();
+                arrays[ie].fRow[ih]     = hits[ih].Row();
+                arrays[ie].fADC[ih]     = hits[ih].ADC();
+            }
+        }
+        vector<float> charges;
+
+        bench.Run("gaincal_charges", [&] (Meter& meter) {
+            float sum = 0.;
+            meter.Start();
+            for (size_t ie = 0; ie != arrays.size(); ++ie) {
+                PLTHitArrays& a = arrays[ie];
+                size_t const n = a.NHits();
+                if (n == 0) {
+                    continue;
+                }
+                charges.resize(n);
+                gainCal.GetCharges(n, &a.fChannel[0], &a.fROC[0], &a.fColumn[0], &a.fRow[0], &a.fADC[0], &charges[0]);
+                sum += charges[n - 1];
+            }
+            meter.Stop();
+            sink = sum;
+            return nHits;
+        });
+    }
+
+    // Half precision first: the float table leaves the hits with exactly the
+    // charges they had, for the benchmarks after
+    PLTGainCal* const tables[2] = {&halfGainCal, &tableGainCal};
+    char const* const tableNames[2] = {"gaincal_table_half", "gaincal_table"};
+    for (int it = 0; it != 2; ++it) {
+        bench.Run(tableNames[it], [&] (Meter& meter) {
+            float sum = 0.;
+            meter.Start();
+            for (size_t ie = 0; ie != events.size(); ++ie) {
+                vector<PLTHit>& hits = events[ie].hits;
+                for (size_t ih = 0; ih != hits.size(); ++ih) {
+                    tables[it]->SetCharge(hits[ih]);
+                    sum += hits[ih].Charge();
+                }
+            }
+            meter.Stop();
+            sink = sum;
+            return nHits;
+        });
+    }
+
+    bench.Run("align_hit", [&] (Meter& meter) {
+        meter.Start();
+        for (size_t ie = 0; ie != events.size(); ++ie) {
+            vector<PLTHit>& hits = events[ie].hits;
+            for (size_t ih = 0; ih != hits.size(); ++ih) {
+                alignment.AlignHit(hits[ih]);
+            }
+        }
+        meter.Stop();
+        return nHits;
+    });
+
+    // Clustering, one plane at a time as ReconstructTelescope does. Nearest
+    // neighbours clustering is left out: it is not written and throws.
+    {
+        const PLTPlane::Clustering modes[] = {PLTPlane::kClustering_Seed_3x3, PLTPlane::kClustering_Seed_5x5,
+            PLTPlane::kClustering_Seed_9x9, PLTPlane::kClustering_AllTouching, PLTPlane::kClustering_OnePixOneCluster,
+            PLTPlane::kClustering_NoClustering};
+        const char* const names[] = {"clusterize_seed3x3", "clusterize_seed5x5", "clusterize_seed9x9",
+            "clusterize_alltouching", "clusterize_onepix", "clusterize_none"};
+
+        PLTEventArena arena;
+        PLTPlane plane;
+        plane.SetArena(&arena);
+        for (size_t im = 0; im != sizeof(modes)/sizeof(modes[0]); ++im) {
+            PLTPlane::Clustering const mode = modes[im];
+            bench.Run(names[im], [&] (Meter& meter) {
+                meter.Start();
+                for (size_t ie = 0; ie != events.size(); ++ie) {
+                    SyntheticEvent& event = events[ie];
+                    arena.Reset();
+                    for (size_t ip = 0; ip != NPLANES; ++ip) {
+                        plane.Clear();
+                        for (size_t ih = event.planeBegin[ip]; ih != event.planeBegin[ip + 1]; ++ih) {
+                            plane.AddHit(&event.hits[ih]);
+                        }
+                        plane.Clusterize(mode, PLTPlane::kFiducialRegion_All);
+                    }
+                }
+                meter.Stop();
+                return (unsigned long) (events.size() * NPLANES);
+            });
+        }
+    }
+
+    // Tracking and track fits on the planes of all the events, clustered
+    // beforehand as online (all touching)
+    {
+        PLTEventArena clusterArena, trackArena;
+        vector<PLTPlane> planes(events.size() * NPLANES);
+        vector<PLTTelescope> telescopes(events.size() * NTELESCOPES);
+        vector<PLTCluster*> trackClusters;
+        for (size_t ie = 0; ie != events.size(); ++ie) {
+            for (size_t ip = 0; ip != NPLANES; ++ip) {
+                PLTPlane& plane = planes[ie * NPLANES + ip];
+                plane.SetArena(&clusterArena);
+                plane.SetChannel(benchChannels[ip / NROCS]);
+                plane.SetROC(ip % NROCS);
+                for (size_t ih = events[ie].planeBegin[ip]; ih != events[ie].planeBegin[ip + 1]; ++ih) {
+                    plane.AddHit(&events[ie].hits[ih]);
+                }
+                plane.Clusterize(PLTPlane::kClustering_AllTouching, PLTPlane::kFiducialRegion_All);
+            }
+            for (size_t it = 0; it != NTELESCOPES; ++it) {
+                telescopes[ie * NTELESCOPES + it].SetArena(&trackArena);
+                PLTPlane* telescopePlanes = &planes[(ie * NTELESCOPES + it) * NROCS];
+                if (telescopePlanes[0].NClusters() && telescopePlanes[1].NClusters() && telescopePlanes[2].NClusters()) {
+                    for (size_t iroc = 0; iroc != NROCS; ++iroc) {
+                        trackClusters.push_back(telescopePlanes[iroc].Cluster(0));
+                    }
+                }
+            }
+        }
+
+        const PLTTracking::TrackingAlgorithm algorithms[] = {PLTTracking::kTrackingAlgorithm_01to2_All,
+            PLTTracking::kTrackingAlgorithm_01to2_AllCombs};
+        const char* const names[] = {"tracking_all", "tracking_allcombs"};
+        for (size_t ia = 0; ia != sizeof(algorithms)/sizeof(algorithms[0]); ++ia) {
+            PLTTracking tracking(&alignment, algorithms[ia]);
+            tracking.SetTrackingArena(&trackArena);
+            bench.Run(names[ia], [&] (Meter& meter) {
+                trackArena.Reset();
+                meter.Start();
+                for (size_t it = 0; it != telescopes.size(); ++it) {
+                    PLTTelescope& telescope = telescopes[it];
+                    telescope.Clear();
+                    for (size_t iroc = 0; iroc != NROCS; ++iroc) {
+                        telescope.AddPlane(&planes[it * NROCS + iroc]);
+                    }
+                    tracking.RunTracking(telescope);
+                }
+                meter.Stop();
+                return (unsigned long) telescopes.size();
+            });
+        }
+
+        bench.Run("make_track", [&] (Meter& meter) {
+            PLTTrack track;
+            meter.Start();
+            for (size_t i = 0; i + NROCS <= trackClusters.size(); i += NROCS) {
+                track.Clear();
+                for (size_t iroc = 0; iroc != NROCS; ++iroc) {
+                    track.AddCluster(trackClusters[i + iroc]);
+                }
+                track.MakeTrack(alignment);
+            }
+            meter.Stop();
+            return (unsigned long) (trackClusters.size() / NROCS);
+        });
+    }
+
+    // The analysis of events reconstructed as online; only AnalyzeEvent is timed
+    {
+        bench.Run("analyze_event", [&] (Meter& meter) {
+            for (size_t ie = 0; ie != events.size(); ++ie) {
+                event.GetNextEvent(&events[ie].words[0], events[ie].words.size());
+                meter.Start();
+                analyzer.AnalyzeEvent();
+                meter.Stop();
+            }
+            return (unsigned long) events.size();
+        });
+    }
+
+    if (!madeUpGainCal.empty()) {
+        remove(madeUpGainCal.c_str());
+    }
+    return 0;
+}
@@ -0,0 +1,235 @@
+// pltslinkgen: synthetic slink data for load tests (PLTSlinkGenerator), at any
+// pileup, written to a file or published on zmq as FEDStreamReader does.
+// pltslinkreplay reads the files, and the online processing or pltslinkreplay
+// with --zmq can take the zmq stream.
+//
+// usage: pltslinkgen [options]
+//   --events N               events to make (default 100000)
+//   --mu X                   mean tracks per telescope in a filled crossing (default 0.1)
+//   --bx PATTERN             filled bunches, e.g. "0-11,100,200-211" (default all)
+//   --noise X                mean noise hits per plane per crossing (default 0.01)
+//   --accidentals X          mean accidentals per telescope per crossing (default 0.001)
+//   --efficiency X           plane efficiency (default 0.99)
+//   --errors X               error words per channel per event (default 0)
+//   --tdc N                  a TDC block every N events (default 0, none)
+//   --trigger-rate HZ        for the event time (default 10000)
+//   --seed N                 (default 1)
+//   --alignment FILE         alignment (default data/Trans_Alignment_4895.dat)
+//   --tracks FILE            track slopes and residuals per channel
+//                            (default data/TrackDistributions_MagnetOn2016_4892.txt)
+//   --mask FILE              online pixel mask (default none); needs --gaincal for
+//                            the hardware addresses of the channels
+//   --gaincal FILE
+//   --output FILE            raw FED words (default slink.bin)
+//   --captured               write messages, each a 32 bit word count followed by the
+//                            words, as pltslinkreplay --captured reads them
+//   --events-per-message N   (default 16)
+//   --zmq ENDPOINT           publish the messages on a zmq PUB socket bound there
+//                            instead of writing them, then an empty message
+//   --rate N                 at most N events/s (default: as fast as possible)
+
+#include "bril/pltslinkprocessor/PLTSlinkGenerator.h"
+#include "bril/pltslinkprocessor/PLTBinaryFileReader.h"
+#include "bril/pltslinkprocessor/PLTGainCal.h"
+#include "bril/pltslinkprocessor/zmq.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <chrono>
+
+using namespace std;
+
+namespace {
+
+    struct GeneratorOptions {
+        unsigned long nEvents;
+        double   mu;
+        string   bxPattern;
+        double   noise;
+        double   accidentals;
+        double   efficiency;
+        double   errorRate;
+        unsigned tdcInterval;
+        double   triggerRate;
+        unsigned long seed;
+        string   alignmentFile;
+        string   tracksFile;
+        string   maskFile;
+        string   gainCalFile;
+        string   outputFile;
+        bool     captured;
+        unsigned eventsPerMessage;
+        string   zmqEndpoint;
+        double   rate;
+
+        GeneratorOptions()
+        {
+            nEvents          = 100000;
+            mu               = 0.1;
+            noise            = 0.01;
+            accidentals      = 0.001;
+            efficiency       = 0.99;
+            errorRate        = 0.;
+            tdcInterval      = 0;
+            triggerRate      = 10000.;
+            seed             = 1;
+            alignmentFile    = "data/Trans_Alignment_4895.dat";
+            tracksFile       = "data/TrackDistributions_MagnetOn2016_4892.txt";
+            outputFile       = "slink.bin";
+            captured         = false;
+            eventsPerMessage = 16;
+            rate             = 0.;
+        }
+    };
+
+    bool ParseOptions(int argc, char* argv[], GeneratorOptions& options)
+    {
+        for (int i = 1; i < argc; ++i) {
+            string const arg = argv[i];
+            bool const hasValue = i + 1 < argc;
+            if (arg == "--captured") {
+                options.captured = true;
+            } else if (arg == "--events" && hasValue) {
+                options.nEvents = strtoul(argv[++i], 0, 10);
+            } else if (arg == "--mu" && hasValue) {
+                options.mu = atof(argv[++i]);
+            } else if (arg == "--bx" && hasValue) {
+                options.bxPattern = argv[++i];
+            } else if (arg == "--noise" && hasValue) {
+                options.noise = atof(argv[++i]);
+            } else if (arg == "--accidentals" && hasValue) {
+                options.accidentals = atof(argv[++i]);
+            } else if (arg == "--efficiency" && hasValue) {
+                options.efficiency = atof(argv[++i]);
+            } else if (arg == "--errors" && hasValue) {
+                options.errorRate = atof(argv[++i]);
+            } else if (arg == "--tdc" && hasValue) {
+                options.tdcInterval = strtoul(argv[++i], 0, 10);
+            } else if (arg == "--trigger-rate" && hasValue) {
+                options.triggerRate = atof(argv[++i]);
+            } else if (arg == "--seed" && hasValue) {
+                options.seed = strtoul(argv[++i], 0, 10);
+            } else if (arg == "--alignment" && hasValue) {
+                options.alignmentFile = argv[++i];
+            } else if (arg == "--tracks" && hasValue) {
+                options.tracksFile = argv[++i];
+            } else if (arg == "--mask" && hasValue) {
+                options.maskFile = argv[++i];
+            } else if (arg == "--gaincal" && hasValue) {
+                options.gainCalFile = argv[++i];
+            } else if (arg == "--output" && hasValue) {
+                options.outputFile = argv[++i];
+            } else if (arg == "--events-per-message" && hasValue) {
+                options.eventsPerMessage = strtoul(argv[++i], 0, 10);
+            } else if (arg == "--zmq" && hasValue) {
+                options.zmqEndpoint = argv[++i];
+            } else if (arg == "--rate" && hasValue) {
+                options.rate = atof(argv[++i]);
+            } else {
+                std::cerr << "unknown or incomplete option " << arg << std::endl;
+                return false;
+            }
+        }
+        if (options.eventsPerMessage == 0) {
+            options.eventsPerMessage = 1;
+        }
+        return options.nEvents > 0 && options.triggerRate > 0. && (options.maskFile.empty() || !options.gainCalFile.empty());
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    GeneratorOptions options;
+    if (!ParseOptions(argc, argv, options)) {
+        std::cerr << "usage: " << argv[0] << " [--events N] [--mu X] [--bx PATTERN] [--noise X] [--accidentals X] [--efficiency X]"
+            << " [--errors X] [--tdc N] [--trigger-rate HZ] [--seed N] [--alignment FILE] [--tracks FILE] [--mask FILE --gaincal FILE]"
+            << " [--output FILE [--captured] | --zmq ENDPOINT] [--events-per-message N] [--rate N]" << std::endl;
+        return 1;
+    }
+
+    // The same channels as online
+    const int validChannels[] = {2, 4, 5, 8, 10, 11, 13, 14, 16, 17, 19, 20};
+    vector<int> channels(validChannels, validChannels + sizeof(validChannels)/sizeof(int));
+
+    PLTAlignment alignment;
+    alignment.ReadAlignmentFile(options.alignmentFile);
+    PLTSlinkGenerator generator(alignment, channels, options.seed);
+    if (!generator.ReadTrackDistributions(options.tracksFile) || !generator.SetBXPattern(options.bxPattern)) {
+        std::cerr << "ERROR: bad track distributions or BX pattern" << std::endl;
+        return 1;
+    }
+    if (!options.maskFile.empty()) {
+        // The online mask is by hardware address, which the gaincal maps to channels
+        PLTGainCal gainCal;
+        gainCal.ReadGainCalFile(options.gainCalFile);
+        PLTBinaryFileReader reader;
+        reader.ReadOnlinePixelMask(options.maskFile, gainCal);
+        generator.SetPixelMask(reader.PixelMask());
+        std::cout << reader.PixelMask().NMasked() << " pixels masked" << std::endl;
+    }
+    generator.SetMu(options.mu);
+    generator.SetNoise(options.noise);
+    generator.SetAccidentals(options.accidentals);
+    generator.SetEfficiency(options.efficiency);
+    generator.SetErrorRate(options.errorRate);
+    generator.SetTDCInterval(options.tdcInterval);
+    generator.SetTriggerRate(options.triggerRate);
+
+    bool const viaZmq = !options.zmqEndpoint.empty();
+    zmq::context_t context(1);
+    zmq::socket_t publisher(context, ZMQ_PUB);
+    ofstream file;
+    if (viaZmq) {
+        publisher.bind(options.zmqEndpoint.c_str());
+        // Give the subscribers time to connect, or the first messages are lost
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    } else {
+        file.open(options.outputFile.c_str(), ios::binary);
+        if (!file.is_open()) {
+            std::cerr << "ERROR: cannot open " << options.outputFile << std::endl;
+            return 1;
+        }
+    }
+
+    vector<uint32_t> message;
+    unsigned long nMessages = 0, nBytes = 0;
+    std::chrono::steady_clock::time_point const start = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point next = start;
+    while (generator.NEvents() < options.nEvents) {
+        message.clear();
+        for (unsigned i = 0; i != options.eventsPerMessage && generator.NEvents() < options.nEvents; ++i) {
+            generator.NextEvent(message);
+        }
+
+        if (options.rate > 0.) {
+            std::this_thread::sleep_until(next);
+            next += std::chrono::nanoseconds((long long) (1e9 * options.eventsPerMessage / options.rate));
+        }
+        size_t const size = message.size() * sizeof(uint32_t);
+        if (viaZmq) {
+            publisher.send(&message[0], size);
+        } else {
+            if (options.captured) {
+                uint32_t const nWords = message.size();
+                file.write((const char*) &nWords, sizeof(nWords));
+            }
+            file.write((const char*) &message[0], size);
+        }
+        ++nMessages;
+        nBytes += size;
+    }
+    if (viaZmq) {
+        publisher.send(0, 0);
+    }
+
+    double const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%lu events in %lu messages, %.1f MB: %lu tracks, %.2f hits and %.3f error words per event\n",
+           generator.NEvents(), nMessages, nBytes / 1e6, generator.NTracks(),
+           (double) generator.NHits() / generator.NEvents(), (double) generator.NErrors() / generator.NEvents());
+    printf("%.2f s, %.0f events/s, %.1f MB/s\n", seconds, generator.NEvents() / seconds, nBytes / 1e6 / seconds);
+
+    return 0;
+}
@@ -0,0 +1,526 @@
+// pltslinkreplay: the online slink processing (SlinkPipeline, exactly as
+// Application::zmqClient runs it) on slink data from files, without XDAQ or
+// the DAQ. It prints what would be published for every lumisection and the
+// event rate, so that changes can be validated and benchmarked on any machine.
+//
+// usage: pltslinkreplay [options] file [file ...]
+//   --captured               the files hold captured slink messages, each a 32 bit
+//                            word count followed by the words; otherwise they are
+//                            raw FED words, cut into messages of whole events
+//   --events-per-message N   events per message for raw files (default 16)
+//   --gaincal FILE           gaincal fits (default none)
+//   --alignment FILE         alignment (default data/Trans_Alignment_4895.dat)
+//   --mask FILE              online pixel mask (default data/Mask_2016_VdM_v1.txt,
+//                            "" for none)
+//   --fast                   only the fast zero-counting lumi, no reconstruction
+//   --threads N              reconstruction threads (default 1)
+//   --charge-table MB        charges from a table of at most MB MB, see
+//                            PLTGainCal::BuildChargeTable (default 0, none)
+//   --half-charges           the table in half precision
+//   --ls-events N            a lumisection every N events, instead of every
+//   --ls-ms T                T ms of event time (default 23310)
+//   --output DIR             write the per-run CSV files there as online
+//   --zmq ENDPOINT           send the messages through a local zmq PUB socket at
+//                            ENDPOINT (e.g. inproc://slink, tcp://127.0.0.1:5555)
+//                            and receive them as online, through the slink ring
+//   --rate N                 with --zmq, send at most N messages/s (default: no limit)
+//   --parallel N             instead of the pipeline, reconstruct each (raw) file
+//                            in N event-aligned chunks on N threads (ReplayDriver)
+//                            and print the efficiencies and rates of the whole file
+
+#include "bril/pltslinkprocessor/SlinkPipeline.h"
+#include "bril/pltslinkprocessor/SlinkRing.h"
+#include "bril/pltslinkprocessor/ReplayDriver.h"
+#include "bril/pltslinkprocessor/zmq.hpp"
+
+#include <iostream>
+#include <fstream>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <chrono>
+
+namespace {
+
+    struct ReplayOptions {
+        vector<string> files;
+        bool     captured;
+        unsigned eventsPerMessage;
+        string   gainCalFile;
+        string   alignmentFile;
+        string   maskFile;
+        bool     fast;
+        unsigned threads;
+        unsigned chargeTableMB;
+        bool     halfCharges;
+        unsigned long lsEvents;
+        uint32_t lsMilliseconds;
+        string   outputDir;
+        string   zmqEndpoint;
+        double   rate;
+        unsigned parallel;
+
+        ReplayOptions()
+        {
+            captured         = false;
+            eventsPerMessage = 16;
+            alignmentFile    = "data/Trans_Alignment_4895.dat";
+            maskFile         = "data/Mask_2016_VdM_v1.txt";
+            fast             = false;
+            threads          = 1;
+            chargeTableMB    = 0;
+            halfCharges      = false;
+            lsEvents         = 0;
+            lsMilliseconds   = 23310;
+            rate             = 0.;
+            parallel         = 0;
+        }
+    };
+
+    // The slink messages of the input files, one after the other. A file is
+    // read whole before its first message, so that the reading is not timed
+    // with the processing.
+    class MessageSource
+    {
+        public:
+            MessageSource(const ReplayOptions& options) : _options(options), _nextFile(0), _pos(0) {}
+
+            // The next message, or false when there are no more
+            bool Next(vector<uint32_t>& message)
+            {
+                while (_pos >= _words.size()) {
+                    if (!ReadNextFile()) {
+                        return false;
+                    }
+                }
+                size_t const begin = _options.captured ? _pos + 1 : _pos;
+                size_t const end   = _options.captured ? CapturedEnd() : EventsEnd(_options.eventsPerMessage);
+                message.assign(_words.begin() + begin, _words.begin() + end);
+                _pos = end;
+                return true;
+            }
+
+        private:
+            bool ReadNextFile()
+            {
+                _words.clear();
+                _pos = 0;
+                if (_nextFile == _options.files.size()) {
+                    return false;
+                }
+                const string& name = _options.files[_nextFile++];
+                ifstream file(name.c_str(), ios::binary);
+                if (!file.is_open()) {
+                    std::cerr << "ERROR: cannot open " << name << std::endl;
+                    return true;
+                }
+                file.seekg(0, ios::end);
+                std::streamoff const size = file.tellg();
+                file.seekg(0, ios::beg);
+                if (size >= (std::streamoff) sizeof(uint32_t)) {
+                    _words.resize(size / sizeof(uint32_t));
+                    file.read((char*) &_words[0], _words.size() * sizeof(uint32_t));
+                }
+                return true;
+            }
+
+            size_t CapturedEnd() const
+            {
+                size_t const end = _pos + 1 + _words[_pos];
+                return end < _words.size() ? end : _words.size();
+            }
+
+            // Just after the nEvents-th trailer from _pos, or the end of the
+            // file; TDC blocks are skipped as ReadEventBatch does
+            size_t EventsEnd(unsigned nEvents) const
+            {
+                size_t i = _pos;
+                while (i + 1 < _words.size()) {
+                    if (_words[i] == 0x53333333 && _words[i+1] == 0x53333333) {
+                        i += 2;
+                        while (i < _words.size() && (_words[i] & 0xf0000000) != 0xa0000000) {
+                            ++i;
+                        }
+                    } else if ((_words[i+1] & 0xf0000000) == 0xa0000000) {
+                        if (--nEvents == 0) {
+                            return i + 2;
+                        }
+                    }
+                    i += 2;
+                }
+                return _words.size();
+            }
+
+            const ReplayOptions& _options;
+            size_t           _nextFile;
+            vector<uint32_t> _words;
+            size_t           _pos;
+    };
+
+    // When the next lumisection starts, from the event count or the event time.
+    // The event time is the time of day in ms, so it goes back to 0 at midnight.
+    class LumiSectionClock
+    {
+        public:
+            LumiSectionClock(const ReplayOptions& options) : _options(options), _started(false), _startTime(0), _startEvents(0) {}
+
+            bool Boundary(const PLTEventBatch& batch, int nEvents)
+            {
+                if (batch.NEvents() == 0) {
+                    return false;
+                }
+                uint32_t const time = batch.Event(batch.NEvents() - 1).Time;
+                if (!_started) {
+                    _started   = true;
+                    _startTime = time;
+                }
+                bool const boundary = _options.lsEvents > 0
+                    ? (unsigned long) (nEvents - _startEvents) >= _options.lsEvents
+                    : Elapsed(time) >= _options.lsMilliseconds;
+                if (boundary) {
+                    _startTime   = time;
+                    _startEvents = nEvents;
+                }
+                return boundary;
+            }
+
+        private:
+            // Since the start of the lumisection. Going back by more than half
+            // a day is taken as passing midnight; by less, the events are just
+            // not in time order.
+            uint32_t Elapsed(uint32_t time) const
+            {
+                if (time >= _startTime) {
+                    return time - _startTime;
+                }
+                if (_startTime - time > MSPERDAY / 2) {
+                    return time + MSPERDAY - _startTime;
+                }
+                return 0;
+            }
+
+            static const uint32_t MSPERDAY = 86400000;
+
+            const ReplayOptions& _options;
+            bool     _started;
+            uint32_t _startTime;
+            int      _startEvents;
+    };
+
+    void PrintLumiSection(const LumiSectionSummary& summary, int nEvents, PipelineMetrics& metrics)
+    {
+        std::cout << "LS " << summary.ls << " events " << nEvents << " (" << summary.nevents << " in all)";
+        if (summary.ringSlots != 0) {
+            std::cout << " ring high water " << summary.ringHighWater << "/" << summary.ringSlots
+                << " dropped " << summary.ringDropped;
+        }
+        std::cout << "\n  mu";
+        for (unsigned i = 0; i < summary.channels.size(); ++i) {
+            std::cout << " ch" << summary.channels[i] << " " << summary.mu[i];
+        }
+        if (!summary.pzero.empty()) {
+            std::cout << "\n  tracks per crossing";
+            for (unsigned i = 0; i < summary.channels.size(); ++i) {
+                std::cout << " ch" << summary.channels[i] << " " << summary.pzero[i];
+            }
+        }
+        std::cout << "\n  accidentals";
+        for (unsigned i = 0; i < summary.channels.size(); ++i) {
+            std::cout << " ch" << summary.channels[i] << " " << summary.acc[i];
+        }
+
+        metrics.SetStageTimes(summary.stageTimes);
+        for (int stage = 0; stage < kNStages; ++stage) {
+            if (metrics.stageEvents[stage].load(std::memory_order_relaxed) != 0) {
+                std::cout << "\n  " << PLTStageTimes::StageName(stage) << " ns p50/p99/max "
+                    << metrics.stageP50[stage].load(std::memory_order_relaxed) << "/"
+                    << metrics.stageP99[stage].load(std::memory_order_relaxed) << "/"
+                    << metrics.stageMax[stage].load(std::memory_order_relaxed);
+            }
+        }
+        std::cout << std::endl;
+    }
+
+    // The end of the --zmq stream: a one-byte message, which no slink message
+    // (whole 32-bit words, possibly none at all) can be
+    bool IsEndOfStream(const zmq::message_t& message)
+    {
+        return message.size() == 1;
+    }
+
+    // Stand-in for the FED side: sends the messages on a PUB socket, then the
+    // end of the stream
+    void Publish(zmq::socket_t* socket, const ReplayOptions* options)
+    {
+        // Give the subscriber time to connect, or the first messages are lost
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+        MessageSource source(*options);
+        vector<uint32_t> words;
+        std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+        while (source.Next(words)) {
+            if (options->rate > 0.) {
+                std::this_thread::sleep_until(next);
+                next += std::chrono::nanoseconds((long long) (1e9 / options->rate));
+            }
+            socket->send(words.empty() ? 0 : &words[0], words.size() * sizeof(uint32_t));
+        }
+        char const end = 0;
+        socket->send(&end, sizeof(end));
+    }
+
+    // The receive thread's side of the wake-ups, as in Application
+    static const char* const RING_ENDPOINT = "inproc://pltslinkring";
+
+    // As Application::slinkReceiver; the end of the stream is passed on, then stops
+    void Receive(zmq::context_t* context, const string endpoint, SlinkRing<zmq::message_t>* ring)
+    {
+        zmq::socket_t socket(*context, ZMQ_SUB);
+        int const noLimit = 0;
+        socket.setsockopt(ZMQ_RCVHWM, &noLimit, sizeof(noLimit));
+        socket.connect(endpoint.c_str());
+        socket.setsockopt(ZMQ_SUBSCRIBE, 0, 0);
+
+        zmq::socket_t ringSocket(*context, ZMQ_PAIR);
+        ringSocket.connect(RING_ENDPOINT);
+
+        zmq::message_t scratch;
+        char const wake = 0;
+        while (1) {
+            zmq::message_t* slot = ring->WriteSlot();
+            socket.recv(slot ? slot : &scratch);
+            if (!slot && !IsEndOfStream(scratch)) {
+                ring->Drop();
+                continue;
+            }
+            if (!slot) {
+                // There must be room for the end
+                while ((slot = ring->WriteSlot()) == 0) {
+                    std::this_thread::yield();
+                }
+                slot->move(&scratch);
+            }
+            ring->Commit();
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (ring->Occupancy() == 1) {
+                ringSocket.send(&wake, sizeof(wake), ZMQ_DONTWAIT);
+            }
+            if (IsEndOfStream(*slot)) {
+                break;
+            }
+        }
+    }
+
+    // --parallel: every file on its own, through ReplayDriver
+    int ReplayParallel(const ReplayOptions& options, const vector<unsigned>& channels)
+    {
+        if (options.captured || options.fast || !options.zmqEndpoint.empty()) {
+            std::cerr << "--parallel reads raw files and reconstructs them: no --captured, --fast or --zmq" << std::endl;
+            return 1;
+        }
+
+        ReplayDriver driver(options.gainCalFile, options.alignmentFile, channels);
+        driver.SetPixelMask(options.maskFile);
+        driver.SetAnalyzerAlignment(options.alignmentFile);
+        for (size_t ifile = 0; ifile != options.files.size(); ++ifile) {
+            long const nEvents = driver.Run(options.files[ifile], options.parallel);
+            if (nEvents < 0) {
+                return 1;
+            }
+
+            EventAnalyzer* analyzer = driver.GetAnalyzer();
+            std::cout << options.files[ifile] << ": " << nEvents << " events\n  efficiency";
+            for (unsigned i = 0; i < channels.size(); ++i) {
+                vector<float> const eff = analyzer->GetTelescopeEfficiency(channels[i]);
+                std::cout << " ch" << channels[i] << " " << eff[0] << "/" << eff[1] << "/" << eff[2];
+            }
+            std::cout << "\n  tracks per crossing";
+            for (unsigned i = 0; i < channels.size(); ++i) {
+                std::cout << " ch" << channels[i] << " " << analyzer->GetZeroCounting(channels[i]);
+            }
+            std::cout << "\n  accidentals";
+            for (unsigned i = 0; i < channels.size(); ++i) {
+                std::cout << " ch" << channels[i] << " " << analyzer->GetTelescopeAccidentals(channels[i]);
+            }
+            std::cout << std::endl;
+        }
+        return 0;
+    }
+
+    bool ParseOptions(int argc, char* argv[], ReplayOptions& options)
+    {
+        for (int i = 1; i < argc; ++i) {
+            string const arg = argv[i];
+            bool const hasValue = i + 1 < argc;
+            if (arg == "--captured") {
+                options.captured = true;
+            } else if (arg == "--fast") {
+                options.fast = true;
+            } else if (arg == "--half-charges") {
+                options.halfCharges = true;
+            } else if (arg == "--events-per-message" && hasValue) {
+                options.eventsPerMessage = strtoul(argv[++i], 0, 10);
+            } else if (arg == "--gaincal" && hasValue) {
+                options.gainCalFile = argv[++i];
+            } else if (arg == "--alignment" && hasValue) {
+                options.alignmentFile = argv[++i];
+            } else if (arg == "--mask" && hasValue) {
+                options.maskFile = argv[++i];
+            } else if (arg == "--threads" && hasValue) {
+                options.threads = strtoul(argv[++i], 0, 10);
+            } else if (arg == "--charge-table" && hasValue) {
+                options.chargeTableMB = strtoul(argv[++i], 0, 10);
+            } else if (arg == "--ls-events" && hasValue) {
+                options.lsEvents = strtoul(argv[++i], 0, 10);
+            } else if (arg == "--ls-ms" && hasValue) {
+                options.lsMilliseconds = strtoul(argv[++i], 0, 10);
+            } else if (arg == "--output" && hasValue) {
+                options.outputDir = argv[++i];
+            } else if (arg == "--zmq" && hasValue) {
+                options.zmqEndpoint = argv[++i];
+            } else if (arg == "--rate" && hasValue) {
+                options.rate = atof(argv[++i]);
+            } else if (arg == "--parallel" && hasValue) {
+                options.parallel = strtoul(argv[++i], 0, 10);
+            } else if (arg.compare(0, 2, "--") == 0) {
+                std::cerr << "unknown or incomplete option " << arg << std::endl;
+                return false;
+            } else {
+                options.files.push_back(arg);
+            }
+        }
+        if (options.eventsPerMessage == 0) {
+            options.eventsPerMessage = 1;
+        }
+        return !options.files.empty();
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    ReplayOptions options;
+    if (!ParseOptions(argc, argv, options)) {
+        std::cerr << "usage: " << argv[0] << " [--captured] [--events-per-message N] [--gaincal FILE] [--alignment FILE] [--mask FILE]"
+            << " [--fast] [--threads N] [--charge-table MB [--half-charges]] [--ls-events N | --ls-ms T] [--output DIR] [--zmq ENDPOINT [--rate N]] [--parallel N] file [file ...]" << std::endl;
+        return 1;
+    }
+
+    // The same channels as online
+    const unsigned validChannels[] = {2, 4, 5, 8, 10, 11, 13, 14, 16, 17, 19, 20};
+    vector<unsigned> channels(validChannels, validChannels + sizeof(validChannels)/sizeof(unsigned));
+
+    if (options.parallel > 0) {
+        return ReplayParallel(options, channels);
+    }
+
+    PipelineMetrics metrics;
+    SlinkPipeline pipeline(options.gainCalFile, options.alignmentFile, options.maskFile, channels, metrics);
+    pipeline.SetFullReconstruction(!options.fast, options.threads);
+    pipeline.SetChargeTable((size_t) options.chargeTableMB << 20, options.halfCharges);
+    LumiSectionFiles* files = options.outputDir.empty() ? 0 : new LumiSectionFiles(options.outputDir);
+
+    LumiSectionClock clock(options);
+    int ls = 1;
+    int lsStartEvents = 0;
+    double pipelineSeconds = 0.;
+    unsigned long nMessages = 0;
+    unsigned long nBytes = 0;
+
+    // Only used with --zmq
+    bool const viaZmq = !options.zmqEndpoint.empty();
+    SlinkRing<zmq::message_t> ring(viaZmq ? 4096 : 1);
+
+    // The lumisection so far: print it and write it out
+    auto lumiSection = [&] (int ls) {
+        LumiSectionSummary* summary = pipeline.EndLumiSection(0, 1, ls, 0);
+        if (viaZmq) {
+            summary->ringHighWater = ring.HighWater();
+            summary->ringSlots     = ring.NSlots();
+            summary->ringDropped   = ring.Dropped();
+        }
+        PrintLumiSection(*summary, summary->nevents - lsStartEvents, metrics);
+        lsStartEvents = summary->nevents;
+        if (files) {
+            files->Write(*summary);
+        }
+        delete summary;
+    };
+
+    // One message through the pipeline, and the lumisection if it is over
+    auto process = [&] (const void* data, size_t size) {
+        std::chrono::steady_clock::time_point const start = std::chrono::steady_clock::now();
+        pipeline.DecodeMessage(data, size);
+        pipeline.ProcessEvents();
+        pipelineSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        ++nMessages;
+        nBytes += size;
+
+        if (clock.Boundary(pipeline.GetEvent()->GetBatch(), pipeline.NEvents())) {
+            lumiSection(ls++);
+        }
+    };
+
+    std::chrono::steady_clock::time_point const start = std::chrono::steady_clock::now();
+    if (!viaZmq) {
+        MessageSource source(options);
+        vector<uint32_t> words;
+        while (source.Next(words)) {
+            process(words.empty() ? 0 : &words[0], words.size() * sizeof(uint32_t));
+        }
+    } else {
+        zmq::context_t context(1);
+        zmq::socket_t publisher(context, ZMQ_PUB);
+
+        // zmq would drop messages silently at its high-water marks; without
+        // them every message gets to the ring, and only drops there count
+        int const noLimit = 0;
+        publisher.setsockopt(ZMQ_SNDHWM, &noLimit, sizeof(noLimit));
+        publisher.bind(options.zmqEndpoint.c_str());
+
+        // As zmqClient, sleep while the ring is empty until the receiver wakes us
+        zmq::socket_t ringSocket(context, ZMQ_PAIR);
+        ringSocket.bind(RING_ENDPOINT);
+        std::thread receiver(Receive, &context, options.zmqEndpoint, &ring);
+        std::thread sender(Publish, &publisher, &options);
+
+        bool done = false;
+        char wake;
+        while (!done) {
+            zmq::message_t* message = ring.ReadSlot();
+            if (!message) {
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (ring.Occupancy() == 0) {
+                    ringSocket.recv(&wake, sizeof(wake));
+                }
+                continue;
+            }
+            done = IsEndOfStream(*message);
+            if (!done) {
+                process(message->data(), message->size());
+            }
+            message->rebuild();
+            ring.Release();
+        }
+        sender.join();
+        receiver.join();
+    }
+    double const seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // What is left makes the last lumisection
+    if (pipeline.NEvents() > lsStartEvents) {
+        lumiSection(ls);
+    }
+
+    int const nEvents = pipeline.NEvents();
+    std::cout << nEvents << " events in " << nMessages << " messages (" << nBytes / 1e6 << " MB)"
+        << " in " << seconds << " s: " << nEvents / seconds << " events/s;"
+        << " in the pipeline " << pipelineSeconds << " s: " << nEvents / pipelineSeconds << " events/s, "
+        << nBytes / 1e6 / pipelineSeconds << " MB/s" << std::endl;
+    if (viaZmq) {
+        std::cout << "ring: " << ring.Received() << " messages received, " << ring.Dropped() << " dropped, high water "
+            << ring.HighWater() << "/" << ring.NSlots() << std::endl;
+    }
+
+    delete files;
+    return 0;
+}